@@ -31,8 +31,19 @@
 #include <zlib.h>
 #include <QByteArray>
 #include <QDebug>
+#include <QString>
+
+#ifdef TILED_ZSTD_SUPPORT
+#include <zstd.h>
+#endif
+
+#ifdef TILED_LZ4_SUPPORT
+#include <lz4frame.h>
+#include <string.h>
+#endif
 
 using namespace Tiled;
+using namespace Tiled::Internal;
 
 // TODO: Improve error reporting by showing these errors in the user interface
 static void logZlibError(int error)
@@ -54,8 +65,100 @@ static void logZlibError(int error)
     }
 }
 
-QByteArray Tiled::decompress(const QByteArray &data, int expectedSize)
+QString Tiled::compressionStrategyToString(CompressionStrategy strategy)
+{
+    switch (strategy) {
+    case FilteredStrategy:
+        return QLatin1String("filtered");
+    case RunLengthStrategy:
+        return QLatin1String("rle");
+    case DefaultStrategy:
+        break;
+    }
+    return QLatin1String("default");
+}
+
+CompressionStrategy Tiled::compressionStrategyFromString(const QString &name,
+                                                         bool *ok)
+{
+    if (ok)
+        *ok = true;
+
+    if (name == QLatin1String("filtered"))
+        return FilteredStrategy;
+    if (name == QLatin1String("rle"))
+        return RunLengthStrategy;
+
+    if (ok && name != QLatin1String("default"))
+        *ok = false;
+
+    return DefaultStrategy;
+}
+
+bool Tiled::isCompressionMethodSupported(CompressionMethod method)
+{
+    switch (method) {
+    case Gzip:
+    case Zlib:
+        return true;
+    case Zstandard:
+#ifdef TILED_ZSTD_SUPPORT
+        return true;
+#else
+        return false;
+#endif
+    case LZ4:
+#ifdef TILED_LZ4_SUPPORT
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+/**
+ * Decompresses \a data using a Decompressor, for the methods not handled by
+ * zlib.
+ */
+static QByteArray decompressStreaming(const QByteArray &data,
+                                      int expectedSize,
+                                      CompressionMethod method)
+{
+    Decompressor decompressor(method);
+    decompressor.setInput(data.constData(), data.length());
+
+    QByteArray out;
+    out.resize(qMax(expectedSize, 1024));
+    int outLength = 0;
+
+    for (;;) {
+        if (outLength == out.size())
+            out.resize(out.size() * 2);
+
+        const int length = decompressor.read(out.data() + outLength,
+                                             out.size() - outLength);
+        if (length < 0)
+            return QByteArray();
+        if (length == 0)
+            break;
+
+        outLength += length;
+    }
+
+    if (!decompressor.atEnd())
+        return QByteArray();
+
+    out.resize(outLength);
+    return out;
+}
+
+QByteArray Tiled::decompress(const QByteArray &data, int expectedSize,
+                             CompressionMethod method)
 {
+    if (method != Gzip && method != Zlib)
+        return decompressStreaming(data, expectedSize, method);
+
     QByteArray out;
     out.resize(expectedSize);
     z_stream strm;
@@ -111,10 +214,72 @@ QByteArray Tiled::decompress(const QByteArray &data, int expectedSize)
     return out;
 }
 
-QByteArray Tiled::compress(const QByteArray &data, CompressionMethod method)
+static int zlibStrategy(CompressionStrategy strategy)
 {
+    switch (strategy) {
+    case FilteredStrategy:
+        return Z_FILTERED;
+    case RunLengthStrategy:
+        return Z_RLE;
+    case DefaultStrategy:
+        break;
+    }
+    return Z_DEFAULT_STRATEGY;
+}
+
+static int initDeflate(z_stream *strm, CompressionMethod method,
+                       int level, CompressionStrategy strategy)
+{
+    const int windowBits = (method == Gzip) ? 15 + 16 : 15;
+
+    if (level < DefaultCompression || level > BestCompression)
+        level = DefaultCompression;
+
+    return deflateInit2(strm, level, Z_DEFLATED, windowBits,
+                        8, zlibStrategy(strategy));
+}
+
+/**
+ * Compresses \a data using a Compressor, for the methods not handled by
+ * zlib.
+ */
+static QByteArray compressStreaming(const QByteArray &data,
+                                    CompressionMethod method,
+                                    int level)
+{
+    Compressor compressor(method, level);
+    compressor.setInput(data.constData(), data.length());
+    compressor.finish();
+
+    QByteArray out;
+    out.resize(qMax(data.length() / 2, 1024));
+    int outLength = 0;
+
+    for (;;) {
+        if (outLength == out.size())
+            out.resize(out.size() * 2);
+
+        const int length = compressor.read(out.data() + outLength,
+                                           out.size() - outLength);
+        if (length < 0)
+            return QByteArray();
+        if (length == 0)
+            break;
+
+        outLength += length;
+    }
+
+    out.resize(outLength);
+    return out;
+}
+
+QByteArray Tiled::compress(const QByteArray &data, CompressionMethod method,
+                           int level, CompressionStrategy strategy)
+{
+    if (method != Gzip && method != Zlib)
+        return compressStreaming(data, method, level);
+
     QByteArray out;
-    out.resize(1024);
     int err;
     z_stream strm;
     strm.zalloc = Z_NULL;
@@ -122,18 +287,19 @@ QByteArray Tiled::compress(const QByteArray &data, CompressionMethod method)
     strm.opaque = Z_NULL;
     strm.next_in = (Bytef *) data.data();
     strm.avail_in = data.length();
-    strm.next_out = (Bytef *) out.data();
-    strm.avail_out = out.size();
 
-    const int windowBits = (method == Gzip) ? 15 + 16 : 15;
-
-    err = deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits,
-                       8, Z_DEFAULT_STRATEGY);
+    err = initDeflate(&strm, method, level, strategy);
     if (err != Z_OK) {
         logZlibError(err);
         return QByteArray();
     }
 
+    // The whole output should fit in here, avoiding any reallocations.
+    // Older zlib versions leave the gzip header out of the bound.
+    out.resize(deflateBound(&strm, data.length()) + 18);
+    strm.next_out = (Bytef *) out.data();
+    strm.avail_out = out.size();
+
     do {
         err = deflate(&strm, Z_FINISH);
         Q_ASSERT(err != Z_STREAM_ERROR);
@@ -160,3 +326,660 @@ QByteArray Tiled::compress(const QByteArray &data, CompressionMethod method)
     out.resize(outLength);
     return out;
 }
+
+
+namespace Tiled {
+namespace Internal {
+
+/**
+ * The interface implemented by each of the supported compression methods
+ * for incremental decompression.
+ */
+class DecompressorBackend
+{
+public:
+    enum State {
+        Running,
+        Finished,
+        Failed
+    };
+
+    DecompressorBackend() : mState(Running) {}
+    virtual ~DecompressorBackend() {}
+
+    virtual void setInput(const char *data, int length) = 0;
+    virtual int read(char *out, int maxLength) = 0;
+
+    State state() const { return mState; }
+
+protected:
+    State mState;
+};
+
+/**
+ * The interface implemented by each of the supported compression methods
+ * for incremental compression.
+ */
+class CompressorBackend
+{
+public:
+    enum State {
+        Running,
+        Finished,
+        Failed
+    };
+
+    CompressorBackend() : mState(Running), mFinishing(false) {}
+    virtual ~CompressorBackend() {}
+
+    virtual void setInput(const char *data, int length) = 0;
+    virtual int read(char *out, int maxLength) = 0;
+
+    void finish() { mFinishing = true; }
+    State state() const { return mState; }
+
+protected:
+    State mState;
+    bool mFinishing;
+};
+
+} // namespace Internal
+} // namespace Tiled
+
+namespace {
+
+class ZlibDecompressor : public DecompressorBackend
+{
+public:
+    ZlibDecompressor()
+        : mInitialized(false)
+    {
+        mStream.zalloc = Z_NULL;
+        mStream.zfree = Z_NULL;
+        mStream.opaque = Z_NULL;
+        mStream.next_in = Z_NULL;
+        mStream.avail_in = 0;
+
+        // Automatically detects zlib and gzip headers
+        const int ret = inflateInit2(&mStream, 15 + 32);
+
+        if (ret == Z_OK) {
+            mInitialized = true;
+        } else {
+            logZlibError(ret);
+            mState = Failed;
+        }
+    }
+
+    ~ZlibDecompressor()
+    {
+        if (mInitialized)
+            inflateEnd(&mStream);
+    }
+
+    void setInput(const char *data, int length)
+    {
+        mStream.next_in = (Bytef *) data;
+        mStream.avail_in = length;
+    }
+
+    int read(char *out, int maxLength)
+    {
+        if (mState == Failed)
+            return -1;
+
+        mStream.next_out = (Bytef *) out;
+        mStream.avail_out = maxLength;
+
+        while (mState == Running && mStream.avail_out > 0) {
+            int ret = inflate(&mStream, Z_SYNC_FLUSH);
+
+            switch (ret) {
+                case Z_NEED_DICT:
+                case Z_STREAM_ERROR:
+                    ret = Z_DATA_ERROR;
+                case Z_DATA_ERROR:
+                case Z_MEM_ERROR:
+                    logZlibError(ret);
+                    mState = Failed;
+                    return -1;
+            }
+
+            if (ret == Z_STREAM_END)
+                mState = Finished;
+            else if (ret == Z_BUF_ERROR || mStream.avail_in == 0)
+                break; // Needs more input
+        }
+
+        // There should be no data after the end of the stream
+        if (mState == Finished && mStream.avail_in != 0) {
+            logZlibError(Z_DATA_ERROR);
+            mState = Failed;
+            return -1;
+        }
+
+        return maxLength - mStream.avail_out;
+    }
+
+private:
+    z_stream mStream;
+    bool mInitialized;
+};
+
+class ZlibCompressor : public CompressorBackend
+{
+public:
+    ZlibCompressor(CompressionMethod method,
+                   int level, CompressionStrategy strategy)
+        : mInitialized(false)
+    {
+        mStream.zalloc = Z_NULL;
+        mStream.zfree = Z_NULL;
+        mStream.opaque = Z_NULL;
+        mStream.next_in = Z_NULL;
+        mStream.avail_in = 0;
+
+        const int ret = initDeflate(&mStream, method, level, strategy);
+
+        if (ret == Z_OK) {
+            mInitialized = true;
+        } else {
+            logZlibError(ret);
+            mState = Failed;
+        }
+    }
+
+    ~ZlibCompressor()
+    {
+        if (mInitialized)
+            deflateEnd(&mStream);
+    }
+
+    void setInput(const char *data, int length)
+    {
+        mStream.next_in = (Bytef *) data;
+        mStream.avail_in = length;
+    }
+
+    int read(char *out, int maxLength)
+    {
+        if (mState == Failed)
+            return -1;
+
+        mStream.next_out = (Bytef *) out;
+        mStream.avail_out = maxLength;
+
+        while (mState == Running && mStream.avail_out > 0) {
+            if (!mFinishing && mStream.avail_in == 0)
+                break; // Needs more input
+
+            const int ret = deflate(&mStream,
+                                    mFinishing ? Z_FINISH : Z_NO_FLUSH);
+
+            if (ret == Z_STREAM_END) {
+                mState = Finished;
+            } else if (ret == Z_BUF_ERROR) {
+                break; // No progress possible
+            } else if (ret != Z_OK) {
+                logZlibError(ret);
+                mState = Failed;
+                return -1;
+            }
+        }
+
+        return maxLength - mStream.avail_out;
+    }
+
+private:
+    z_stream mStream;
+    bool mInitialized;
+};
+
+#ifdef TILED_ZSTD_SUPPORT
+
+class ZstdDecompressor : public DecompressorBackend
+{
+public:
+    ZstdDecompressor()
+        : mStream(ZSTD_createDStream())
+    {
+        mInput.src = 0;
+        mInput.size = 0;
+        mInput.pos = 0;
+
+        if (!mStream || ZSTD_isError(ZSTD_initDStream(mStream))) {
+            qDebug() << "Unable to initialize Zstandard decompression!";
+            mState = Failed;
+        }
+    }
+
+    ~ZstdDecompressor()
+    {
+        ZSTD_freeDStream(mStream);
+    }
+
+    void setInput(const char *data, int length)
+    {
+        mInput.src = data;
+        mInput.size = length;
+        mInput.pos = 0;
+    }
+
+    int read(char *out, int maxLength)
+    {
+        if (mState == Failed)
+            return -1;
+
+        ZSTD_outBuffer output = { out, size_t(maxLength), 0 };
+
+        while (mState == Running && output.pos < output.size) {
+            const size_t ret = ZSTD_decompressStream(mStream,
+                                                     &output, &mInput);
+            if (ZSTD_isError(ret)) {
+                qDebug() << "Incorrect Zstandard compressed data:"
+                         << ZSTD_getErrorName(ret);
+                mState = Failed;
+                return -1;
+            }
+
+            if (ret == 0)
+                mState = Finished;
+            else if (mInput.pos == mInput.size && output.pos < output.size)
+                break; // Needs more input
+        }
+
+        // There should be no data after the end of the frame
+        if (mState == Finished && mInput.pos != mInput.size) {
+            qDebug() << "Incorrect Zstandard compressed data!";
+            mState = Failed;
+            return -1;
+        }
+
+        return int(output.pos);
+    }
+
+private:
+    ZSTD_DStream *mStream;
+    ZSTD_inBuffer mInput;
+};
+
+class ZstdCompressor : public CompressorBackend
+{
+public:
+    ZstdCompressor(int level)
+        : mStream(ZSTD_createCStream())
+    {
+        mInput.src = 0;
+        mInput.size = 0;
+        mInput.pos = 0;
+
+        // Zstandard has its own default level, and goes beyond level 9
+        if (level == DefaultCompression)
+            level = 3;
+
+        if (!mStream || ZSTD_isError(ZSTD_initCStream(mStream, level))) {
+            qDebug() << "Unable to initialize Zstandard compression!";
+            mState = Failed;
+        }
+    }
+
+    ~ZstdCompressor()
+    {
+        ZSTD_freeCStream(mStream);
+    }
+
+    void setInput(const char *data, int length)
+    {
+        mInput.src = data;
+        mInput.size = length;
+        mInput.pos = 0;
+    }
+
+    int read(char *out, int maxLength)
+    {
+        if (mState == Failed)
+            return -1;
+
+        ZSTD_outBuffer output = { out, size_t(maxLength), 0 };
+
+        while (mState == Running && output.pos < output.size) {
+            size_t ret;
+
+            if (mInput.pos < mInput.size) {
+                ret = ZSTD_compressStream(mStream, &output, &mInput);
+            } else if (mFinishing) {
+                ret = ZSTD_endStream(mStream, &output);
+                if (ret == 0)
+                    mState = Finished;
+            } else {
+                break; // Needs more input
+            }
+
+            if (ZSTD_isError(ret)) {
+                qDebug() << "Error while compressing data:"
+                         << ZSTD_getErrorName(ret);
+                mState = Failed;
+                return -1;
+            }
+        }
+
+        return int(output.pos);
+    }
+
+private:
+    ZSTD_CStream *mStream;
+    ZSTD_inBuffer mInput;
+};
+
+#endif // TILED_ZSTD_SUPPORT
+
+#ifdef TILED_LZ4_SUPPORT
+
+class Lz4Decompressor : public DecompressorBackend
+{
+public:
+    Lz4Decompressor()
+        : mContext(0)
+        , mInput(0)
+        , mInputSize(0)
+    {
+        const LZ4F_errorCode_t ret =
+                LZ4F_createDecompressionContext(&mContext, LZ4F_VERSION);
+        if (LZ4F_isError(ret)) {
+            qDebug() << "Unable to initialize LZ4 decompression!";
+            mContext = 0;
+            mState = Failed;
+        }
+    }
+
+    ~Lz4Decompressor()
+    {
+        if (mContext)
+            LZ4F_freeDecompressionContext(mContext);
+    }
+
+    void setInput(const char *data, int length)
+    {
+        mInput = data;
+        mInputSize = length;
+    }
+
+    int read(char *out, int maxLength)
+    {
+        if (mState == Failed)
+            return -1;
+
+        int outLength = 0;
+
+        while (mState == Running && outLength < maxLength) {
+            size_t dstSize = maxLength - outLength;
+            size_t srcSize = mInputSize;
+
+            const size_t ret = LZ4F_decompress(mContext,
+                                               out + outLength, &dstSize,
+                                               mInput, &srcSize, 0);
+            if (LZ4F_isError(ret)) {
+                qDebug() << "Incorrect LZ4 compressed data:"
+                         << LZ4F_getErrorName(ret);
+                mState = Failed;
+                return -1;
+            }
+
+            mInput += srcSize;
+            mInputSize -= int(srcSize);
+            outLength += int(dstSize);
+
+            if (ret == 0)
+                mState = Finished;
+            else if (srcSize == 0 && dstSize == 0)
+                break; // Needs more input
+        }
+
+        // There should be no data after the end of the frame
+        if (mState == Finished && mInputSize != 0) {
+            qDebug() << "Incorrect LZ4 compressed data!";
+            mState = Failed;
+            return -1;
+        }
+
+        return outLength;
+    }
+
+private:
+    LZ4F_decompressionContext_t mContext;
+    const char *mInput;
+    int mInputSize;
+};
+
+/**
+ * The LZ4 frame API needs room for a whole compressed block in the output
+ * buffer, so the compressed data goes through an internal buffer.
+ */
+class Lz4Compressor : public CompressorBackend
+{
+public:
+    Lz4Compressor(int level)
+        : mContext(0)
+        , mInput(0)
+        , mInputSize(0)
+        , mStarted(false)
+        , mPendingOffset(0)
+    {
+        memset(&mPreferences, 0, sizeof(mPreferences));
+        mPreferences.compressionLevel = (level == DefaultCompression)
+                ? 0 : level;
+
+        const LZ4F_errorCode_t ret =
+                LZ4F_createCompressionContext(&mContext, LZ4F_VERSION);
+        if (LZ4F_isError(ret)) {
+            qDebug() << "Unable to initialize LZ4 compression!";
+            mContext = 0;
+            mState = Failed;
+        }
+    }
+
+    ~Lz4Compressor()
+    {
+        if (mContext)
+            LZ4F_freeCompressionContext(mContext);
+    }
+
+    void setInput(const char *data, int length)
+    {
+        mInput = data;
+        mInputSize = length;
+    }
+
+    int read(char *out, int maxLength)
+    {
+        if (mState == Failed)
+            return -1;
+
+        int outLength = 0;
+
+        while (outLength < maxLength) {
+            // Hand out what was compressed before
+            const int pending = mPending.size() - mPendingOffset;
+            if (pending > 0) {
+                const int count = qMin(pending, maxLength - outLength);
+                memcpy(out + outLength,
+                       mPending.constData() + mPendingOffset, count);
+                mPendingOffset += count;
+                outLength += count;
+                continue;
+            }
+
+            if (mState != Running || !fillPending())
+                break;
+        }
+
+        return (mState == Failed) ? -1 : outLength;
+    }
+
+private:
+    enum { BlockSize = 65536 };
+
+    /**
+     * Compresses the next piece of input into the pending buffer. Returns
+     * false when nothing could be done.
+     */
+    bool fillPending()
+    {
+        size_t ret;
+        mPendingOffset = 0;
+
+        if (!mStarted) {
+            mPending.resize(LZ4F_HEADER_SIZE_MAX);
+            ret = LZ4F_compressBegin(mContext, mPending.data(),
+                                     mPending.size(), &mPreferences);
+            mStarted = true;
+        } else if (mInputSize > 0) {
+            const int count = qMin(mInputSize, int(BlockSize));
+            mPending.resize(int(LZ4F_compressBound(count, &mPreferences)));
+            ret = LZ4F_compressUpdate(mContext, mPending.data(),
+                                      mPending.size(), mInput, count, 0);
+            mInput += count;
+            mInputSize -= count;
+        } else if (mFinishing) {
+            mPending.resize(int(LZ4F_compressBound(0, &mPreferences)));
+            ret = LZ4F_compressEnd(mContext, mPending.data(),
+                                   mPending.size(), 0);
+            mState = Finished;
+        } else {
+            mPending.resize(0);
+            return false; // Needs more input
+        }
+
+        if (LZ4F_isError(ret)) {
+            qDebug() << "Error while compressing data:"
+                     << LZ4F_getErrorName(ret);
+            mState = Failed;
+            mPending.resize(0);
+            return false;
+        }
+
+        mPending.resize(int(ret));
+        return true;
+    }
+
+    LZ4F_compressionContext_t mContext;
+    LZ4F_preferences_t mPreferences;
+    const char *mInput;
+    int mInputSize;
+    bool mStarted;
+    QByteArray mPending;
+    int mPendingOffset;
+};
+
+#endif // TILED_LZ4_SUPPORT
+
+} // anonymous namespace
+
+static DecompressorBackend *createDecompressorBackend(CompressionMethod method)
+{
+    switch (method) {
+    case Gzip:
+    case Zlib:
+        return new ZlibDecompressor;
+    case Zstandard:
+#ifdef TILED_ZSTD_SUPPORT
+        return new ZstdDecompressor;
+#else
+        break;
+#endif
+    case LZ4:
+#ifdef TILED_LZ4_SUPPORT
+        return new Lz4Decompressor;
+#else
+        break;
+#endif
+    }
+    return 0;
+}
+
+static CompressorBackend *createCompressorBackend(CompressionMethod method,
+                                                  int level,
+                                                  CompressionStrategy strategy)
+{
+    switch (method) {
+    case Gzip:
+    case Zlib:
+        return new ZlibCompressor(method, level, strategy);
+    case Zstandard:
+#ifdef TILED_ZSTD_SUPPORT
+        return new ZstdCompressor(level);
+#else
+        break;
+#endif
+    case LZ4:
+#ifdef TILED_LZ4_SUPPORT
+        return new Lz4Compressor(level);
+#else
+        break;
+#endif
+    }
+    return 0;
+}
+
+Decompressor::Decompressor(CompressionMethod method)
+    : d(createDecompressorBackend(method))
+{
+    if (!d)
+        qDebug() << "Compression method not supported:" << int(method);
+}
+
+Decompressor::~Decompressor()
+{
+    delete d;
+}
+
+void Decompressor::setInput(const char *data, int length)
+{
+    if (d)
+        d->setInput(data, length);
+}
+
+int Decompressor::read(char *out, int maxLength)
+{
+    return d ? d->read(out, maxLength) : -1;
+}
+
+bool Decompressor::atEnd() const
+{
+    return d && d->state() == DecompressorBackend::Finished;
+}
+
+Compressor::Compressor(CompressionMethod method,
+                       int level, CompressionStrategy strategy)
+    : d(createCompressorBackend(method, level, strategy))
+{
+    if (!d)
+        qDebug() << "Compression method not supported:" << int(method);
+}
+
+Compressor::~Compressor()
+{
+    delete d;
+}
+
+void Compressor::setInput(const char *data, int length)
+{
+    if (d)
+        d->setInput(data, length);
+}
+
+void Compressor::finish()
+{
+    if (d)
+        d->finish();
+}
+
+int Compressor::read(char *out, int maxLength)
+{
+    return d ? d->read(out, maxLength) : -1;
+}
+
+bool Compressor::atEnd() const
+{
+    return d && d->state() == CompressorBackend::Finished;
+}
@@ -32,17 +32,72 @@
 #include "tiled_global.h"
 
 class QByteArray;
+class QString;
 
 namespace Tiled {
 
+namespace Internal {
+class DecompressorBackend;
+class CompressorBackend;
+}
+
+/**
+ * The compression methods for tile layer data. Gzip and Zlib are always
+ * available, the others only when libtiled was built with support for them
+ * (see isCompressionMethodSupported()).
+ */
 enum CompressionMethod {
     Gzip,
-    Zlib
+    Zlib,
+    Zstandard,
+    LZ4
+};
+
+/**
+ * Returns whether the given compression \a method is available in this
+ * build.
+ */
+bool TILEDSHARED_EXPORT isCompressionMethodSupported(CompressionMethod method);
+
+/**
+ * The compression levels accepted by compress() and Compressor. Any level
+ * in between FastestCompression and BestCompression can be used as well.
+ */
+enum CompressionLevel {
+    DefaultCompression = -1,
+    NoCompression = 0,
+    FastestCompression = 1,
+    BestCompression = 9
 };
 
 /**
- * Decompresses either zlib or gzip compressed memory. Returns a null
- * QByteArray if decompressing failed.
+ * The strategies accepted by compress() and Compressor. Tile layer data is
+ * often highly repetitive, which makes RunLengthStrategy at a low level a
+ * lot faster at nearly the same compressed size.
+ */
+enum CompressionStrategy {
+    DefaultStrategy,
+    FilteredStrategy,
+    RunLengthStrategy
+};
+
+/**
+ * Returns the name of the given compression \a strategy, as used in the TMX
+ * format and on the command line.
+ */
+QString TILEDSHARED_EXPORT compressionStrategyToString(
+        CompressionStrategy strategy);
+
+/**
+ * Returns the compression strategy with the given \a name. Sets \a ok to
+ * false and returns DefaultStrategy when the name is not recognized.
+ */
+CompressionStrategy TILEDSHARED_EXPORT compressionStrategyFromString(
+        const QString &name, bool *ok = 0);
+
+/**
+ * Decompresses compressed memory. Returns a null QByteArray if
+ * decompressing failed.
  *
  * Needed because qUncompress does not support gzip compressed data. Also,
  * this method does not need the expected size to be prepended to the data,
@@ -50,22 +105,119 @@ enum CompressionMethod {
  *
  * @param data         the compressed data
  * @param expectedSize the expected size of the uncompressed data in bytes
+ * @param method       the compression format, where Zlib and Gzip are
+ *                     detected automatically
  * @return the uncompressed data, or a null QByteArray if decompressing failed
  */
 QByteArray TILEDSHARED_EXPORT decompress(const QByteArray &data,
-                                         int expectedSize = 1024);
+                                         int expectedSize = 1024,
+                                         CompressionMethod method = Zlib);
 
 /**
- * Compresses the give data in either gzip or zlib format. Returns a null
+ * Compresses the give data in the given format. Returns a null
  * QByteArray if compression failed.
  *
  * Needed because qCompress does not support gzip compression.
  *
- * @param data the uncompressed data
+ * @param data     the uncompressed data
+ * @param method   the compression format
+ * @param level    the compression level, from 0 to 9 or DefaultCompression
+ * @param strategy the compression strategy, only used by gzip and zlib
  * @return the compressed data, or a null QByteArray if compression failed
  */
 QByteArray TILEDSHARED_EXPORT compress(const QByteArray &data,
-                                       CompressionMethod method = Zlib);
+                                       CompressionMethod method = Zlib,
+                                       int level = DefaultCompression,
+                                       CompressionStrategy strategy =
+                                               DefaultStrategy);
+
+/**
+ * Decompresses compressed data incrementally. Unlike decompress(), neither
+ * the compressed nor the uncompressed data needs to be held in memory all
+ * at once.
+ */
+class TILEDSHARED_EXPORT Decompressor
+{
+public:
+    /**
+     * Creates a decompressor for the given \a method. Zlib and gzip headers
+     * are detected automatically. When the method is not supported, read()
+     * always fails.
+     */
+    explicit Decompressor(CompressionMethod method = Zlib);
+    ~Decompressor();
+
+    /**
+     * Sets the next piece of compressed data. The data needs to stay valid
+     * until read() returns 0.
+     */
+    void setInput(const char *data, int length);
+
+    /**
+     * Decompresses as much of the input as fits into \a out.
+     *
+     * @return the number of bytes written to \a out, 0 when more input is
+     *         needed or the end of the stream has been reached, or -1 when
+     *         the data is corrupt
+     */
+    int read(char *out, int maxLength);
+
+    /**
+     * Returns whether the end of the compressed stream has been reached.
+     */
+    bool atEnd() const;
+
+private:
+    Q_DISABLE_COPY(Decompressor)
+
+    Internal::DecompressorBackend *d;
+};
+
+/**
+ * Compresses data in the given format incrementally. When the method is not
+ * supported, read() always fails. Unlike
+ * compress(), neither the uncompressed nor the compressed data needs to be
+ * held in memory all at once.
+ */
+class TILEDSHARED_EXPORT Compressor
+{
+public:
+    explicit Compressor(CompressionMethod method = Zlib,
+                        int level = DefaultCompression,
+                        CompressionStrategy strategy = DefaultStrategy);
+    ~Compressor();
+
+    /**
+     * Sets the next piece of uncompressed data. The data needs to stay valid
+     * until read() returns 0.
+     */
+    void setInput(const char *data, int length);
+
+    /**
+     * Indicates that all data has been passed to setInput(). The remaining
+     * compressed data can then be retrieved with read().
+     */
+    void finish();
+
+    /**
+     * Compresses as much of the input as fits into \a out.
+     *
+     * @return the number of bytes written to \a out, 0 when more input is
+     *         needed or the end of the stream has been written, or -1 when
+     *         compression failed
+     */
+    int read(char *out, int maxLength);
+
+    /**
+     * Returns whether the end of the compressed stream has been written.
+     */
+    bool atEnd() const;
+
+private:
+    Q_DISABLE_COPY(Compressor)
+
+    Internal::CompressorBackend *d;
+};
 
 } // namespace Tiled
 
@@ -30,10 +30,9 @@
  */
 
 #include "imagelayer.h"
+#include "imageutils.h"
 #include "map.h"
 
-#include <QBitmap>
-
 using namespace Tiled;
 
 ImageLayer::ImageLayer(const QString &name,
@@ -58,13 +57,11 @@ bool ImageLayer::loadFromImage(const QImage &image, const QString &fileName)
     if (image.isNull())
         return false;
 
-    mImage = QPixmap::fromImage(image);
-
     if (mTransparentColor.isValid())
-    {
-        const QImage mask = image.createMaskFromColor(mTransparentColor.rgb());
-        mImage.setMask(QBitmap::fromImage(mask));
-    }
+        mImage = QPixmap::fromImage(makeColorTransparent(image,
+                                                         mTransparentColor));
+    else
+        mImage = QPixmap::fromImage(image);
 
     mImageSource = fileName;
 
@@ -0,0 +1,360 @@
+/*
+ * imageutils.cpp
+ * Copyright 2026, agent <agent@local>
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "imageutils.h"
+
+#include <QColor>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QVector>
+
+using namespace Tiled;
+
+namespace {
+
+/**
+ * Images with fewer rows than this are not worth splitting up.
+ */
+const int MinimumStripeHeight = 128;
+
+/**
+ * Makes the pixels of one color transparent within a range of scan lines.
+ */
+class ColorKeyJob : public QRunnable
+{
+public:
+    ColorKeyJob(uchar *bits, int bytesPerLine, int width,
+                int firstLine, int lineCount,
+                QRgb color, QSemaphore *done)
+        : mBits(bits)
+        , mBytesPerLine(bytesPerLine)
+        , mWidth(width)
+        , mFirstLine(firstLine)
+        , mLineCount(lineCount)
+        , mColor(color)
+        , mDone(done)
+    {
+        setAutoDelete(false);
+    }
+
+    void run()
+    {
+        const int lastLine = mFirstLine + mLineCount;
+        for (int y = mFirstLine; y < lastLine; ++y) {
+            QRgb *pixel = reinterpret_cast<QRgb*>(mBits + y * mBytesPerLine);
+            QRgb *end = pixel + mWidth;
+            for (; pixel != end; ++pixel)
+                if (*pixel == mColor)
+                    *pixel = 0;
+        }
+        if (mDone)
+            mDone->release();
+    }
+
+private:
+    uchar *mBits;
+    int mBytesPerLine;
+    int mWidth;
+    int mFirstLine;
+    int mLineCount;
+    QRgb mColor;
+    QSemaphore *mDone;
+};
+
+/**
+ * Copies a range of areas out of an image.
+ */
+class CopyAreasJob : public QRunnable
+{
+public:
+    CopyAreasJob(const QImage &image, const QList<QRect> &rects,
+                 QImage *results, int first, int count, QSemaphore *done)
+        : mImage(image)
+        , mRects(rects)
+        , mResults(results)
+        , mFirst(first)
+        , mCount(count)
+        , mDone(done)
+    {
+        setAutoDelete(false);
+    }
+
+    void run()
+    {
+        for (int i = mFirst; i < mFirst + mCount; ++i)
+            mResults[i] = mImage.copy(mRects.at(i));
+        if (mDone)
+            mDone->release();
+    }
+
+private:
+    const QImage &mImage;
+    const QList<QRect> &mRects;
+    QImage *mResults;
+    int mFirst;
+    int mCount;
+    QSemaphore *mDone;
+};
+
+/**
+ * Returns the average of the pixels of \a rect within \a image, which needs
+ * to be in the premultiplied ARGB32 format.
+ */
+QRgb averagePremultiplied(const QImage &image, const QRect &rect)
+{
+    const QRect area = rect & image.rect();
+    if (area.isEmpty())
+        return 0;
+
+    quint64 alpha = 0, red = 0, green = 0, blue = 0;
+
+    for (int y = area.top(); y <= area.bottom(); ++y) {
+        const QRgb *pixel =
+                reinterpret_cast<const QRgb*>(image.scanLine(y))
+                + area.left();
+        const QRgb *end = pixel + area.width();
+        for (; pixel != end; ++pixel) {
+            alpha += qAlpha(*pixel);
+            red += qRed(*pixel);
+            green += qGreen(*pixel);
+            blue += qBlue(*pixel);
+        }
+    }
+
+    const quint64 count = quint64(area.width()) * area.height();
+    return qRgba(int(red / count), int(green / count),
+                 int(blue / count), int(alpha / count));
+}
+
+/**
+ * Computes the average colors of a range of areas of an image.
+ */
+class AverageColorsJob : public QRunnable
+{
+public:
+    AverageColorsJob(const QImage &image, const QList<QRect> &rects,
+                     QRgb *results, int first, int count, QSemaphore *done)
+        : mImage(image)
+        , mRects(rects)
+        , mResults(results)
+        , mFirst(first)
+        , mCount(count)
+        , mDone(done)
+    {
+        setAutoDelete(false);
+    }
+
+    void run()
+    {
+        for (int i = mFirst; i < mFirst + mCount; ++i)
+            mResults[i] = averagePremultiplied(mImage, mRects.at(i));
+        if (mDone)
+            mDone->release();
+    }
+
+private:
+    const QImage &mImage;
+    const QList<QRect> &mRects;
+    QRgb *mResults;
+    int mFirst;
+    int mCount;
+    QSemaphore *mDone;
+};
+
+/**
+ * The image processing has its own thread pool, since the calling thread
+ * blocks until its jobs are done. On the global thread pool, this could
+ * wait on jobs queued behind other work that is itself waiting.
+ */
+Q_GLOBAL_STATIC(QThreadPool, imageThreadPool)
+
+/**
+ * Runs the given jobs, the last one on the calling thread and the others on
+ * the image thread pool, and returns once all of them have finished. Each
+ * job except the last one must release \a done once.
+ */
+void runJobs(const QList<QRunnable*> &jobs, QSemaphore &done)
+{
+    QThreadPool *pool = imageThreadPool();
+    const int pooledJobs = jobs.size() - 1;
+
+    for (int i = 0; i < pooledJobs; ++i)
+        pool->start(jobs.at(i));
+
+    jobs.last()->run();
+    done.acquire(pooledJobs);
+
+    qDeleteAll(jobs);
+}
+
+/**
+ * Returns in how many parts work on \a count items should be split, given
+ * that each part should have at least \a minimum items.
+ */
+int partCount(int count, int minimum)
+{
+    const int threads = imageThreadPool()->maxThreadCount();
+    return qBound(1, count / minimum, qMax(1, threads));
+}
+
+} // anonymous namespace
+
+QImage Tiled::makeColorTransparent(const QImage &image, const QColor &color)
+{
+    QImage result = image.convertToFormat(QImage::Format_ARGB32);
+    if (result.isNull())
+        return result;
+
+    // Detach here, since the jobs write to the pixel data directly
+    uchar *bits = result.bits();
+    const int bytesPerLine = result.bytesPerLine();
+    const int height = result.height();
+    const int parts = partCount(height, MinimumStripeHeight);
+
+    QSemaphore done;
+    QList<QRunnable*> jobs;
+    for (int i = 0; i < parts; ++i) {
+        const int firstLine = height * i / parts;
+        const int lineCount = height * (i + 1) / parts - firstLine;
+        jobs.append(new ColorKeyJob(bits, bytesPerLine, result.width(),
+                                    firstLine, lineCount, color.rgb(),
+                                    i < parts - 1 ? &done : 0));
+    }
+
+    runJobs(jobs, done);
+    return result;
+}
+
+QList<QImage> Tiled::copyImageAreas(const QImage &image,
+                                    const QList<QRect> &rects)
+{
+    if (rects.isEmpty())
+        return QList<QImage>();
+
+    QVector<QImage> results(rects.size());
+
+    // Each part copies at least a stripe's worth of tiles
+    const int tileHeight = qMax(1, rects.first().height());
+    const int minimumAreas = qMax(1, MinimumStripeHeight / tileHeight);
+    const int parts = partCount(rects.size(), minimumAreas);
+
+    QSemaphore done;
+    QList<QRunnable*> jobs;
+    for (int i = 0; i < parts; ++i) {
+        const int first = rects.size() * i / parts;
+        const int count = rects.size() * (i + 1) / parts - first;
+        jobs.append(new CopyAreasJob(image, rects, results.data(),
+                                     first, count,
+                                     i < parts - 1 ? &done : 0));
+    }
+
+    runJobs(jobs, done);
+    return results.toList();
+}
+
+QImage Tiled::extrudeImageAreas(const QImage &image,
+                                const QList<QRect> &rects,
+                                int columns,
+                                QList<QRect> *areas)
+{
+    areas->clear();
+    if (rects.isEmpty() || columns < 1)
+        return QImage();
+
+    const QImage source =
+            image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    const QSize size = rects.first().size();
+    const int cellWidth = size.width() + 2;
+    const int cellHeight = size.height() + 2;
+    const int rows = (rects.size() + columns - 1) / columns;
+
+    QImage result(columns * cellWidth, rows * cellHeight,
+                  QImage::Format_ARGB32_Premultiplied);
+    result.fill(0);
+
+    for (int i = 0; i < rects.size(); ++i) {
+        const QRect &rect = rects.at(i);
+        const int left = (i % columns) * cellWidth;
+        const int top = (i / columns) * cellHeight;
+        const int width = rect.width();
+
+        // The rows above and below the area repeat its first and last row
+        for (int y = -1; y <= rect.height(); ++y) {
+            const int sourceY = rect.top() + qBound(0, y, rect.height() - 1);
+            const QRgb *in =
+                    reinterpret_cast<const QRgb*>(source.scanLine(sourceY))
+                    + rect.left();
+            QRgb *out = reinterpret_cast<QRgb*>(result.scanLine(top + 1 + y))
+                    + left;
+
+            out[0] = in[0];
+            qMemCopy(out + 1, in, width * sizeof(QRgb));
+            out[width + 1] = in[width - 1];
+        }
+
+        areas->append(QRect(QPoint(left + 1, top + 1), size));
+    }
+
+    return result;
+}
+
+QRgb Tiled::averageColor(const QImage &image, const QRect &rect)
+{
+    return averagePremultiplied(
+                image.convertToFormat(QImage::Format_ARGB32_Premultiplied),
+                rect);
+}
+
+QList<QRgb> Tiled::averageColors(const QImage &image,
+                                 const QList<QRect> &rects)
+{
+    if (rects.isEmpty())
+        return QList<QRgb>();
+
+    const QImage premultiplied =
+            image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    QVector<QRgb> results(rects.size());
+
+    const int tileHeight = qMax(1, rects.first().height());
+    const int minimumAreas = qMax(1, MinimumStripeHeight / tileHeight);
+    const int parts = partCount(rects.size(), minimumAreas);
+
+    QSemaphore done;
+    QList<QRunnable*> jobs;
+    for (int i = 0; i < parts; ++i) {
+        const int first = rects.size() * i / parts;
+        const int count = rects.size() * (i + 1) / parts - first;
+        jobs.append(new AverageColorsJob(premultiplied, rects, results.data(),
+                                         first, count,
+                                         i < parts - 1 ? &done : 0));
+    }
+
+    runJobs(jobs, done);
+    return results.toList();
+}
@@ -0,0 +1,88 @@
+/*
+ * imageutils.h
+ * Copyright 2026, agent <agent@local>
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef IMAGEUTILS_H
+#define IMAGEUTILS_H
+
+#include "tiled_global.h"
+
+#include <QImage>
+#include <QList>
+#include <QRect>
+
+class QColor;
+
+namespace Tiled {
+
+/**
+ * Returns a copy of \a image in the ARGB32 format, in which the pixels of the
+ * given \a color are fully transparent. Large images are processed in
+ * horizontal stripes on a thread pool.
+ */
+TILEDSHARED_EXPORT QImage makeColorTransparent(const QImage &image,
+                                               const QColor &color);
+
+/**
+ * Returns copies of the given areas of \a image, in the same order as
+ * \a rects. The copies are made on a thread pool.
+ */
+TILEDSHARED_EXPORT QList<QImage> copyImageAreas(const QImage &image,
+                                                const QList<QRect> &rects);
+
+/**
+ * Copies the given areas of \a image, which all need to have the same size,
+ * into a new image. They are laid out in rows of \a columns areas, in the
+ * same order as \a rects, and their positions are returned in \a areas.
+ *
+ * Each area gets a border of one pixel that repeats its edge pixels, so
+ * that drawing an area with smooth scaling does not blend in the pixels
+ * next to it.
+ */
+TILEDSHARED_EXPORT QImage extrudeImageAreas(const QImage &image,
+                                            const QList<QRect> &rects,
+                                            int columns,
+                                            QList<QRect> *areas);
+
+/**
+ * Returns the average color of the given area of \a image, as a
+ * premultiplied ARGB value.
+ */
+TILEDSHARED_EXPORT QRgb averageColor(const QImage &image, const QRect &rect);
+
+/**
+ * Returns the average colors of the given areas of \a image, in the same
+ * order as \a rects. The colors are computed on a thread pool.
+ *
+ * \sa averageColor()
+ */
+TILEDSHARED_EXPORT QList<QRgb> averageColors(const QImage &image,
+                                             const QList<QRect> &rects);
+
+} // namespace Tiled
+
+#endif // IMAGEUTILS_H
@@ -68,11 +68,11 @@ QRectF IsometricRenderer::boundingRect(const MapObject *object) const
 {
     if (object->tile()) {
         const QPointF bottomCenter = tileToPixelCoords(object->position());
-        const QPixmap &img = object->tile()->image();
-        return QRectF(bottomCenter.x() - img.width() / 2,
-                      bottomCenter.y() - img.height(),
-                      img.width(),
-                      img.height()).adjusted(-1, -1, 1, 1);
+        const Tile *tile = object->tile();
+        return QRectF(bottomCenter.x() - tile->width() / 2,
+                      bottomCenter.y() - tile->height(),
+                      tile->width(),
+                      tile->height()).adjusted(-1, -1, 1, 1);
     } else {
         // Take the bounding rect of the projected object, and then add a few
         // pixels on all sides to correct for the line width.
@@ -206,34 +206,46 @@ void IsometricRenderer::drawTileLayer(QPainter *painter,
     // Determine whether the current row is shifted half a tile to the right
     bool shifted = inUpperHalf ^ inLeftHalf;
 
+    // Each row overlaps the previous one, but the tiles within a row only
+    // overlap when they are wider than the grid
+    CellRenderer renderer(painter, maxTileSize.width() > tileWidth
+                          ? CellRenderer::KeepOrder
+                          : CellRenderer::AnyOrder);
+
+    const int layerWidth = layer->width();
+    const int layerHeight = layer->height();
+
     for (int y = startPos.y(); y - tileHeight < rect.bottom();
          y += tileHeight / 2)
     {
-        QPoint columnItr = rowItr;
-
-        for (int x = startPos.x(); x < rect.right(); x += tileWidth) {
-            if (layer->contains(columnItr)) {
-                const Cell &cell = layer->cellAt(columnItr);
-                if (!cell.isEmpty()) {
-                    const QPixmap &img = cell.tile->image();
-                    int flipX = cell.flippedHorizontally ? -1 : 1;
-                    int flipY = cell.flippedVertically ? -1 : 1;
-                    int offsetX = cell.flippedHorizontally ? img.width() : 0;
-                    int offsetY = cell.flippedVertically ? 0 : img.height();
-
-                    painter->scale(flipX, flipY);
-                    painter->drawPixmap(x * flipX - offsetX,
-                                        y * flipY - offsetY,
-                                        img);
-                    painter->scale(flipX, flipY);
-                }
-            }
-
-            // Advance to the next column
-            ++columnItr.rx();
-            --columnItr.ry();
+        // All further rows lie below the bottom corner of the layer
+        if (rowItr.x() + rowItr.y() > layerWidth + layerHeight - 2)
+            break;
+
+        /* Along a row, column i is at (rowItr.x + i, rowItr.y - i). Limit the
+         * columns to the ones within the exposed rect and the layer, so that
+         * only existing cells are visited.
+         */
+        const int startX = startPos.x();
+        const int exposedColumns = rect.right() > startX
+                ? (rect.right() - startX + tileWidth - 1) / tileWidth
+                : 0;
+
+        const int firstColumn = qMax(0, qMax(-rowItr.x(),
+                                             rowItr.y() - layerHeight + 1));
+        const int endColumn = qMin(exposedColumns,
+                                   qMin(layerWidth - rowItr.x(),
+                                        rowItr.y() + 1));
+
+        for (int column = firstColumn; column < endColumn; ++column) {
+            const Cell cell = layer->cellAt(rowItr.x() + column,
+                                            rowItr.y() - column);
+            if (!cell.isEmpty())
+                renderer.render(cell, QPointF(startX + column * tileWidth, y));
         }
 
+        renderer.flush();
+
         // Advance to the next row
         if (!shifted) {
             ++rowItr.rx();
@@ -270,18 +282,18 @@ void IsometricRenderer::drawMapObject(QPainter *painter,
     QPen pen(Qt::black);
 
     if (object->tile()) {
-        const QPixmap &img = object->tile()->image();
-        QPointF paintOrigin(-img.width() / 2, -img.height());
+        const Tile *tile = object->tile();
+        QPointF paintOrigin(-tile->width() / 2, -tile->height());
         paintOrigin += tileToPixelCoords(object->position()).toPoint();
-        painter->drawPixmap(paintOrigin, img);
+        painter->drawPixmap(paintOrigin, tile->atlas(), tile->imageRect());
 
         pen.setStyle(Qt::SolidLine);
         painter->setPen(pen);
-        painter->drawRect(QRectF(paintOrigin, img.size()));
+        painter->drawRect(QRectF(paintOrigin, tile->size()));
         pen.setStyle(Qt::DotLine);
         pen.setColor(color);
         painter->setPen(pen);
-        painter->drawRect(QRectF(paintOrigin, img.size()));
+        painter->drawRect(QRectF(paintOrigin, tile->size()));
     } else {
         QColor brushColor = color;
         brushColor.setAlpha(50);
@@ -15,6 +15,19 @@ DLLDESTDIR = ../..
 win32:INCLUDEPATH += $$(QTDIR)/src/3rdparty/zlib
 else:LIBS += -lz
 
+# Optional Zstandard and LZ4 support for tile layer data. Detected through
+# pkg-config, or enabled explicitly with CONFIG+=zstd / CONFIG+=lz4.
+unix:!zstd:system(pkg-config --exists libzstd):CONFIG += zstd
+unix:!lz4:system(pkg-config --exists liblz4):CONFIG += lz4
+zstd {
+    DEFINES += TILED_ZSTD_SUPPORT
+    LIBS += -lzstd
+}
+lz4 {
+    DEFINES += TILED_LZ4_SUPPORT
+    LIBS += -llz4
+}
+
 DEFINES += QT_NO_CAST_FROM_ASCII \
     QT_NO_CAST_TO_ASCII
 DEFINES += TILED_LIBRARY
@@ -26,13 +39,16 @@ SOURCES += compression.cpp \
     map.cpp \
     mapobject.cpp \
     mapreader.cpp \
+    maprenderer.cpp \
     mapwriter.cpp \
     objectgroup.cpp \
     orthogonalrenderer.cpp \
     properties.cpp \
     tilelayer.cpp \
+    tileregion.cpp \
     tileset.cpp \
     imagelayer.cpp \
+    imageutils.cpp \
     gridstyle.cpp
 HEADERS += compression.h \
     isometricrenderer.h \
@@ -49,8 +65,10 @@ HEADERS += compression.h \
     tile.h \
     tiled_global.h \
     tilelayer.h \
+    tileregion.h \
     tileset.h \
     imagelayer.h \
+    imageutils.h \
     gridstyle.h
 macx {
     contains(QT_CONFIG, ppc):CONFIG += x86 \
@@ -46,7 +46,9 @@ Map::Map(Orientation orientation,
     mHeight(height),
     mTileWidth(tileWidth),
     mTileHeight(tileHeight),
-    mMaxTileSize(tileWidth, tileHeight)
+    mMaxTileSize(tileWidth, tileHeight),
+    mCompressionLevel(DefaultCompression),
+    mCompressionStrategy(DefaultStrategy)
 {
 }
 
@@ -167,6 +169,8 @@ Map *Map::clone() const
 {
     Map *o = new Map(mOrientation, mWidth, mHeight, mTileWidth, mTileHeight);
     o->mMaxTileSize = mMaxTileSize;
+    o->mCompressionLevel = mCompressionLevel;
+    o->mCompressionStrategy = mCompressionStrategy;
     foreach (Layer *layer, mLayers)
         o->addLayer(layer->clone());
     o->mTilesets = mTilesets;
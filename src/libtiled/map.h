@@ -31,6 +31,7 @@
 #ifndef MAP_H
 #define MAP_H
 
+#include "compression.h"
 #include "object.h"
 
 #include <QList>
@@ -139,6 +140,31 @@ public:
      */
     void adjustMaxTileSize(const QSize &size);
 
+    /**
+     * Returns the compression level used when saving the tile layer data
+     * of this map in a compressed format.
+     */
+    int compressionLevel() const { return mCompressionLevel; }
+
+    /**
+     * Sets the compression level used when saving this map. Should be in
+     * range [0, 9] or DefaultCompression.
+     */
+    void setCompressionLevel(int level) { mCompressionLevel = level; }
+
+    /**
+     * Returns the compression strategy used when saving the tile layer data
+     * of this map in a compressed format.
+     */
+    CompressionStrategy compressionStrategy() const
+    { return mCompressionStrategy; }
+
+    /**
+     * Sets the compression strategy used when saving this map.
+     */
+    void setCompressionStrategy(CompressionStrategy strategy)
+    { mCompressionStrategy = strategy; }
+
     /**
      * Convenience method for getting the extra tile size, which is the number
      * of pixels that tiles may extend beyond the size of the tile grid.
@@ -266,6 +292,8 @@ private:
     int mTileWidth;
     int mTileHeight;
     QSize mMaxTileSize;
+    int mCompressionLevel;
+    CompressionStrategy mCompressionStrategy;
     QList<Layer*> mLayers;
     QList<Tileset*> mTilesets;
 };
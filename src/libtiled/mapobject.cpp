@@ -29,6 +29,8 @@
 
 #include "mapobject.h"
 
+#include "objectgroup.h"
+
 using namespace Tiled;
 
 MapObject::MapObject():
@@ -50,6 +52,51 @@ MapObject::MapObject(const QString &name, const QString &type,
 {
 }
 
+void MapObject::setPosition(const QPointF &pos)
+{
+    mPos = pos;
+    boundsChanged();
+}
+
+void MapObject::setX(qreal x)
+{
+    mPos.setX(x);
+    boundsChanged();
+}
+
+void MapObject::setY(qreal y)
+{
+    mPos.setY(y);
+    boundsChanged();
+}
+
+void MapObject::setSize(const QSizeF &size)
+{
+    mSize = size;
+    boundsChanged();
+}
+
+void MapObject::setWidth(qreal width)
+{
+    mSize.setWidth(width);
+    boundsChanged();
+}
+
+void MapObject::setHeight(qreal height)
+{
+    mSize.setHeight(height);
+    boundsChanged();
+}
+
+/**
+ * Keeps the spatial index of the object group up to date.
+ */
+void MapObject::boundsChanged()
+{
+    if (mObjectGroup)
+        mObjectGroup->objectBoundsChanged(this);
+}
+
 MapObject *MapObject::clone() const
 {
     MapObject *o = new MapObject(mName, mType,
@@ -91,7 +91,7 @@ public:
     /**
      * Sets the position of this object.
      */
-    void setPosition(const QPointF &pos) { mPos = pos; }
+    void setPosition(const QPointF &pos);
 
     /**
      * Returns the x position of this object.
@@ -101,7 +101,7 @@ public:
     /**
      * Sets the x position of this object.
      */
-    void setX(qreal x) { mPos.setX(x); }
+    void setX(qreal x);
 
     /**
      * Returns the y position of this object.
@@ -111,7 +111,7 @@ public:
     /**
      * Sets the x position of this object.
      */
-    void setY(qreal y) { mPos.setY(y); }
+    void setY(qreal y);
 
     /**
      * Returns the size of this object.
@@ -121,7 +121,7 @@ public:
     /**
      * Sets the size of this object.
      */
-    void setSize(const QSizeF &size) { mSize = size; }
+    void setSize(const QSizeF &size);
 
     void setSize(qreal width, qreal height)
     { setSize(QSizeF(width, height)); }
@@ -134,7 +134,7 @@ public:
     /**
      * Sets the width of this object.
      */
-    void setWidth(qreal width) { mSize.setWidth(width); }
+    void setWidth(qreal width);
 
     /**
      * Returns the height of this object.
@@ -144,7 +144,7 @@ public:
     /**
      * Sets the height of this object.
      */
-    void setHeight(qreal height) { mSize.setHeight(height); }
+    void setHeight(qreal height);
 
     /**
      * Shortcut to getting a QRectF from position() and size().
@@ -192,6 +192,8 @@ public:
     MapObject *clone() const;
 
 private:
+    void boundsChanged();
+
     QString mName;
     QPointF mPos;
     QSizeF mSize;
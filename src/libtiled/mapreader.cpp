@@ -44,6 +44,9 @@
 #include <QDir>
 #include <QFileInfo>
 #include <QMap>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
 #include <QXmlStreamReader>
 
 using namespace Tiled;
@@ -71,7 +74,9 @@ public:
     MapReaderPrivate(MapReader *mapReader):
         p(mapReader),
         mMap(0),
-        mReadingExternalTileset(false)
+        mReadingExternalTileset(false),
+        mGidTableDirty(false),
+        mLayerDataSlots(qMax(1, mLayerDataPool.maxThreadCount()))
     {}
 
     Map *readMap(QIODevice *device, const QString &path);
@@ -92,10 +97,57 @@ private:
 
     TileLayer *readLayer();
     void readLayerData(TileLayer *tileLayer);
-    void decodeBinaryLayerData(TileLayer *tileLayer,
-                               const QStringRef &text,
-                               const QStringRef &compression);
-    void decodeCSVLayerData(TileLayer *tileLayer, const QString &text);
+
+    /**
+     * The encoded data of a tile layer. It is decoded on a thread from
+     * mLayerDataPool while the rest of the map is being read.
+     */
+    class LayerDataJob : public QRunnable
+    {
+    public:
+        LayerDataJob(const MapReaderPrivate *reader) : reader(reader) {}
+
+        void run();
+
+        const MapReaderPrivate *reader;
+        TileLayer *tileLayer;
+        QString encoding;
+        QString compression;
+        QString text;
+        qint64 lineNumber;
+        qint64 columnNumber;
+        QString error;
+    };
+    friend class LayerDataJob;
+
+    void startLayerDataJob(LayerDataJob *job);
+    void finishLayerDataJobs();
+
+    bool decodeBinaryLayerData(TileLayer *tileLayer,
+                               const QString &text,
+                               const QString &compression,
+                               QString &error) const;
+    bool decodeCSVLayerData(TileLayer *tileLayer,
+                            const QString &text,
+                            QString &error) const;
+
+    /**
+     * Keeps track of the position in the layer while decoding binary layer
+     * data, which may arrive in pieces that don't align with the global
+     * tile IDs.
+     */
+    struct BinaryLayerDataState
+    {
+        int x;
+        int y;
+        uint gid;
+        int gidBytes;
+    };
+
+    bool readBinaryLayerData(TileLayer *tileLayer,
+                             BinaryLayerDataState &state,
+                             const uchar *data, int length,
+                             QString &error) const;
 
     /**
      * Returns the cell for the given global tile ID. When an error occurs,
@@ -108,6 +160,15 @@ private:
      */
     Cell cellForGid(uint gid, bool &ok);
 
+    /**
+     * Returns the cell for the given global tile ID like cellForGid(), but
+     * without raising an error or updating the lookup table. Safe to call
+     * while layer data is being decoded.
+     */
+    Cell lookupCell(uint gid, bool &ok) const;
+
+    void buildGidTable();
+
     ObjectGroup *readObjectGroup();
     MapObject *readObject();
 
@@ -127,6 +188,20 @@ private:
     QMap<uint, Tileset*> mGidsToTileset;
     bool mReadingExternalTileset;
 
+    // Flat lookup table from global tile ID to tile, built from
+    // mGidsToTileset when the first tile is looked up after a tileset was
+    // added. Left empty when the IDs are spread too far to make it sensible.
+    QVector<Tile*> mGidsToTile;
+    bool mGidTableDirty;
+
+    // The layer data is decoded in parallel. The lookup tables above are
+    // only changed while no decoding is going on. Each job holds the encoded
+    // text of its layer until it is done, so the number of jobs that aren't
+    // done yet is limited to the number of threads.
+    QThreadPool mLayerDataPool;
+    QList<LayerDataJob*> mLayerDataJobs;
+    mutable QSemaphore mLayerDataSlots;
+
     QXmlStreamReader xml;
 };
 
@@ -148,6 +223,8 @@ Map *MapReaderPrivate::readMap(QIODevice *device, const QString &path)
     }
 
     mGidsToTileset.clear();
+    mGidsToTile.clear();
+    mGidTableDirty = false;
     return map;
 }
 
@@ -237,21 +314,43 @@ Map *MapReaderPrivate::readMap()
 
     mMap = new Map(orientation, mapWidth, mapHeight, tileWidth, tileHeight);
 
+    bool ok;
+    const int compressionLevel =
+            atts.value(QLatin1String("compressionlevel")).toString().toInt(&ok);
+    if (ok)
+        mMap->setCompressionLevel(compressionLevel);
+
+    const QString compressionStrategy =
+            atts.value(QLatin1String("compressionstrategy")).toString();
+    if (!compressionStrategy.isEmpty()) {
+        mMap->setCompressionStrategy(
+                compressionStrategyFromString(compressionStrategy));
+    }
+
+    // The layers are only added to the map once their data is decoded,
+    // since decoding them can adjust the maximum tile size of the map
+    QList<Layer*> layers;
+
     while (xml.readNextStartElement()) {
         if (xml.name() == "properties")
             mMap->mergeProperties(readProperties());
         else if (xml.name() == "tileset")
             mMap->addTileset(readTileset());
         else if (xml.name() == "layer")
-            mMap->addLayer(readLayer());
+            layers.append(readLayer());
         else if (xml.name() == "objectgroup")
-            mMap->addLayer(readObjectGroup());
+            layers.append(readObjectGroup());
         else if (xml.name() == "imagelayer")
-            mMap->addLayer(readImageLayer());
+            layers.append(readImageLayer());
         else
             readUnknownElement();
     }
 
+    finishLayerDataJobs();
+
+    foreach (Layer *layer, layers)
+        mMap->addLayer(layer);
+
     // Clean up in case of error
     if (xml.hasError()) {
         // The tilesets are not owned by the map
@@ -317,8 +416,13 @@ Tileset *MapReaderPrivate::readTileset()
         xml.skipCurrentElement();
     }
 
-    if (tileset && !mReadingExternalTileset)
+    if (tileset && !mReadingExternalTileset) {
+        // Layer data that is still being decoded uses the lookup tables
+        mLayerDataPool.waitForDone();
+
         mGidsToTileset.insert(firstGid, tileset);
+        mGidTableDirty = true;
+    }
 
     return tileset;
 }
@@ -420,6 +524,8 @@ void MapReaderPrivate::readLayerData(TileLayer *tileLayer)
     QStringRef encoding = atts.value(QLatin1String("encoding"));
     QStringRef compression = atts.value(QLatin1String("compression"));
 
+    LayerDataJob *job = 0;
+
     int x = 0;
     int y = 0;
 
@@ -453,118 +559,370 @@ void MapReaderPrivate::readLayerData(TileLayer *tileLayer)
                 readUnknownElement();
             }
         } else if (xml.isCharacters() && !xml.isWhitespace()) {
-            if (encoding == QLatin1String("base64")) {
-                decodeBinaryLayerData(tileLayer,
-                                      xml.text(),
-                                      compression);
-            } else if (encoding == QLatin1String("csv")) {
-                decodeCSVLayerData(tileLayer, xml.text().toString());
-            } else {
+            if (encoding != QLatin1String("base64")
+                    && encoding != QLatin1String("csv")) {
                 xml.raiseError(tr("Unknown encoding: %1")
                                .arg(encoding.toString()));
                 continue;
             }
+
+            // The text may arrive in several pieces, for example when it
+            // is interrupted by a comment
+            if (!job) {
+                job = new LayerDataJob(this);
+                job->tileLayer = tileLayer;
+                job->encoding = encoding.toString();
+                job->compression = compression.toString();
+                job->lineNumber = xml.lineNumber();
+                job->columnNumber = xml.columnNumber();
+            }
+            job->text.append(xml.text());
         }
     }
+
+    if (job)
+        startLayerDataJob(job);
 }
 
-void MapReaderPrivate::decodeBinaryLayerData(TileLayer *tileLayer,
-                                             const QStringRef &text,
-                                             const QStringRef &compression)
+/**
+ * Hands the given layer data to the thread pool for decoding. Ownership of
+ * the job is kept, so that its result can be checked afterwards by
+ * finishLayerDataJobs().
+ */
+void MapReaderPrivate::startLayerDataJob(LayerDataJob *job)
 {
-#if QT_VERSION < 0x040800
-    const QString textData = QString::fromRawData(text.unicode(), text.size());
-    const QByteArray latin1Text = textData.toLatin1();
-#else
-    const QByteArray latin1Text = text.toLatin1();
-#endif
-    QByteArray tileData = QByteArray::fromBase64(latin1Text);
-    const int size = (tileLayer->width() * tileLayer->height()) * 4;
+    // The lookup table is shared by all the jobs, so it needs to be up to
+    // date before decoding starts
+    if (mGidTableDirty)
+        buildGidTable();
+
+    // Waits for an earlier layer to be decoded when all threads are busy,
+    // rather than keeping the text of every layer in memory
+    mLayerDataSlots.acquire();
+
+    job->setAutoDelete(false);
+    mLayerDataJobs.append(job);
+    mLayerDataPool.start(job);
+}
 
-    if (compression == QLatin1String("zlib")
-        || compression == QLatin1String("gzip")) {
-        tileData = decompress(tileData, size);
-    } else if (!compression.isEmpty()) {
-        xml.raiseError(tr("Compression method '%1' not supported")
-                       .arg(compression.toString()));
-        return;
+/**
+ * Waits until all layer data is decoded. When any layer failed to decode,
+ * the error of the first one in the file is raised, as if the layers had
+ * been decoded one after the other.
+ */
+void MapReaderPrivate::finishLayerDataJobs()
+{
+    mLayerDataPool.waitForDone();
+
+    foreach (const LayerDataJob *job, mLayerDataJobs) {
+        if (!job->error.isEmpty()) {
+            // Parsing stopped at the first error, so it can only have
+            // happened after this layer
+            mError = tr("%3\n\nLine %1, column %2")
+                    .arg(job->lineNumber)
+                    .arg(job->columnNumber)
+                    .arg(job->error);
+            xml.raiseError(job->error);
+            break;
+        }
     }
 
-    if (size != tileData.length()) {
-        xml.raiseError(tr("Corrupt layer data for layer '%1'")
-                       .arg(tileLayer->name()));
-        return;
+    qDeleteAll(mLayerDataJobs);
+    mLayerDataJobs.clear();
+}
+
+void MapReaderPrivate::LayerDataJob::run()
+{
+    if (encoding == QLatin1String("base64"))
+        reader->decodeBinaryLayerData(tileLayer, text, compression, error);
+    else
+        reader->decodeCSVLayerData(tileLayer, text, error);
+
+    // Release the encoded data as early as possible
+    text.clear();
+    reader->mLayerDataSlots.release();
+}
+
+namespace {
+
+/**
+ * Decodes base64 encoded text in pieces, without converting it to Latin-1
+ * first. Like QByteArray::fromBase64, characters outside of the base64
+ * alphabet are ignored.
+ */
+class Base64Decoder
+{
+public:
+    Base64Decoder() : mBuffer(0), mBits(0) {}
+
+    /**
+     * Decodes \a length characters of \a text to \a out, which needs to have
+     * room for at least (length * 3) / 4 + 1 bytes. Returns the number of
+     * bytes written.
+     */
+    int decode(const QChar *text, int length, uchar *out)
+    {
+        uchar *start = out;
+
+        for (int i = 0; i < length; ++i) {
+            const ushort ch = text[i].unicode();
+            int d;
+
+            if (ch >= 'A' && ch <= 'Z')
+                d = ch - 'A';
+            else if (ch >= 'a' && ch <= 'z')
+                d = ch - 'a' + 26;
+            else if (ch >= '0' && ch <= '9')
+                d = ch - '0' + 52;
+            else if (ch == '+')
+                d = 62;
+            else if (ch == '/')
+                d = 63;
+            else
+                continue;
+
+            mBuffer = (mBuffer << 6) | d;
+            mBits += 6;
+            if (mBits >= 8) {
+                mBits -= 8;
+                *out++ = uchar(mBuffer >> mBits);
+                mBuffer &= (1 << mBits) - 1;
+            }
+        }
+
+        return out - start;
     }
 
-    const unsigned char *data =
-            reinterpret_cast<const unsigned char*>(tileData.constData());
-    int x = 0;
-    int y = 0;
+private:
+    uint mBuffer;
+    int mBits;
+};
 
-    for (int i = 0; i < size - 3; i += 4) {
-        const uint gid = data[i] |
-                         data[i + 1] << 8 |
-                         data[i + 2] << 16 |
-                         data[i + 3] << 24;
+} // anonymous namespace
+
+bool MapReaderPrivate::decodeBinaryLayerData(TileLayer *tileLayer,
+                                             const QString &text,
+                                             const QString &compression,
+                                             QString &error) const
+{
+    const bool compressed = !compression.isEmpty();
+    CompressionMethod method = Zlib; // Also detects gzip headers
+    bool supported = true;
+
+    if (compression == QLatin1String("zstd"))
+        method = Zstandard;
+    else if (compression == QLatin1String("lz4"))
+        method = LZ4;
+    else if (compressed)
+        supported = compression == QLatin1String("zlib")
+                || compression == QLatin1String("gzip");
+
+    if (!supported || !isCompressionMethodSupported(method)) {
+        error = tr("Compression method '%1' not supported").arg(compression);
+        return false;
+    }
+
+    // The text is decoded and decompressed in pieces, which are written to
+    // the layer straight away. This avoids holding several copies of the
+    // whole layer data in memory.
+    enum {
+        TextChunkSize = 8192,
+        DecodedChunkSize = TextChunkSize * 3 / 4 + 1,
+        InflatedChunkSize = 16384
+    };
+
+    Base64Decoder base64;
+    Decompressor decompressor(method);
+    uchar decoded[DecodedChunkSize];
+    uchar inflated[InflatedChunkSize];
+
+    BinaryLayerDataState state = { 0, 0, 0, 0 };
+
+    const QChar *chars = text.unicode();
+    const int textSize = text.size();
+
+    for (int pos = 0; pos < textSize; pos += TextChunkSize) {
+        const int decodedSize =
+                base64.decode(chars + pos,
+                              qMin(int(TextChunkSize), textSize - pos),
+                              decoded);
+
+        if (!compressed) {
+            if (!readBinaryLayerData(tileLayer, state,
+                                     decoded, decodedSize, error))
+                return false;
+            continue;
+        }
+
+        decompressor.setInput(reinterpret_cast<const char*>(decoded),
+                              decodedSize);
+
+        int inflatedSize;
+        while ((inflatedSize =
+                decompressor.read(reinterpret_cast<char*>(inflated),
+                                  InflatedChunkSize)) > 0) {
+            if (!readBinaryLayerData(tileLayer, state,
+                                     inflated, inflatedSize, error))
+                return false;
+        }
+
+        if (inflatedSize < 0)
+            break;
+    }
+
+    if ((compressed && !decompressor.atEnd())
+            || state.y != tileLayer->height()
+            || state.gidBytes != 0) {
+        error = tr("Corrupt layer data for layer '%1'")
+                .arg(tileLayer->name());
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Reads the little-endian 32-bit global tile IDs in \a data and sets the
+ * resulting cells on the tile layer, continuing at the position stored in
+ * \a state. Returns false and sets \a error when the data is invalid.
+ */
+bool MapReaderPrivate::readBinaryLayerData(TileLayer *tileLayer,
+                                           BinaryLayerDataState &state,
+                                           const uchar *data, int length,
+                                           QString &error) const
+{
+    const int width = tileLayer->width();
+    const int height = tileLayer->height();
+
+    for (int i = 0; i < length; ++i) {
+        state.gid |= uint(data[i]) << (state.gidBytes * 8);
+        if (++state.gidBytes < 4)
+            continue;
+
+        if (state.y >= height) {
+            error = tr("Corrupt layer data for layer '%1'")
+                    .arg(tileLayer->name());
+            return false;
+        }
 
         bool ok;
-        Cell cell = cellForGid(gid, ok);
-        if (ok)
-            tileLayer->setCell(x, y, cell);
-        else {
-            xml.raiseError(tr("Invalid tile: %1").arg(gid));
-            return;
+        const Cell cell = lookupCell(state.gid, ok);
+        if (!ok) {
+            error = tr("Invalid tile: %1").arg(state.gid);
+            return false;
         }
+        tileLayer->setCell(state.x, state.y, cell);
+
+        state.gid = 0;
+        state.gidBytes = 0;
 
-        x++;
-        if (x == tileLayer->width()) {
-            x = 0;
-            y++;
+        if (++state.x == width) {
+            state.x = 0;
+            ++state.y;
         }
     }
+
+    return true;
 }
 
-void MapReaderPrivate::decodeCSVLayerData(TileLayer *tileLayer, const QString &text)
+static inline bool isCSVSpace(QChar c)
 {
-    QString trimText = text.trimmed();
-    QStringList tiles = trimText.split(QLatin1Char(','));
+    const ushort u = c.unicode();
+    return u == ' ' || u == '\n' || u == '\r' || u == '\t'
+            || (u > 127 && c.isSpace());
+}
 
-    if (tiles.length() != tileLayer->width() * tileLayer->height()) {
-        xml.raiseError(tr("Corrupt layer data for layer '%1'")
-                       .arg(tileLayer->name()));
-        return;
+bool MapReaderPrivate::decodeCSVLayerData(TileLayer *tileLayer,
+                                          const QString &text,
+                                          QString &error) const
+{
+    const int width = tileLayer->width();
+    const int height = tileLayer->height();
+
+    const QChar *c = text.unicode();
+    const QChar *end = c + text.size();
+
+    // Check the number of tiles up front, so that no partially read layer
+    // is left behind on corrupt data
+    int tileCount = 1;
+    for (const QChar *i = c; i != end; ++i)
+        if (*i == QLatin1Char(','))
+            ++tileCount;
+
+    if (tileCount != width * height) {
+        error = tr("Corrupt layer data for layer '%1'")
+                .arg(tileLayer->name());
+        return false;
     }
 
-    for (int y = 0; y < tileLayer->height(); y++) {
-        for (int x = 0; x < tileLayer->width(); x++) {
-            bool conversionOk;
-            const uint gid = tiles.at(y * tileLayer->width() + x)
-                    .toUInt(&conversionOk);
+    // Parse the numbers in place, rather than splitting the text into
+    // millions of temporary strings
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            while (c != end && isCSVSpace(*c))
+                ++c;
+
+            quint64 gid = 0;
+            bool conversionOk = false;
+
+            for (; c != end; ++c) {
+                const ushort digit = c->unicode() - '0';
+                if (digit > 9)
+                    break;
+
+                gid = gid * 10 + digit;
+                if (gid > 0xFFFFFFFFu)
+                    break;
+                conversionOk = true;
+            }
+
+            while (c != end && isCSVSpace(*c))
+                ++c;
+
+            if (gid > 0xFFFFFFFFu)
+                conversionOk = false;
+            else if (c != end && *c++ != QLatin1Char(','))
+                conversionOk = false;
+
             if (!conversionOk) {
-                xml.raiseError(
-                        tr("Unable to parse tile at (%1,%2) on layer '%3'")
-                               .arg(x + 1).arg(y + 1).arg(tileLayer->name()));
-                return;
+                error = tr("Unable to parse tile at (%1,%2) on layer '%3'")
+                        .arg(x + 1).arg(y + 1).arg(tileLayer->name());
+                return false;
             }
+
             bool gidOk;
-            Cell cell = cellForGid(gid, gidOk);
-            if (gidOk)
+            const Cell cell = lookupCell(uint(gid), gidOk);
+            if (gidOk) {
                 tileLayer->setCell(x, y, cell);
-            else {
-                xml.raiseError(tr("Invalid tile: %1").arg(gid));
+            } else {
+                error = tr("Invalid tile: %1").arg(uint(gid));
+                return false;
             }
         }
     }
+
+    return true;
 }
 
 Cell MapReaderPrivate::cellForGid(uint gid, bool &ok)
+{
+    if (mGidTableDirty)
+        buildGidTable();
+
+    const Cell result = lookupCell(gid, ok);
+    if (!ok)
+        xml.raiseError(tr("Tile used but no tilesets specified"));
+
+    return result;
+}
+
+Cell MapReaderPrivate::lookupCell(uint gid, bool &ok) const
 {
     Cell result;
 
     if (gid == 0) {
         ok = true;
     } else if (mGidsToTileset.isEmpty()) {
-        xml.raiseError(tr("Tile used but no tilesets specified"));
         ok = false;
     } else {
         // Read out the flags
@@ -574,19 +932,70 @@ Cell MapReaderPrivate::cellForGid(uint gid, bool &ok)
         // Clear the flags
         gid &= ~(FlippedHorizontallyFlag | FlippedVerticallyFlag);
 
-        // Find the tileset containing this tile
-        QMap<uint, Tileset*>::const_iterator i = mGidsToTileset.upperBound(gid);
-        --i; // Navigate one tileset back since upper bound finds the next
-        const int tileId = gid - i.key();
-        const Tileset *tileset = i.value();
-
-        result.tile = tileset ? tileset->tileAt(tileId) : 0;
+        if (!mGidsToTile.isEmpty()) {
+            if (gid < uint(mGidsToTile.size()))
+                result.tile = mGidsToTile.at(gid);
+        } else {
+            // Find the tileset containing this tile
+            QMap<uint, Tileset*>::const_iterator i =
+                    mGidsToTileset.upperBound(gid);
+            if (i != mGidsToTileset.begin()) {
+                --i; // Navigate one tileset back since upper bound finds the next
+                const int tileId = gid - i.key();
+                const Tileset *tileset = i.value();
+
+                result.tile = tileset ? tileset->tileAt(tileId) : 0;
+            }
+        }
         ok = true;
     }
 
     return result;
 }
 
+/**
+ * Builds the table used to look up the tile for a global tile ID in
+ * constant time, rather than searching mGidsToTileset for each cell.
+ */
+void MapReaderPrivate::buildGidTable()
+{
+    // Don't waste memory on sparse IDs, like when a tileset uses a huge
+    // first global tile ID
+    static const uint MaxTableSize = 1 << 20;
+
+    mGidTableDirty = false;
+    mGidsToTile.clear();
+
+    uint tableSize = 0;
+    QMap<uint, Tileset*>::const_iterator it = mGidsToTileset.constBegin();
+    QMap<uint, Tileset*>::const_iterator it_end = mGidsToTileset.constEnd();
+    for (; it != it_end; ++it) {
+        // Summed in 64 bits, since a first ID near the end of the range
+        // would otherwise wrap around to a small end
+        const quint64 end = quint64(it.key()) + it.value()->tileCount();
+        if (end > MaxTableSize)
+            return;
+        tableSize = qMax(tableSize, uint(end));
+    }
+
+    mGidsToTile.fill(0, tableSize);
+
+    // Each tileset covers the IDs up to the first ID of the next tileset,
+    // just like with the upperBound lookup
+    for (it = mGidsToTileset.constBegin(); it != it_end; ++it) {
+        const Tileset *tileset = it.value();
+        const uint firstGid = it.key();
+
+        QMap<uint, Tileset*>::const_iterator next = it + 1;
+        const uint endGid = (next == it_end) ? tableSize : next.key();
+
+        for (int id = 0, id_end = tileset->tileCount();
+             id < id_end && firstGid + id < endGid; ++id) {
+            mGidsToTile[firstGid + id] = tileset->tileAt(id);
+        }
+    }
+}
+
 ObjectGroup *MapReaderPrivate::readObjectGroup()
 {
     Q_ASSERT(xml.isStartElement() && xml.name() == "objectgroup");
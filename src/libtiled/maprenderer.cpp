@@ -0,0 +1,106 @@
+/*
+ * maprenderer.cpp
+ * Copyright 2026, agent <agent@local>
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "maprenderer.h"
+
+#include "tile.h"
+#include "tilelayer.h"
+
+using namespace Tiled;
+
+CellRenderer::CellRenderer(QPainter *painter, Order order)
+    : mPainter(painter)
+    , mOrder(order)
+{
+}
+
+CellRenderer::~CellRenderer()
+{
+    flush();
+}
+
+void CellRenderer::render(const Cell &cell, const QPointF &origin)
+{
+    const Tile *tile = cell.tile;
+    const QPixmap &atlas = tile->atlas();
+    const QRect &imageRect = tile->imageRect();
+
+#if QT_VERSION >= 0x040700
+    const qint64 key = atlas.cacheKey();
+
+    // When the order matters, only consecutive cells can be batched
+    if (mOrder == KeepOrder && !mBatches.isEmpty()
+            && mBatches.last().pixmap.cacheKey() != key) {
+        flush();
+    }
+
+    QHash<qint64, int>::const_iterator i = mBatchIndices.find(key);
+    if (i == mBatchIndices.end()) {
+        i = mBatchIndices.insert(key, mBatches.size());
+        mBatches.append(Batch());
+        mBatches.last().pixmap = atlas;
+    }
+
+    // Fragments are positioned by their center, and flipped by scaling
+    // around it
+    const qreal width = imageRect.width();
+    const qreal height = imageRect.height();
+    mBatches[i.value()].fragments.append(
+            QPainter::PixmapFragment::create(
+                QPointF(origin.x() + width / 2, origin.y() - height / 2),
+                imageRect,
+                cell.flippedHorizontally ? -1 : 1,
+                cell.flippedVertically ? -1 : 1));
+#else
+    const int flipX = cell.flippedHorizontally ? -1 : 1;
+    const int flipY = cell.flippedVertically ? -1 : 1;
+    const qreal offsetX = cell.flippedHorizontally ? imageRect.width() : 0;
+    const qreal offsetY = cell.flippedVertically ? 0 : imageRect.height();
+
+    mPainter->scale(flipX, flipY);
+    mPainter->drawPixmap(QPointF(origin.x() * flipX - offsetX,
+                                 origin.y() * flipY - offsetY),
+                         atlas, imageRect);
+    mPainter->scale(flipX, flipY);
+#endif
+}
+
+void CellRenderer::flush()
+{
+#if QT_VERSION >= 0x040700
+    foreach (const Batch &batch, mBatches) {
+        mPainter->drawPixmapFragments(batch.fragments.constData(),
+                                      batch.fragments.size(),
+                                      batch.pixmap);
+    }
+
+    mBatches.clear();
+    mBatchIndices.clear();
+#endif
+}
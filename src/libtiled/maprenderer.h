@@ -31,10 +31,13 @@
 
 #include "tiled_global.h"
 
+#include <QHash>
 #include <QPainter>
+#include <QVector>
 
 namespace Tiled {
 
+class Cell;
 class Layer;
 class Map;
 class MapObject;
@@ -146,6 +149,59 @@ private:
     const Map *mMap;
 };
 
+/**
+ * A utility class for drawing cells. Cells using the same pixmap, usually
+ * the atlas of their tileset, are collected and drawn with a single
+ * QPainter::drawPixmapFragments() call, with flipping done by the
+ * fragments. This avoids changing the painter state for each cell.
+ *
+ * Collected cells are drawn when flush() is called or when the renderer is
+ * destroyed.
+ */
+class TILEDSHARED_EXPORT CellRenderer
+{
+public:
+    /**
+     * Whether the cells need to be drawn in the order in which they are
+     * passed in. This is needed when the cells may overlap each other.
+     */
+    enum Order {
+        AnyOrder,
+        KeepOrder
+    };
+
+    CellRenderer(QPainter *painter, Order order = AnyOrder);
+    ~CellRenderer();
+
+    /**
+     * Draws the given \a cell, with the bottom left corner of its tile at
+     * \a origin.
+     */
+    void render(const Cell &cell, const QPointF &origin);
+
+    /**
+     * Draws all collected cells.
+     */
+    void flush();
+
+private:
+    Q_DISABLE_COPY(CellRenderer)
+
+    QPainter * const mPainter;
+    const Order mOrder;
+
+#if QT_VERSION >= 0x040700
+    struct Batch
+    {
+        QPixmap pixmap;
+        QVector<QPainter::PixmapFragment> fragments;
+    };
+
+    QVector<Batch> mBatches;
+    QHash<qint64, int> mBatchIndices;
+#endif
+};
+
 } // namespace Tiled
 
 #endif // MAPRENDERER_H
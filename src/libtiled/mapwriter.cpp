@@ -41,7 +41,10 @@
 
 #include <QCoreApplication>
 #include <QDir>
-#include <QMap>
+#include <QHash>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
 #include <QXmlStreamWriter>
 
 using namespace Tiled;
@@ -61,7 +64,7 @@ class MapWriterPrivate
 public:
     MapWriterPrivate();
 
-    void writeMap(const Map *map, QIODevice *device,
+    bool writeMap(const Map *map, QIODevice *device,
                   const QString &path);
 
     void writeTileset(const Tileset *tileset, QIODevice *device,
@@ -72,14 +75,60 @@ public:
     QString mError;
     MapWriter::LayerDataFormat mLayerDataFormat;
     bool mDtdEnabled;
+    int mCompressionLevel;
+    CompressionStrategy mCompressionStrategy;
 
 private:
-    void writeMap(QXmlStreamWriter &w, const Map *map);
+    bool writeMap(QXmlStreamWriter &w, const Map *map);
     void writeTileset(QXmlStreamWriter &w, const Tileset *tileset,
                       uint firstGid);
-    void writeTileLayer(QXmlStreamWriter &w, const TileLayer *tileLayer);
+
+    /**
+     * Encodes the data of a tile layer on a thread from mLayerDataPool, so
+     * that the tile layers are encoded in parallel while the map is written
+     * in document order.
+     */
+    class LayerDataJob : public QRunnable
+    {
+    public:
+        LayerDataJob(const MapWriterPrivate *writer,
+                     const TileLayer *tileLayer)
+            : writer(writer)
+            , tileLayer(tileLayer)
+            , ok(true)
+        {}
+
+        void run();
+
+        const MapWriterPrivate *writer;
+        const TileLayer *tileLayer;
+        QByteArray data;
+        bool ok;
+        QSemaphore done;
+    };
+    friend class LayerDataJob;
+
+    /**
+     * Remembers the last tileset looked up in gidForCell, since consecutive
+     * cells are usually from the same tileset.
+     */
+    struct GidCache
+    {
+        GidCache() : tileset(0), firstGid(0) {}
+
+        const Tileset *tileset;
+        uint firstGid;
+    };
+
+    bool writeTileLayer(QXmlStreamWriter &w, const TileLayer *tileLayer,
+                        LayerDataJob *job);
+    void encodeCSVLayerData(QByteArray &out,
+                            const TileLayer *tileLayer) const;
+    bool encodeBinaryLayerData(QByteArray &out,
+                               const TileLayer *tileLayer) const;
     void writeLayerAttributes(QXmlStreamWriter &w, const Layer *layer);
     uint gidForCell(const Cell &cell) const;
+    uint gidForCell(const Cell &cell, GidCache &cache) const;
     void writeObjectGroup(QXmlStreamWriter &w, const ObjectGroup *objectGroup);
     void writeObject(QXmlStreamWriter &w, const MapObject *mapObject);
     void writeImageLayer(QXmlStreamWriter &w, const ImageLayer *imageLayer);
@@ -87,8 +136,18 @@ private:
                          const Properties &properties);
 
     QDir mMapDir;     // The directory in which the map is being saved
-    QMap<uint, const Tileset*> mFirstGidToTileset;
+    QHash<const Tileset*, uint> mTilesetToFirstGid;
     bool mUseAbsolutePaths;
+
+    // The compression settings used for the map being written
+    int mMapCompressionLevel;
+    CompressionStrategy mMapCompressionStrategy;
+
+    mutable GidCache mGidCache;
+
+    // Only used for encoding layer data, so that waiting for it can not hold
+    // up other work on the global thread pool, or the other way around
+    QThreadPool mLayerDataPool;
 };
 
 } // namespace Internal
@@ -98,7 +157,11 @@ private:
 MapWriterPrivate::MapWriterPrivate()
     : mLayerDataFormat(MapWriter::Base64Gzip)
     , mDtdEnabled(false)
+    , mCompressionLevel(DefaultCompression)
+    , mCompressionStrategy(DefaultStrategy)
     , mUseAbsolutePaths(false)
+    , mMapCompressionLevel(DefaultCompression)
+    , mMapCompressionStrategy(DefaultStrategy)
 {
 }
 
@@ -112,6 +175,22 @@ bool MapWriterPrivate::openFile(QFile *file)
     return true;
 }
 
+/**
+ * Returns whether the layer data \a format is compressed, and with which
+ * compression \a method.
+ */
+static bool compressionMethod(MapWriter::LayerDataFormat format,
+                              CompressionMethod &method)
+{
+    switch (format) {
+    case MapWriter::Base64Gzip:         method = Gzip; return true;
+    case MapWriter::Base64Zlib:         method = Zlib; return true;
+    case MapWriter::Base64Zstandard:    method = Zstandard; return true;
+    case MapWriter::Base64LZ4:          method = LZ4; return true;
+    default:                            return false;
+    }
+}
+
 static QXmlStreamWriter *createWriter(QIODevice *device)
 {
     QXmlStreamWriter *writer = new QXmlStreamWriter(device);
@@ -120,9 +199,16 @@ static QXmlStreamWriter *createWriter(QIODevice *device)
     return writer;
 }
 
-void MapWriterPrivate::writeMap(const Map *map, QIODevice *device,
+bool MapWriterPrivate::writeMap(const Map *map, QIODevice *device,
                                 const QString &path)
 {
+    CompressionMethod method;
+    if (compressionMethod(mLayerDataFormat, method) &&
+            !isCompressionMethodSupported(method)) {
+        mError = tr("The layer data compression method is not supported.");
+        return false;
+    }
+
     mMapDir = QDir(path);
     mUseAbsolutePaths = path.isEmpty();
 
@@ -135,9 +221,11 @@ void MapWriterPrivate::writeMap(const Map *map, QIODevice *device,
                                        "map.dtd\">"));
     }
 
-    writeMap(*writer, map);
-    writer->writeEndDocument();
+    const bool ok = writeMap(*writer, map);
+    if (ok)
+        writer->writeEndDocument();
     delete writer;
+    return ok;
 }
 
 void MapWriterPrivate::writeTileset(const Tileset *tileset, QIODevice *device,
@@ -160,7 +248,7 @@ void MapWriterPrivate::writeTileset(const Tileset *tileset, QIODevice *device,
     delete writer;
 }
 
-void MapWriterPrivate::writeMap(QXmlStreamWriter &w, const Map *map)
+bool MapWriterPrivate::writeMap(QXmlStreamWriter &w, const Map *map)
 {
     w.writeStartElement(QLatin1String("map"));
 
@@ -189,26 +277,81 @@ void MapWriterPrivate::writeMap(QXmlStreamWriter &w, const Map *map)
     w.writeAttribute(QLatin1String("tileheight"),
                      QString::number(map->tileHeight()));
 
+    if (map->compressionLevel() != DefaultCompression) {
+        w.writeAttribute(QLatin1String("compressionlevel"),
+                         QString::number(map->compressionLevel()));
+    }
+    if (map->compressionStrategy() != DefaultStrategy) {
+        w.writeAttribute(QLatin1String("compressionstrategy"),
+                         compressionStrategyToString(
+                             map->compressionStrategy()));
+    }
+
+    // Settings on the writer take precedence over those of the map
+    mMapCompressionLevel = (mCompressionLevel != DefaultCompression)
+            ? mCompressionLevel : map->compressionLevel();
+    mMapCompressionStrategy = (mCompressionStrategy != DefaultStrategy)
+            ? mCompressionStrategy : map->compressionStrategy();
+
     writeProperties(w, map->properties());
 
-    mFirstGidToTileset.clear();
+    mTilesetToFirstGid.clear();
+    mGidCache = GidCache();
     uint firstGid = 1;
     foreach (const Tileset *tileset, map->tilesets()) {
         writeTileset(w, tileset, firstGid);
-        mFirstGidToTileset.insert(firstGid, tileset);
+        mTilesetToFirstGid.insert(tileset, firstGid);
         firstGid += tileset->tileCount();
     }
 
+    // The data of the tile layers is encoded a few layers ahead of the one
+    // being written, each layer waiting for its data to be ready. This
+    // limits the encoded data held in memory to a layer per thread.
+    QList<LayerDataJob*> jobs;
+    if (mLayerDataFormat != MapWriter::XML) {
+        foreach (const Layer *layer, map->layers()) {
+            if (const TileLayer *tileLayer = layer->asTileLayer()) {
+                LayerDataJob *job = new LayerDataJob(this, tileLayer);
+                job->setAutoDelete(false);
+                jobs.append(job);
+            }
+        }
+    }
+
+    const int jobsAhead = qMax(1, mLayerDataPool.maxThreadCount());
+    int startedJobs = 0;
+    while (startedJobs < qMin(jobsAhead, jobs.size()))
+        mLayerDataPool.start(jobs.at(startedJobs++));
+
+    int jobIndex = 0;
+    bool ok = true;
+
     foreach (const Layer *layer, map->layers()) {
-        if (dynamic_cast<const TileLayer*>(layer) != 0)
-            writeTileLayer(w, static_cast<const TileLayer*>(layer));
-        else if (dynamic_cast<const ObjectGroup*>(layer) != 0)
+        if (dynamic_cast<const TileLayer*>(layer) != 0) {
+            if (!writeTileLayer(w, static_cast<const TileLayer*>(layer),
+                                jobs.value(jobIndex++))) {
+                mError = tr("Could not compress the data of layer '%1'.")
+                        .arg(layer->name());
+                ok = false;
+                break;
+            }
+
+            if (startedJobs < jobs.size())
+                mLayerDataPool.start(jobs.at(startedJobs++));
+        } else if (dynamic_cast<const ObjectGroup*>(layer) != 0)
             writeObjectGroup(w, static_cast<const ObjectGroup*>(layer));
         else if (dynamic_cast<const ImageLayer*>(layer) != 0)
             writeImageLayer(w, static_cast<const ImageLayer*>(layer));
     }
 
-    w.writeEndElement();
+    // The jobs that were started ahead need to finish before deleting them
+    if (!ok)
+        mLayerDataPool.waitForDone();
+    qDeleteAll(jobs);
+
+    if (ok)
+        w.writeEndElement();
+    return ok;
 }
 
 void MapWriterPrivate::writeTileset(QXmlStreamWriter &w, const Tileset *tileset,
@@ -281,8 +424,23 @@ void MapWriterPrivate::writeTileset(QXmlStreamWriter &w, const Tileset *tileset,
     w.writeEndElement();
 }
 
-void MapWriterPrivate::writeTileLayer(QXmlStreamWriter &w,
-                                      const TileLayer *tileLayer)
+/**
+ * Writes the Latin-1 text in \a data in pieces, rather than converting all of
+ * it to a QString at once.
+ */
+static void writeLatin1(QXmlStreamWriter &w, const QByteArray &data)
+{
+    const int pieceSize = 65536;
+
+    for (int i = 0; i < data.size(); i += pieceSize) {
+        const int length = qMin(pieceSize, data.size() - i);
+        w.writeCharacters(QString::fromLatin1(data.constData() + i, length));
+    }
+}
+
+bool MapWriterPrivate::writeTileLayer(QXmlStreamWriter &w,
+                                      const TileLayer *tileLayer,
+                                      LayerDataJob *job)
 {
     w.writeStartElement(QLatin1String("layer"));
     writeLayerAttributes(w, tileLayer);
@@ -293,7 +451,9 @@ void MapWriterPrivate::writeTileLayer(QXmlStreamWriter &w,
 
     if (mLayerDataFormat == MapWriter::Base64
             || mLayerDataFormat == MapWriter::Base64Gzip
-            || mLayerDataFormat == MapWriter::Base64Zlib) {
+            || mLayerDataFormat == MapWriter::Base64Zlib
+            || mLayerDataFormat == MapWriter::Base64Zstandard
+            || mLayerDataFormat == MapWriter::Base64LZ4) {
 
         encoding = QLatin1String("base64");
 
@@ -301,6 +461,10 @@ void MapWriterPrivate::writeTileLayer(QXmlStreamWriter &w,
             compression = QLatin1String("gzip");
         else if (mLayerDataFormat == MapWriter::Base64Zlib)
             compression = QLatin1String("zlib");
+        else if (mLayerDataFormat == MapWriter::Base64Zstandard)
+            compression = QLatin1String("zstd");
+        else if (mLayerDataFormat == MapWriter::Base64LZ4)
+            compression = QLatin1String("lz4");
 
     } else if (mLayerDataFormat == MapWriter::CSV)
         encoding = QLatin1String("csv");
@@ -320,48 +484,196 @@ void MapWriterPrivate::writeTileLayer(QXmlStreamWriter &w,
                 w.writeEndElement();
             }
         }
-    } else if (mLayerDataFormat == MapWriter::CSV) {
-        QString tileData;
+    } else {
+        job->done.acquire();
+        if (!job->ok)
+            return false;
 
-        for (int y = 0; y < tileLayer->height(); ++y) {
-            for (int x = 0; x < tileLayer->width(); ++x) {
-                const uint gid = gidForCell(tileLayer->cellAt(x, y));
-                tileData.append(QString::number(gid));
-                if (x != tileLayer->width() - 1
-                    || y != tileLayer->height() - 1)
-                    tileData.append(QLatin1String(","));
-            }
-            tileData.append(QLatin1String("\n"));
+        if (mLayerDataFormat == MapWriter::CSV) {
+            w.writeCharacters(QLatin1String("\n"));
+            writeLatin1(w, job->data);
+        } else {
+            w.writeCharacters(QLatin1String("\n   "));
+            writeLatin1(w, job->data);
+            w.writeCharacters(QLatin1String("\n  "));
         }
 
-        w.writeCharacters(QLatin1String("\n"));
-        w.writeCharacters(tileData);
-    } else {
-        QByteArray tileData;
-        tileData.reserve(tileLayer->height() * tileLayer->width() * 4);
+        // Free the encoded data as soon as it has been written
+        job->data.clear();
+    }
 
-        for (int y = 0; y < tileLayer->height(); ++y) {
-            for (int x = 0; x < tileLayer->width(); ++x) {
-                const uint gid = gidForCell(tileLayer->cellAt(x, y));
-                tileData.append((char) (gid));
-                tileData.append((char) (gid >> 8));
-                tileData.append((char) (gid >> 16));
-                tileData.append((char) (gid >> 24));
+    w.writeEndElement(); // </data>
+    w.writeEndElement(); // </layer>
+    return true;
+}
+
+/**
+ * Writes the decimal representation of \a value to \a out and returns the
+ * position following it.
+ */
+static char *writeNumber(char *out, uint value)
+{
+    char digits[10];
+    int count = 0;
+
+    do {
+        digits[count++] = char('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    while (count > 0)
+        *out++ = digits[--count];
+
+    return out;
+}
+
+void MapWriterPrivate::LayerDataJob::run()
+{
+    if (writer->mLayerDataFormat == MapWriter::CSV)
+        writer->encodeCSVLayerData(data, tileLayer);
+    else
+        ok = writer->encodeBinaryLayerData(data, tileLayer);
+
+    done.release();
+}
+
+void MapWriterPrivate::encodeCSVLayerData(QByteArray &out,
+                                          const TileLayer *tileLayer) const
+{
+    const int width = tileLayer->width();
+    const int height = tileLayer->height();
+
+    GidCache gidCache;
+
+    // Each row is formatted into a buffer with room for the longest
+    // possible row: 10 digits and a comma per tile, plus the newline
+    QByteArray row;
+    row.resize(width * 11 + 1);
+
+    for (int y = 0; y < height; ++y) {
+        char *c = row.data();
+
+        for (int x = 0; x < width; ++x) {
+            c = writeNumber(c, gidForCell(tileLayer->cellAt(x, y), gidCache));
+            if (x != width - 1 || y != height - 1)
+                *c++ = ',';
+        }
+        *c++ = '\n';
+
+        out.append(row.constData(), c - row.constData());
+    }
+}
+
+namespace {
+
+/**
+ * Appends base64 encoded data to a byte array as it comes in. The data is
+ * encoded in pieces of whole groups of three bytes, so that the pieces join
+ * up to the same text as encoding all data at once.
+ */
+class Base64Writer
+{
+public:
+    Base64Writer(QByteArray &out) :
+        mOut(out),
+        mPendingSize(0)
+    {}
+
+    void write(const char *data, int length)
+    {
+        while (length > 0) {
+            const int count = qMin(length, BufferSize - mPendingSize);
+            qMemCopy(mPending + mPendingSize, data, count);
+            mPendingSize += count;
+            data += count;
+            length -= count;
+
+            if (mPendingSize == BufferSize)
+                flush();
+        }
+    }
+
+    void flush()
+    {
+        if (mPendingSize == 0)
+            return;
+
+        const QByteArray piece = QByteArray::fromRawData(mPending,
+                                                         mPendingSize);
+        mOut.append(piece.toBase64());
+        mPendingSize = 0;
+    }
+
+private:
+    // Needs to be a multiple of three to avoid padding between pieces
+    enum { BufferSize = 3 * 8192 };
+
+    QByteArray &mOut;
+    char mPending[BufferSize];
+    int mPendingSize;
+};
+
+} // anonymous namespace
+
+bool MapWriterPrivate::encodeBinaryLayerData(QByteArray &out,
+                                             const TileLayer *tileLayer) const
+{
+    const int width = tileLayer->width();
+    const int height = tileLayer->height();
+
+    CompressionMethod method = Zlib;
+    const bool compressed = compressionMethod(mLayerDataFormat, method);
+    Compressor compressor(method,
+                          mMapCompressionLevel,
+                          mMapCompressionStrategy);
+
+    GidCache gidCache;
+    Base64Writer base64(out);
+    QByteArray row;
+    row.resize(width * 4);
+    QByteArray compressedData;
+    compressedData.resize(16384);
+
+    // The layer data is generated one row at a time and passed through
+    // compression and base64 encoding in pieces, so that only the encoded
+    // text of the whole layer is held in memory
+    for (int y = 0; y <= height; ++y) {
+        if (y < height) {
+            uchar *bytes = reinterpret_cast<uchar*>(row.data());
+
+            for (int x = 0; x < width; ++x) {
+                const uint gid = gidForCell(tileLayer->cellAt(x, y),
+                                            gidCache);
+                *bytes++ = uchar(gid);
+                *bytes++ = uchar(gid >> 8);
+                *bytes++ = uchar(gid >> 16);
+                *bytes++ = uchar(gid >> 24);
             }
+
+            if (!compressed) {
+                base64.write(row.constData(), row.size());
+                continue;
+            }
+
+            compressor.setInput(row.constData(), row.size());
+        } else if (compressed) {
+            compressor.finish();
+        } else {
+            break;
         }
 
-        if (mLayerDataFormat == MapWriter::Base64Gzip)
-            tileData = compress(tileData, Gzip);
-        else if (mLayerDataFormat == MapWriter::Base64Zlib)
-            tileData = compress(tileData, Zlib);
+        int length;
+        while ((length = compressor.read(compressedData.data(),
+                                         compressedData.size())) > 0) {
+            base64.write(compressedData.constData(), length);
+        }
 
-        w.writeCharacters(QLatin1String("\n   "));
-        w.writeCharacters(QString::fromLatin1(tileData.toBase64()));
-        w.writeCharacters(QLatin1String("\n  "));
+        if (length == -1)
+            return false;
     }
 
-    w.writeEndElement(); // </data>
-    w.writeEndElement(); // </layer>
+    base64.flush();
+    return true;
 }
 
 void MapWriterPrivate::writeLayerAttributes(QXmlStreamWriter &w,
@@ -386,12 +698,21 @@ void MapWriterPrivate::writeLayerAttributes(QXmlStreamWriter &w,
 
 /**
  * Returns the global tile ID for the given cell. Only valid after the
- * firstGidToTileset map has been initialized.
+ * tilesetToFirstGid map has been initialized.
  *
  * @param cell the cell to return the global ID for
  * @return the appropriate global tile ID, or 0 if not found
  */
 uint MapWriterPrivate::gidForCell(const Cell &cell) const
+{
+    return gidForCell(cell, mGidCache);
+}
+
+/**
+ * Returns the global tile ID for the given cell, using the given \a cache
+ * for the tileset lookup. Each thread needs to use its own cache.
+ */
+uint MapWriterPrivate::gidForCell(const Cell &cell, GidCache &cache) const
 {
     if (cell.isEmpty())
         return 0;
@@ -399,15 +720,18 @@ uint MapWriterPrivate::gidForCell(const Cell &cell) const
     const Tileset *tileset = cell.tile->tileset();
 
     // Find the first GID for the tileset
-    QMap<uint, const Tileset*>::const_iterator i = mFirstGidToTileset.begin();
-    QMap<uint, const Tileset*>::const_iterator i_end = mFirstGidToTileset.end();
-    while (i != i_end && i.value() != tileset)
-        ++i;
+    if (tileset != cache.tileset) {
+        QHash<const Tileset*, uint>::const_iterator i =
+                mTilesetToFirstGid.find(tileset);
 
-    if (i == i_end) // tileset not found
-        return 0;
+        if (i == mTilesetToFirstGid.end()) // tileset not found
+            return 0;
 
-    uint gid = i.key() + cell.tile->id();
+        cache.tileset = tileset;
+        cache.firstGid = i.value();
+    }
+
+    uint gid = cache.firstGid + cell.tile->id();
     if (cell.flippedHorizontally)
         gid |= FlippedHorizontallyFlag;
     if (cell.flippedVertically)
@@ -548,10 +872,10 @@ MapWriter::~MapWriter()
     delete d;
 }
 
-void MapWriter::writeMap(const Map *map, QIODevice *device,
+bool MapWriter::writeMap(const Map *map, QIODevice *device,
                          const QString &path)
 {
-    d->writeMap(map, device, path);
+    return d->writeMap(map, device, path);
 }
 
 bool MapWriter::writeMap(const Map *map, const QString &fileName)
@@ -560,7 +884,8 @@ bool MapWriter::writeMap(const Map *map, const QString &fileName)
     if (!d->openFile(&file))
         return false;
 
-    writeMap(map, &file, QFileInfo(fileName).absolutePath());
+    if (!writeMap(map, &file, QFileInfo(fileName).absolutePath()))
+        return false;
 
     if (file.error() != QFile::NoError) {
         d->mError = file.errorString();
@@ -607,6 +932,26 @@ MapWriter::LayerDataFormat MapWriter::layerDataFormat() const
     return d->mLayerDataFormat;
 }
 
+void MapWriter::setCompressionLevel(int level)
+{
+    d->mCompressionLevel = level;
+}
+
+int MapWriter::compressionLevel() const
+{
+    return d->mCompressionLevel;
+}
+
+void MapWriter::setCompressionStrategy(CompressionStrategy strategy)
+{
+    d->mCompressionStrategy = strategy;
+}
+
+CompressionStrategy MapWriter::compressionStrategy() const
+{
+    return d->mCompressionStrategy;
+}
+
 void MapWriter::setDtdEnabled(bool enabled)
 {
     d->mDtdEnabled = enabled;
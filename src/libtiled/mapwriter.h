@@ -30,6 +30,7 @@
 #ifndef MAPWRITER_H
 #define MAPWRITER_H
 
+#include "compression.h"
 #include "tiled_global.h"
 
 #include <QString>
@@ -59,10 +60,11 @@ public:
      * be given, which will be used to create relative references to external
      * images and tilesets.
      *
-     * Error checking will need to be done on the \a device after calling this
-     * function.
+     * Returns false and sets errorString() when the layer data could not be
+     * compressed. Other error checking will need to be done on the \a device
+     * after calling this function.
      */
-    void writeMap(const Map *map, QIODevice *device,
+    bool writeMap(const Map *map, QIODevice *device,
                   const QString &path = QString());
 
     /**
@@ -99,13 +101,17 @@ public:
 
     /**
      * The different formats in which the tile layer data can be stored.
+     * Base64Zstandard and Base64LZ4 are only available when the matching
+     * compression method is supported (see isCompressionMethodSupported()).
      */
     enum LayerDataFormat {
-        XML        = 0,
-        Base64     = 1,
-        Base64Gzip = 2,
-        Base64Zlib = 3,
-        CSV        = 4
+        XML             = 0,
+        Base64          = 1,
+        Base64Gzip      = 2,
+        Base64Zlib      = 3,
+        CSV             = 4,
+        Base64Zstandard = 5,
+        Base64LZ4       = 6
     };
 
     /**
@@ -114,6 +120,22 @@ public:
     void setLayerDataFormat(LayerDataFormat format);
     LayerDataFormat layerDataFormat() const;
 
+    /**
+     * Sets the compression level used for compressed layer data, overriding
+     * the level stored in the map. When left at DefaultCompression, the
+     * level of the map is used.
+     */
+    void setCompressionLevel(int level);
+    int compressionLevel() const;
+
+    /**
+     * Sets the compression strategy used for compressed layer data,
+     * overriding the strategy stored in the map. When left at
+     * DefaultStrategy, the strategy of the map is used.
+     */
+    void setCompressionStrategy(CompressionStrategy strategy);
+    CompressionStrategy compressionStrategy() const;
+
     /**
      * Sets whether the DTD reference is written when saving the map.
      */
@@ -35,8 +35,54 @@
 #include "tile.h"
 #include "tileset.h"
 
+#include <QSet>
+
+#include <cmath>
+
 using namespace Tiled;
 
+// The size in tiles of the cells of the spatial index
+static const int IndexCellSize = 8;
+
+// Objects overlapping more cells than this are not put in the cells
+static const int MaxCellsPerObject = 64;
+
+// Cell coordinates are limited to this range, to stay within an int
+static const qreal MaxCellCoordinate = 1 << 24;
+
+static inline quint64 cellKey(int x, int y)
+{
+    return (quint64(quint32(x)) << 32) | quint32(y);
+}
+
+/**
+ * Returns the range of cells of the spatial index overlapped by \a rect.
+ * Returns a null rect when the range would be too large.
+ */
+static QRect cellRange(const QRectF &rect)
+{
+    const qreal left = std::floor(rect.left() / IndexCellSize);
+    const qreal top = std::floor(rect.top() / IndexCellSize);
+    const qreal right = std::floor(rect.right() / IndexCellSize);
+    const qreal bottom = std::floor(rect.bottom() / IndexCellSize);
+
+    if (!(left >= -MaxCellCoordinate && right <= MaxCellCoordinate &&
+          top >= -MaxCellCoordinate && bottom <= MaxCellCoordinate))
+        return QRect();
+
+    return QRect(QPoint(int(left), int(top)), QPoint(int(right), int(bottom)));
+}
+
+/**
+ * Returns whether the two normalized rects overlap, including touching edges
+ * and rects without a size.
+ */
+static inline bool overlaps(const QRectF &a, const QRectF &b)
+{
+    return a.left() <= b.right() && b.left() <= a.right() &&
+            a.top() <= b.bottom() && b.top() <= a.bottom();
+}
+
 ObjectGroup::ObjectGroup(const QString &name,
                          int x, int y, int width, int height)
     : Layer(name, x, y, width, height)
@@ -52,12 +98,14 @@ void ObjectGroup::addObject(MapObject *object)
 {
     mObjects.append(object);
     object->setObjectGroup(this);
+    indexObject(object);
 }
 
 void ObjectGroup::insertObject(int index, MapObject *object)
 {
     mObjects.insert(index, object);
     object->setObjectGroup(this);
+    indexObject(object);
 }
 
 int ObjectGroup::removeObject(MapObject *object)
@@ -65,11 +113,100 @@ int ObjectGroup::removeObject(MapObject *object)
     const int index = mObjects.indexOf(object);
     Q_ASSERT(index != -1);
 
+    unindexObject(object);
     mObjects.removeAt(index);
     object->setObjectGroup(0);
     return index;
 }
 
+QList<MapObject*> ObjectGroup::objectsInRect(const QRectF &rect) const
+{
+    const QRectF area = rect.normalized();
+    QList<MapObject*> result;
+
+    foreach (MapObject *object, mLargeObjects)
+        if (overlaps(object->bounds().normalized(), area))
+            result.append(object);
+
+    const QRect cells = cellRange(area);
+    if (cells.isNull() ||
+            qreal(cells.width()) * cells.height() > mIndexCells.size()) {
+        // Looking up the cells would take longer than checking all objects
+        foreach (MapObject *object, mObjects)
+            if (!mIndexedCells.value(object).isNull() &&
+                    overlaps(object->bounds().normalized(), area))
+                result.append(object);
+        return result;
+    }
+
+    // Objects overlapping multiple cells are found more than once
+    QSet<MapObject*> found;
+
+    for (int y = cells.top(); y <= cells.bottom(); ++y) {
+        for (int x = cells.left(); x <= cells.right(); ++x) {
+            QHash<quint64, QList<MapObject*> >::const_iterator it =
+                    mIndexCells.find(cellKey(x, y));
+            if (it == mIndexCells.end())
+                continue;
+
+            foreach (MapObject *object, it.value()) {
+                if (found.contains(object))
+                    continue;
+                found.insert(object);
+
+                if (overlaps(object->bounds().normalized(), area))
+                    result.append(object);
+            }
+        }
+    }
+
+    return result;
+}
+
+void ObjectGroup::objectBoundsChanged(MapObject *object)
+{
+    unindexObject(object);
+    indexObject(object);
+}
+
+void ObjectGroup::indexObject(MapObject *object)
+{
+    const QRect cells = cellRange(object->bounds().normalized());
+
+    if (cells.isNull() ||
+            qint64(cells.width()) * cells.height() > MaxCellsPerObject) {
+        mLargeObjects.append(object);
+        mIndexedCells.insert(object, QRect());
+        return;
+    }
+
+    for (int y = cells.top(); y <= cells.bottom(); ++y)
+        for (int x = cells.left(); x <= cells.right(); ++x)
+            mIndexCells[cellKey(x, y)].append(object);
+
+    mIndexedCells.insert(object, cells);
+}
+
+void ObjectGroup::unindexObject(MapObject *object)
+{
+    const QRect cells = mIndexedCells.take(object);
+
+    if (cells.isNull()) {
+        mLargeObjects.removeOne(object);
+        return;
+    }
+
+    for (int y = cells.top(); y <= cells.bottom(); ++y) {
+        for (int x = cells.left(); x <= cells.right(); ++x) {
+            const quint64 key = cellKey(x, y);
+            QList<MapObject*> &objects = mIndexCells[key];
+            objects.removeOne(object);
+            if (objects.isEmpty())
+                mIndexCells.remove(key);
+        }
+    }
+}
+
 QRectF ObjectGroup::objectsBoundingRect() const
 {
     QRectF boundingRect;
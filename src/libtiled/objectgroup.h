@@ -35,8 +35,10 @@
 
 #include "layer.h"
 
-#include <QList>
 #include <QColor>
+#include <QHash>
+#include <QList>
+#include <QRect>
 
 namespace Tiled {
 
@@ -88,6 +90,29 @@ public:
      */
     int removeObject(MapObject *object);
 
+    /**
+     * Returns the objects of which the bounds overlap the given \a rect, in
+     * tile coordinates. Objects without a size overlap when their position is
+     * within the rect. The objects are returned in no particular order.
+     *
+     * This uses a spatial index, so it only needs to look at objects near the
+     * given rect.
+     */
+    QList<MapObject*> objectsInRect(const QRectF &rect) const;
+
+    /**
+     * Returns the objects of which the bounds contain the given \a pos, in
+     * tile coordinates. The objects are returned in no particular order.
+     */
+    QList<MapObject*> objectsAt(const QPointF &pos) const
+    { return objectsInRect(QRectF(pos, QSizeF(0, 0))); }
+
+    /**
+     * Updates the spatial index for the changed position or size of the
+     * given \a object. Called by MapObject.
+     */
+    void objectBoundsChanged(MapObject *object);
+
     /**
      * Returns the bounding rect around all objects in this object group.
      */
@@ -150,8 +175,20 @@ protected:
     ObjectGroup *initializeClone(ObjectGroup *clone) const;
 
 private:
+    void indexObject(MapObject *object);
+    void unindexObject(MapObject *object);
+
     QList<MapObject*> mObjects;
     QColor mColor;
+
+    /*
+     * The spatial index divides the plane into square cells, and lists for
+     * each cell the objects overlapping it. Objects covering too many cells
+     * are kept in a separate list instead.
+     */
+    QHash<quint64, QList<MapObject*> > mIndexCells;
+    QHash<MapObject*, QRect> mIndexedCells;
+    QList<MapObject*> mLargeObjects;
 };
 
 } // namespace Tiled
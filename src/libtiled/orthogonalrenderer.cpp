@@ -65,11 +65,11 @@ QRectF OrthogonalRenderer::boundingRect(const MapObject *object) const
     // The -2 and +3 are to account for the pen width and shadow
     if (object->tile()) {
         const QPointF bottomLeft = rect.topLeft();
-        const QPixmap &img = object->tile()->image();
+        const Tile *tile = object->tile();
         return QRectF(bottomLeft.x(),
-                      bottomLeft.y() - img.height(),
-                      img.width(),
-                      img.height()).adjusted(-1, -1, 1, 1);
+                      bottomLeft.y() - tile->height(),
+                      tile->width(),
+                      tile->height()).adjusted(-1, -1, 1, 1);
     } else if (rect.isNull()) {
         return rect.adjusted(-10 - 2, -10 - 2, 10 + 3, 10 + 3);
     } else {
@@ -203,26 +203,29 @@ void OrthogonalRenderer::drawTileLayer(QPainter *painter,
         endY = qMin((int) std::ceil(rect.bottom()) / tileHeight + 1, endY);
     }
 
+    // Tiles that are wider than the grid overlap their neighbors in the
+    // same row, and higher tiles overlap the row above
+    const QSize maxTileSize = layer->maxTileSize();
+    const bool overlapsRow = maxTileSize.width() > tileWidth;
+    const bool overlapsRowAbove = maxTileSize.height() > tileHeight;
+
+    CellRenderer renderer(painter, overlapsRow ? CellRenderer::KeepOrder
+                                               : CellRenderer::AnyOrder);
+
     for (int y = startY; y < endY; ++y) {
         for (int x = startX; x < endX; ++x) {
-            const Cell &cell = layer->cellAt(x, y);
-            if (cell.isEmpty())
-                continue;
-
-            const QPixmap &img = cell.tile->image();
-            const int flipX = cell.flippedHorizontally ? -1 : 1;
-            const int flipY = cell.flippedVertically ? -1 : 1;
-            const int offsetX = cell.flippedHorizontally ? img.width() : 0;
-            const int offsetY = cell.flippedVertically ? 0 : img.height();
-
-            painter->scale(flipX, flipY);
-            painter->drawPixmap(x * tileWidth * flipX - offsetX,
-                                (y + 1) * tileHeight * flipY - offsetY,
-                                img);
-            painter->scale(flipX, flipY);
+            const Cell cell = layer->cellAt(x, y);
+            if (!cell.isEmpty())
+                renderer.render(cell, QPointF(x * tileWidth,
+                                              (y + 1) * tileHeight));
         }
+
+        if (overlapsRowAbove)
+            renderer.flush();
     }
 
+    renderer.flush();
+
     painter->translate(-layerPos);
 }
 
@@ -253,17 +256,17 @@ void OrthogonalRenderer::drawMapObject(QPainter *painter,
 
     if (object->tile())
     {
-        const QPixmap &img = object->tile()->image();
-        const QPoint paintOrigin(0, -img.height());
-        painter->drawPixmap(paintOrigin, img);
+        const Tile *tile = object->tile();
+        const QPoint paintOrigin(0, -tile->height());
+        painter->drawPixmap(paintOrigin, tile->atlas(), tile->imageRect());
 
         QPen pen(Qt::SolidLine);
         painter->setPen(pen);
-        painter->drawRect(QRect(paintOrigin, img.size()));
+        painter->drawRect(QRect(paintOrigin, tile->size()));
         pen.setStyle(Qt::DotLine);
         pen.setColor(color);
         painter->setPen(pen);
-        painter->drawRect(QRect(paintOrigin, img.size()));
+        painter->drawRect(QRect(paintOrigin, tile->size()));
     }
     else
     {
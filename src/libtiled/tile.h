@@ -30,6 +30,7 @@
 #ifndef TILE_H
 #define TILE_H
 
+#include "imageutils.h"
 #include "object.h"
 
 #include <QPixmap>
@@ -38,13 +39,29 @@ namespace Tiled {
 
 class Tileset;
 
+/**
+ * A tile. Its image is usually an area of a larger image shared by all the
+ * tiles of a tileset, which allows tiles of the same tileset to be drawn
+ * together. Use atlas() and imageRect() to draw the tile.
+ */
 class TILEDSHARED_EXPORT Tile : public Object
 {
 public:
     Tile(const QPixmap &image, int id, Tileset *tileset):
         mId(id),
         mTileset(tileset),
-        mImage(image)
+        mAtlas(image),
+        mImageRect(image.rect()),
+        mAverageColorValid(false)
+    {}
+
+    Tile(const QPixmap &atlas, const QRect &imageRect,
+         int id, Tileset *tileset):
+        mId(id),
+        mTileset(tileset),
+        mAtlas(atlas),
+        mImageRect(imageRect),
+        mAverageColorValid(false)
     {}
 
     /**
@@ -58,29 +75,99 @@ public:
     Tileset *tileset() const { return mTileset; }
 
     /**
-     * Returns the image of this tile.
+     * Returns the image of this tile. When the tile is part of an atlas,
+     * this returns a copy of its area, made on the first call. Prefer
+     * drawing the imageRect() of the atlas().
+     */
+    QPixmap image() const
+    {
+        if (mImageRect == mAtlas.rect())
+            return mAtlas;
+        if (mImage.isNull())
+            mImage = mAtlas.copy(mImageRect);
+        return mImage;
+    }
+
+    /**
+     * Returns the image that contains the image of this tile.
+     */
+    const QPixmap &atlas() const { return mAtlas; }
+
+    /**
+     * Returns the area of the atlas() that is the image of this tile.
      */
-    const QPixmap &image() const { return mImage; }
+    const QRect &imageRect() const { return mImageRect; }
 
     /**
      * Sets the image of this tile.
      */
-    void setImage(const QPixmap &image) { mImage = image; }
+    void setImage(const QPixmap &image)
+    {
+        mAtlas = image;
+        mImageRect = image.rect();
+        mImage = QPixmap();
+        mAverageColorValid = false;
+    }
+
+    /**
+     * Sets the image of this tile to the given area of the \a atlas.
+     */
+    void setImage(const QPixmap &atlas, const QRect &imageRect)
+    {
+        mAtlas = atlas;
+        mImageRect = imageRect;
+        mImage = QPixmap();
+        mAverageColorValid = false;
+    }
 
     /**
      * Returns the width of this tile.
      */
-    int width() const { return mImage.width(); }
+    int width() const { return mImageRect.width(); }
 
     /**
      * Returns the height of this tile.
      */
-    int height() const { return mImage.height(); }
+    int height() const { return mImageRect.height(); }
+
+    /**
+     * Returns the size of this tile.
+     */
+    QSize size() const { return mImageRect.size(); }
+
+    /**
+     * Returns the average color of the image of this tile, as a premultiplied
+     * ARGB value. It is used to draw the tile when it is too small to be
+     * recognized.
+     */
+    QRgb averageColor() const
+    {
+        if (!mAverageColorValid) {
+            const QImage image = this->image().toImage();
+            mAverageColor = Tiled::averageColor(image, image.rect());
+            mAverageColorValid = true;
+        }
+        return mAverageColor;
+    }
+
+    /**
+     * Sets the average color of the image of this tile. Allows it to be
+     * computed along with loading the image.
+     */
+    void setAverageColor(QRgb color)
+    {
+        mAverageColor = color;
+        mAverageColorValid = true;
+    }
 
 private:
     int mId;
     Tileset *mTileset;
-    QPixmap mImage;
+    QPixmap mAtlas;
+    QRect mImageRect;
+    mutable QPixmap mImage;
+    mutable QRgb mAverageColor;
+    mutable bool mAverageColorValid;
 };
 
 } // namespace Tiled
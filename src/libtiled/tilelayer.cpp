@@ -38,28 +38,77 @@ using namespace Tiled;
 TileLayer::TileLayer(const QString &name, int x, int y, int width, int height):
     Layer(name, x, y, width, height),
     mMaxTileSize(0, 0),
-    mGrid(width * height)
+    mChunkColumns((width + ChunkMask) >> ChunkBits),
+    mChunkRows((height + ChunkMask) >> ChunkBits),
+    mChunks(mChunkColumns * mChunkRows),
+    mTiles(1, 0)
 {
 }
 
-QRegion TileLayer::region() const
+TileRegion TileLayer::region() const
 {
-    QRegion region;
+    TileRegion region;
 
     for (int y = 0; y < mHeight; ++y) {
+        int rangeStart = -1;
+
         for (int x = 0; x < mWidth; ++x) {
-            if (!cellAt(x, y).isEmpty()) {
-                const int rangeStart = x;
-                for (++x; x <= mWidth; ++x) {
-                    if (x == mWidth || cellAt(x, y).isEmpty()) {
-                        const int rangeEnd = x;
-                        region += QRect(rangeStart + mX, y + mY,
-                                        rangeEnd - rangeStart, 1);
-                        break;
-                    }
-                }
+            const QVector<uint> &chunk = mChunks.at(chunkIndex(x, y));
+            const bool empty = chunk.isEmpty()
+                    || chunk.at(indexInChunk(x, y)) == 0;
+
+            if (!empty && rangeStart == -1) {
+                rangeStart = x;
+            } else if (empty && rangeStart != -1) {
+                region.addSpan(rangeStart + mX, y + mY, x - rangeStart);
+                rangeStart = -1;
             }
+
+            // Skip the rest of this row of an unallocated chunk
+            if (chunk.isEmpty())
+                x |= ChunkMask;
         }
+
+        if (rangeStart != -1)
+            region.addSpan(rangeStart + mX, y + mY, mWidth - rangeStart);
+    }
+
+    return region;
+}
+
+TileRegion TileLayer::differences(const TileLayer &other) const
+{
+    Q_ASSERT(other.mWidth == mWidth && other.mHeight == mHeight);
+
+    TileRegion region;
+
+    for (int y = 0; y < mHeight; ++y) {
+        int rangeStart = -1;
+
+        for (int x = 0; x < mWidth; ++x) {
+            const int index = chunkIndex(x, y);
+            const QVector<uint> &chunk = mChunks.at(index);
+            const QVector<uint> &otherChunk = other.mChunks.at(index);
+
+            // Chunks that are still shared are the same
+            const bool shared = chunk.constData() == otherChunk.constData();
+            const bool different = !shared
+                    && !(cellAt(x, y) == other.cellAt(x, y));
+
+            if (different && rangeStart == -1) {
+                rangeStart = x;
+            } else if (!different && rangeStart != -1) {
+                region.addSpan(rangeStart + mX, y + mY, x - rangeStart);
+                rangeStart = -1;
+            }
+
+            // Skip the rest of this row of a shared chunk
+            if (shared)
+                x |= ChunkMask;
+        }
+
+        if (rangeStart != -1)
+            region.addSpan(rangeStart + mX, y + mY, mWidth - rangeStart);
     }
 
     return region;
@@ -80,7 +129,46 @@ void TileLayer::setCell(int x, int y, const Cell &cell)
         }
     }
 
-    mGrid[x + y * mWidth] = cell;
+    setPackedCell(x, y, packCell(cell));
+}
+
+void TileLayer::setPackedCell(int x, int y, uint packed)
+{
+    QVector<uint> &chunk = mChunks[chunkIndex(x, y)];
+
+    if (chunk.isEmpty()) {
+        // Writing an empty cell never needs to allocate a chunk
+        if (packed == 0)
+            return;
+
+        chunk.fill(0, ChunkArea);
+    }
+
+    chunk[indexInChunk(x, y)] = packed;
+}
+
+/**
+ * Returns the packed representation of \a cell, adding its tile to the tile
+ * table when it isn't in there yet.
+ */
+uint TileLayer::packCell(const Cell &cell)
+{
+    if (cell.isEmpty())
+        return 0;
+
+    uint packed = mTileIndices.value(cell.tile);
+    if (packed == 0) {
+        packed = mTiles.size();
+        mTiles.append(cell.tile);
+        mTileIndices.insert(cell.tile, packed);
+    }
+
+    if (cell.flippedHorizontally)
+        packed |= FlippedHorizontallyBit;
+    if (cell.flippedVertically)
+        packed |= FlippedVerticallyBit;
+
+    return packed;
 }
 
 TileLayer *TileLayer::copy(const QRegion &region) const
@@ -95,12 +183,21 @@ TileLayer *TileLayer::copy(const QRegion &region) const
                                       0, 0,
                                       bounds.width(), bounds.height());
 
-    foreach (const QRect &rect, area.rects())
-        for (int x = rect.left(); x <= rect.right(); ++x)
-            for (int y = rect.top(); y <= rect.bottom(); ++y)
+    foreach (const QRect &rect, area.rects()) {
+        for (int y = rect.top(); y <= rect.bottom(); ++y) {
+            for (int x = rect.left(); x <= rect.right(); ++x) {
+                // Unallocated chunks have nothing to copy
+                if (mChunks.at(chunkIndex(x, y)).isEmpty()) {
+                    x |= ChunkMask;
+                    continue;
+                }
+
                 copied->setCell(x - areaBounds.x() + offsetX,
                                 y - areaBounds.y() + offsetY,
                                 cellAt(x, y));
+            }
+        }
+    }
 
     return copied;
 }
@@ -113,8 +210,8 @@ void TileLayer::merge(const QPoint &pos, const TileLayer *layer)
 
     for (int y = area.top(); y <= area.bottom(); ++y) {
         for (int x = area.left(); x <= area.right(); ++x) {
-            const Cell &cell = layer->cellAt(x - area.left(),
-                                             y - area.top());
+            const Cell cell = layer->cellAt(x - area.left(),
+                                            y - area.top());
             if (!cell.isEmpty())
                 setCell(x, y, cell);
         }
@@ -123,82 +220,192 @@ void TileLayer::merge(const QPoint &pos, const TileLayer *layer)
 
 void TileLayer::flip(FlipDirection direction)
 {
-    QVector<Cell> newGrid(mWidth * mHeight);
+    TileLayer flipped(QString(), 0, 0, mWidth, mHeight);
 
-    for (int y = 0; y < mHeight; ++y) {
-        for (int x = 0; x < mWidth; ++x) {
-            Cell &dest = newGrid[x + y * mWidth];
-            if (direction == FlipHorizontally) {
-                const Cell &source = cellAt(mWidth - x - 1, y);
-                dest = source;
-                dest.flippedHorizontally = !source.flippedHorizontally;
+    for (int chunkY = 0; chunkY < mChunkRows; ++chunkY) {
+        for (int chunkX = 0; chunkX < mChunkColumns; ++chunkX) {
+            const QVector<uint> &chunk =
+                    mChunks.at(chunkX + chunkY * mChunkColumns);
+            if (chunk.isEmpty())
+                continue;
+
+            for (int i = 0; i < ChunkArea; ++i) {
+                const uint source = chunk.at(i);
+                if (source == 0)
+                    continue;
+
+                const int x = (chunkX << ChunkBits) + (i & ChunkMask);
+                const int y = (chunkY << ChunkBits) + (i >> ChunkBits);
+
+                if (direction == FlipHorizontally) {
+                    flipped.setPackedCell(mWidth - x - 1, y,
+                                          source ^ FlippedHorizontallyBit);
+                } else {
+                    flipped.setPackedCell(x, mHeight - y - 1,
+                                          source ^ FlippedVerticallyBit);
+                }
+            }
+        }
+    }
+
+    takeCells(flipped);
+}
+
+/**
+ * Returns for each entry in the tile table whether it is used by a cell on
+ * this layer and its tile is part of \a tileset. Entries not used by any
+ * cell are never looked at, because their tile may no longer exist.
+ */
+QVector<bool> TileLayer::tileIndicesFromTileset(const Tileset *tileset) const
+{
+    enum { Unknown, Matching, NotMatching };
+
+    const int tileCount = mTiles.size();
+    QVector<char> states(tileCount, Unknown);
+    QVector<bool> indices(tileCount, false);
+
+    foreach (const QVector<uint> &chunk, mChunks) {
+        for (int i = 0, i_end = chunk.size(); i < i_end; ++i) {
+            const uint index = chunk.at(i) & TileIndexMask;
+            if (index == 0 || states.at(index) != Unknown)
+                continue;
+
+            if (mTiles.at(index)->tileset() == tileset) {
+                states[index] = Matching;
+                indices[index] = true;
             } else {
-                const Cell &source = cellAt(x, mHeight - y - 1);
-                dest = source;
-                dest.flippedVertically = !source.flippedVertically;
+                states[index] = NotMatching;
             }
         }
     }
 
-    mGrid = newGrid;
+    return indices;
+}
+
+/**
+ * Clears all cells using one of the given entries of the tile table and
+ * removes these entries from the table.
+ */
+void TileLayer::clearTileIndices(const QVector<bool> &indices)
+{
+    for (int c = 0, c_end = mChunks.size(); c < c_end; ++c) {
+        if (mChunks.at(c).isEmpty())
+            continue;
+
+        QVector<uint> &chunk = mChunks[c];
+        for (int i = 0; i < ChunkArea; ++i)
+            if (indices.at(chunk.at(i) & TileIndexMask))
+                chunk[i] = 0;
+    }
+
+    for (int index = 1, index_end = indices.size(); index < index_end; ++index) {
+        if (indices.at(index)) {
+            mTileIndices.remove(mTiles.at(index));
+            mTiles[index] = 0;
+        }
+    }
 }
 
 QSet<Tileset*> TileLayer::usedTilesets() const
 {
+    QVector<bool> used(mTiles.size(), false);
+
+    foreach (const QVector<uint> &chunk, mChunks)
+        for (int i = 0, i_end = chunk.size(); i < i_end; ++i)
+            used[chunk.at(i) & TileIndexMask] = true;
+
     QSet<Tileset*> tilesets;
 
-    for (int i = 0, i_end = mGrid.size(); i < i_end; ++i)
-        if (const Tile *tile = mGrid.at(i).tile)
-            tilesets.insert(tile->tileset());
+    for (int index = 1, index_end = used.size(); index < index_end; ++index)
+        if (used.at(index))
+            tilesets.insert(mTiles.at(index)->tileset());
 
     return tilesets;
 }
 
 bool TileLayer::referencesTileset(const Tileset *tileset) const
 {
-    for (int i = 0, i_end = mGrid.size(); i < i_end; ++i) {
-        const Tile *tile = mGrid.at(i).tile;
-        if (tile && tile->tileset() == tileset)
-            return true;
-    }
-    return false;
+    return tileIndicesFromTileset(tileset).contains(true);
 }
 
-QRegion TileLayer::tilesetReferences(Tileset *tileset) const
+TileRegion TileLayer::tilesetReferences(Tileset *tileset) const
 {
-    QRegion region;
+    const QVector<bool> indices = tileIndicesFromTileset(tileset);
+    TileRegion region;
 
-    for (int y = 0; y < mHeight; ++y)
-        for (int x = 0; x < mWidth; ++x)
-            if (const Tile *tile = cellAt(x, y).tile)
-                if (tile->tileset() == tileset)
-                    region += QRegion(x + mX, y + mY, 1, 1);
+    // Going through the cells row by row allows the region to be built up
+    // one run at a time
+    for (int y = 0; y < mHeight; ++y) {
+        const int rowOffset = (y & ChunkMask) << ChunkBits;
+        int rangeStart = -1;
+
+        for (int chunkX = 0; chunkX < mChunkColumns; ++chunkX) {
+            const int startX = chunkX << ChunkBits;
+            const QVector<uint> &chunk = mChunks.at(chunkIndex(startX, y));
+
+            for (int i = 0; i < ChunkSize; ++i) {
+                const bool referenced = !chunk.isEmpty() &&
+                        indices.at(chunk.at(rowOffset + i) & TileIndexMask);
+
+                if (referenced && rangeStart == -1) {
+                    rangeStart = startX + i;
+                } else if (!referenced && rangeStart != -1) {
+                    region.addSpan(rangeStart + mX, y + mY,
+                                   startX + i - rangeStart);
+                    rangeStart = -1;
+                }
+
+                if (chunk.isEmpty())
+                    break;
+            }
+        }
+
+        if (rangeStart != -1)
+            region.addSpan(rangeStart + mX, y + mY, mWidth - rangeStart);
+    }
 
     return region;
 }
 
 void TileLayer::removeReferencesToTileset(Tileset *tileset)
 {
-    for (int i = 0, i_end = mGrid.size(); i < i_end; ++i) {
-        const Tile *tile = mGrid.at(i).tile;
-        if (tile && tile->tileset() == tileset)
-            mGrid.replace(i, Cell());
-    }
+    const QVector<bool> indices = tileIndicesFromTileset(tileset);
+    if (indices.contains(true))
+        clearTileIndices(indices);
 }
 
 void TileLayer::replaceReferencesToTileset(Tileset *oldTileset,
                                            Tileset *newTileset)
 {
-    for (int i = 0, i_end = mGrid.size(); i < i_end; ++i) {
-        const Tile *tile = mGrid.at(i).tile;
-        if (tile && tile->tileset() == oldTileset)
-            mGrid[i].tile = newTileset->tileAt(tile->id());
+    QVector<bool> indices = tileIndicesFromTileset(oldTileset);
+    bool clearNeeded = false;
+
+    // Only the tile table needs to change, unless the new tileset lacks
+    // some of the tiles
+    for (int index = 1, index_end = indices.size(); index < index_end; ++index) {
+        if (!indices.at(index))
+            continue;
+
+        Tile *oldTile = mTiles.at(index);
+        Tile *newTile = newTileset->tileAt(oldTile->id());
+
+        if (newTile) {
+            mTileIndices.remove(oldTile);
+            mTiles[index] = newTile;
+            mTileIndices.insert(newTile, index);
+            indices[index] = false;
+        } else {
+            clearNeeded = true;
+        }
     }
+
+    if (clearNeeded)
+        clearTileIndices(indices);
 }
 
 void TileLayer::resize(const QSize &size, const QPoint &offset)
 {
-    QVector<Cell> newGrid(size.width() * size.height());
+    TileLayer resized(QString(), 0, 0, size.width(), size.height());
 
     // Copy over the preserved part
     const int startX = qMax(0, -offset.x());
@@ -208,12 +415,17 @@ void TileLayer::resize(const QSize &size, const QPoint &offset)
 
     for (int y = startY; y < endY; ++y) {
         for (int x = startX; x < endX; ++x) {
-            const int index = x + offset.x() + (y + offset.y()) * size.width();
-            newGrid[index] = cellAt(x, y);
+            if (mChunks.at(chunkIndex(x, y)).isEmpty()) {
+                x |= ChunkMask;
+                continue;
+            }
+
+            resized.setPackedCell(x + offset.x(), y + offset.y(),
+                                  packedCellAt(x, y));
         }
     }
 
-    mGrid = newGrid;
+    takeCells(resized);
     Layer::resize(size, offset);
 }
 
@@ -221,13 +433,13 @@ void TileLayer::offset(const QPoint &offset,
                        const QRect &bounds,
                        bool wrapX, bool wrapY)
 {
-    QVector<Cell> newGrid(mWidth * mHeight);
+    TileLayer shifted(QString(), 0, 0, mWidth, mHeight);
 
     for (int y = 0; y < mHeight; ++y) {
         for (int x = 0; x < mWidth; ++x) {
             // Skip out of bounds tiles
             if (!bounds.contains(x, y)) {
-                newGrid[x + y * mWidth] = cellAt(x, y);
+                shifted.setPackedCell(x, y, packedCellAt(x, y));
                 continue;
             }
 
@@ -253,13 +465,11 @@ void TileLayer::offset(const QPoint &offset,
 
             // Set the new tile
             if (contains(oldX, oldY) && bounds.contains(oldX, oldY))
-                newGrid[x + y * mWidth] = cellAt(oldX, oldY);
-            else
-                newGrid[x + y * mWidth] = Cell();
+                shifted.setPackedCell(x, y, packedCellAt(oldX, oldY));
         }
     }
 
-    mGrid = newGrid;
+    takeCells(shifted);
 }
 
 bool TileLayer::canMergeWith(Layer *other) const
@@ -283,9 +493,10 @@ Layer *TileLayer::mergedWith(Layer *other) const
 
 bool TileLayer::isEmpty() const
 {
-    for (int i = 0, i_end = mGrid.size(); i < i_end; ++i)
-        if (!mGrid.at(i).isEmpty())
-            return false;
+    foreach (const QVector<uint> &chunk, mChunks)
+        for (int i = 0, i_end = chunk.size(); i < i_end; ++i)
+            if (chunk.at(i) != 0)
+                return false;
 
     return true;
 }
@@ -303,7 +514,24 @@ Layer *TileLayer::clone() const
 TileLayer *TileLayer::initializeClone(TileLayer *clone) const
 {
     Layer::initializeClone(clone);
-    clone->mGrid = mGrid;
+    clone->mChunkColumns = mChunkColumns;
+    clone->mChunkRows = mChunkRows;
+    clone->mChunks = mChunks;
+    clone->mTiles = mTiles;
+    clone->mTileIndices = mTileIndices;
     clone->mMaxTileSize = mMaxTileSize;
     return clone;
 }
+
+/**
+ * Takes over the cells of \a other, which is expected to have the size this
+ * layer will have afterwards. Used when restructuring the whole layer. The
+ * cells of \a other need to have been packed against the tile table of this
+ * layer.
+ */
+void TileLayer::takeCells(TileLayer &other)
+{
+    mChunkColumns = other.mChunkColumns;
+    mChunkRows = other.mChunkRows;
+    mChunks = other.mChunks;
+}
@@ -33,7 +33,9 @@
 #include "tiled_global.h"
 
 #include "layer.h"
+#include "tileregion.h"
 
+#include <QHash>
 #include <QString>
 #include <QVector>
 
@@ -76,6 +78,14 @@ public:
 
 /**
  * A tile layer.
+ *
+ * The cells are stored in square chunks that are only allocated once a
+ * non-empty cell is written to them, so that memory use scales with the
+ * painted area rather than with the size of the layer.
+ *
+ * Within a chunk each cell is packed into 32 bits: an index into a table of
+ * the tiles used by this layer, with the flip flags stored in the high bits
+ * the same way as in the global tile IDs of the TMX format.
  */
 class TILEDSHARED_EXPORT TileLayer : public Layer
 {
@@ -109,16 +119,16 @@ public:
      * Calculates the region occupied by the tiles of this layer. Similar to
      * Layer::bounds(), but leaves out the regions without tiles.
      */
-    QRegion region() const;
+    TileRegion region() const;
 
     /**
-     * Returns a read-only reference to the cell at the given coordinates. The
-     * coordinates have to be within this layer.
+     * Returns the cell at the given coordinates. The coordinates have to be
+     * within this layer.
      */
-    const Cell &cellAt(int x, int y) const
-    { return mGrid.at(x + y * mWidth); }
+    Cell cellAt(int x, int y) const
+    { return unpackCell(packedCellAt(x, y)); }
 
-    const Cell &cellAt(const QPoint &point) const
+    Cell cellAt(const QPoint &point) const
     { return cellAt(point.x(), point.y()); }
 
     /**
@@ -161,7 +171,17 @@ public:
     /**
      * Returns the region of tiles coming from the given \a tileset.
      */
-    QRegion tilesetReferences(Tileset *tileset) const;
+    TileRegion tilesetReferences(Tileset *tileset) const;
+
+    /**
+     * Returns the region of cells in which this layer differs from \a other.
+     * Both layers need to have the same size.
+     *
+     * This is fast when \a other is a clone of this layer, since the parts
+     * that were not changed since cloning are still shared and can be
+     * skipped.
+     */
+    TileRegion differences(const TileLayer &other) const;
 
     /**
      * Removes all references to the given tileset. This sets all tiles on this
@@ -208,8 +228,56 @@ protected:
     TileLayer *initializeClone(TileLayer *clone) const;
 
 private:
+    enum {
+        ChunkBits = 4,
+        ChunkSize = 1 << ChunkBits,
+        ChunkMask = ChunkSize - 1,
+        ChunkArea = ChunkSize * ChunkSize
+    };
+
+    int chunkIndex(int x, int y) const
+    { return (x >> ChunkBits) + (y >> ChunkBits) * mChunkColumns; }
+
+    static int indexInChunk(int x, int y)
+    { return (x & ChunkMask) + ((y & ChunkMask) << ChunkBits); }
+
+    // Layout of a packed cell, matching the flags of the TMX global tile IDs
+    static const uint FlippedHorizontallyBit = 0x80000000;
+    static const uint FlippedVerticallyBit   = 0x40000000;
+    static const uint TileIndexMask          = 0x3FFFFFFF;
+
+    uint packedCellAt(int x, int y) const
+    {
+        const QVector<uint> &chunk = mChunks.at(chunkIndex(x, y));
+        return chunk.isEmpty() ? 0 : chunk.at(indexInChunk(x, y));
+    }
+
+    void setPackedCell(int x, int y, uint packed);
+
+    Cell unpackCell(uint packed) const
+    {
+        Cell cell(mTiles.at(packed & TileIndexMask));
+        cell.flippedHorizontally = packed & FlippedHorizontallyBit;
+        cell.flippedVertically = packed & FlippedVerticallyBit;
+        return cell;
+    }
+
+    uint packCell(const Cell &cell);
+
+    QVector<bool> tileIndicesFromTileset(const Tileset *tileset) const;
+    void clearTileIndices(const QVector<bool> &indices);
+    void takeCells(TileLayer &other);
+
     QSize mMaxTileSize;
-    QVector<Cell> mGrid;
+    int mChunkColumns;
+    int mChunkRows;
+    QVector<QVector<uint> > mChunks;  // Empty chunks are not allocated
+
+    // Table of the tiles referenced by packed cells. Index 0 is the empty
+    // cell. Entries no longer used by any cell are kept, but never
+    // dereferenced, since their tile may have been deleted.
+    QVector<Tile*> mTiles;
+    QHash<Tile*, uint> mTileIndices;
 };
 
 } // namespace Tiled
@@ -0,0 +1,342 @@
+/*
+ * tileregion.cpp
+ * Copyright 2026, agent <agent@local>
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "tileregion.h"
+
+#include <algorithm>
+
+using namespace Tiled;
+
+namespace {
+
+/**
+ * Orders spans before the cells following them, for finding the span that
+ * may contain a cell.
+ */
+struct SpanBefore
+{
+    bool operator()(const TileRegion::Span &span, const QPoint &cell) const
+    {
+        return span.y < cell.y() ||
+                (span.y == cell.y() && span.right <= cell.x());
+    }
+};
+
+} // anonymous namespace
+
+TileRegion::TileRegion(const QRect &rect)
+{
+    addRect(rect);
+}
+
+TileRegion::TileRegion(const QRegion &region)
+{
+    // The rects of a QRegion are sorted by row, and rects starting on the
+    // same row form a band of equal height
+    const QVector<QRect> rects = region.rects();
+
+    int bandStart = 0;
+    while (bandStart < rects.size()) {
+        const QRect &first = rects.at(bandStart);
+        int bandEnd = bandStart + 1;
+        while (bandEnd < rects.size() && rects.at(bandEnd).top() == first.top())
+            ++bandEnd;
+
+        for (int y = first.top(); y <= first.bottom(); ++y) {
+            for (int i = bandStart; i < bandEnd; ++i) {
+                const QRect &rect = rects.at(i);
+                appendSpan(y, rect.left(), rect.right() + 1);
+            }
+        }
+
+        bandStart = bandEnd;
+    }
+}
+
+int TileRegion::cellCount() const
+{
+    int count = 0;
+    foreach (const Span &span, mSpans)
+        count += span.right - span.left;
+    return count;
+}
+
+QRect TileRegion::boundingRect() const
+{
+    if (mSpans.isEmpty())
+        return QRect();
+
+    int left = mSpans.first().left;
+    int right = mSpans.first().right;
+    foreach (const Span &span, mSpans) {
+        left = qMin(left, span.left);
+        right = qMax(right, span.right);
+    }
+
+    return QRect(QPoint(left, mSpans.first().y),
+                 QPoint(right - 1, mSpans.last().y));
+}
+
+bool TileRegion::contains(int x, int y) const
+{
+    const QVector<Span>::const_iterator it =
+            std::lower_bound(mSpans.begin(), mSpans.end(),
+                             QPoint(x, y), SpanBefore());
+
+    return it != mSpans.end() && it->y == y && it->left <= x;
+}
+
+void TileRegion::addSpan(int x, int y, int width)
+{
+    if (width <= 0)
+        return;
+
+    if (mSpans.isEmpty() || y > mSpans.last().y ||
+            (y == mSpans.last().y && x >= mSpans.last().left)) {
+        appendSpan(y, x, x + width);
+    } else {
+        TileRegion span;
+        span.appendSpan(y, x, x + width);
+        *this = united(span);
+    }
+}
+
+void TileRegion::addRect(const QRect &rect)
+{
+    if (rect.isEmpty())
+        return;
+
+    if (mSpans.isEmpty() || rect.top() > mSpans.last().y) {
+        for (int y = rect.top(); y <= rect.bottom(); ++y)
+            appendSpan(y, rect.left(), rect.right() + 1);
+    } else {
+        *this = united(TileRegion(rect));
+    }
+}
+
+TileRegion TileRegion::united(const TileRegion &other) const
+{
+    if (other.isEmpty())
+        return *this;
+    if (isEmpty())
+        return other;
+
+    const QVector<Span> &a = mSpans;
+    const QVector<Span> &b = other.mSpans;
+    TileRegion result;
+    result.mSpans.reserve(qMax(a.size(), b.size()));
+
+    int i = 0, j = 0;
+    while (i < a.size() || j < b.size()) {
+        const bool takeA = j == b.size() ||
+                (i < a.size() && (a.at(i).y < b.at(j).y ||
+                                  (a.at(i).y == b.at(j).y &&
+                                   a.at(i).left <= b.at(j).left)));
+        const Span &span = takeA ? a.at(i++) : b.at(j++);
+        result.appendSpan(span.y, span.left, span.right);
+    }
+
+    return result;
+}
+
+TileRegion TileRegion::intersected(const TileRegion &other) const
+{
+    const QVector<Span> &a = mSpans;
+    const QVector<Span> &b = other.mSpans;
+    TileRegion result;
+
+    int i = 0, j = 0;
+    while (i < a.size() && j < b.size()) {
+        const Span &spanA = a.at(i);
+        const Span &spanB = b.at(j);
+
+        if (spanA.y < spanB.y) {
+            ++i;
+        } else if (spanB.y < spanA.y) {
+            ++j;
+        } else {
+            const int left = qMax(spanA.left, spanB.left);
+            const int right = qMin(spanA.right, spanB.right);
+            if (left < right)
+                result.mSpans.append(Span(spanA.y, left, right));
+
+            if (spanA.right < spanB.right)
+                ++i;
+            else
+                ++j;
+        }
+    }
+
+    return result;
+}
+
+TileRegion TileRegion::subtracted(const TileRegion &other) const
+{
+    const QVector<Span> &b = other.mSpans;
+    TileRegion result;
+
+    int j = 0;
+    foreach (const Span &span, mSpans) {
+        // Skip the spans that end before this one starts
+        while (j < b.size() && (b.at(j).y < span.y ||
+                                (b.at(j).y == span.y &&
+                                 b.at(j).right <= span.left)))
+            ++j;
+
+        int left = span.left;
+        for (int k = j; k < b.size() && b.at(k).y == span.y &&
+             b.at(k).left < span.right; ++k) {
+            if (b.at(k).left > left)
+                result.mSpans.append(Span(span.y, left, b.at(k).left));
+            left = qMax(left, b.at(k).right);
+        }
+
+        if (left < span.right)
+            result.mSpans.append(Span(span.y, left, span.right));
+    }
+
+    return result;
+}
+
+TileRegion TileRegion::translated(const QPoint &offset) const
+{
+    TileRegion result(*this);
+    for (int i = 0; i < result.mSpans.size(); ++i) {
+        Span &span = result.mSpans[i];
+        span.y += offset.y();
+        span.left += offset.x();
+        span.right += offset.x();
+    }
+    return result;
+}
+
+bool TileRegion::intersects(const TileRegion &other) const
+{
+    const QVector<Span> &a = mSpans;
+    const QVector<Span> &b = other.mSpans;
+
+    int i = 0, j = 0;
+    while (i < a.size() && j < b.size()) {
+        const Span &spanA = a.at(i);
+        const Span &spanB = b.at(j);
+
+        if (spanA.y < spanB.y) {
+            ++i;
+        } else if (spanB.y < spanA.y) {
+            ++j;
+        } else {
+            if (qMax(spanA.left, spanB.left) < qMin(spanA.right, spanB.right))
+                return true;
+
+            if (spanA.right < spanB.right)
+                ++i;
+            else
+                ++j;
+        }
+    }
+
+    return false;
+}
+
+QVector<QRect> TileRegion::rects() const
+{
+    QVector<QRect> rects;
+
+    // The current band is a run of rows with the same spans
+    int bandStart = 0;
+    int bandSize = 0;
+    int bandBottom = 0;
+
+    int rowStart = 0;
+    while (rowStart <= mSpans.size()) {
+        int rowEnd = rowStart;
+        while (rowEnd < mSpans.size() &&
+               mSpans.at(rowEnd).y == mSpans.at(rowStart).y)
+            ++rowEnd;
+
+        bool sameAsBand = false;
+        if (rowEnd > rowStart && bandSize == rowEnd - rowStart &&
+                mSpans.at(rowStart).y == bandBottom + 1) {
+            sameAsBand = true;
+            for (int i = 0; i < bandSize && sameAsBand; ++i) {
+                const Span &a = mSpans.at(bandStart + i);
+                const Span &b = mSpans.at(rowStart + i);
+                sameAsBand = a.left == b.left && a.right == b.right;
+            }
+        }
+
+        if (sameAsBand) {
+            ++bandBottom;
+        } else {
+            for (int i = bandStart; i < bandStart + bandSize; ++i) {
+                const Span &span = mSpans.at(i);
+                rects.append(QRect(QPoint(span.left, span.y),
+                                   QPoint(span.right - 1, bandBottom)));
+            }
+
+            if (rowEnd == rowStart)
+                break;
+
+            bandStart = rowStart;
+            bandSize = rowEnd - rowStart;
+            bandBottom = mSpans.at(rowStart).y;
+        }
+
+        rowStart = rowEnd;
+    }
+
+    return rects;
+}
+
+QRegion TileRegion::toRegion() const
+{
+    // The rects are already in the banded form used by QRegion
+    const QVector<QRect> rects = this->rects();
+
+    QRegion region;
+    if (!rects.isEmpty())
+        region.setRects(rects.constData(), rects.size());
+    return region;
+}
+
+/**
+ * Appends a span that does not start before the last span, merging it with
+ * the last span when they overlap or touch.
+ */
+void TileRegion::appendSpan(int y, int left, int right)
+{
+    if (!mSpans.isEmpty()) {
+        Span &last = mSpans.last();
+        if (last.y == y && left <= last.right) {
+            last.right = qMax(last.right, right);
+            return;
+        }
+    }
+
+    mSpans.append(Span(y, left, right));
+}
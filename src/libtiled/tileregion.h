@@ -0,0 +1,153 @@
+/*
+ * tileregion.h
+ * Copyright 2026, agent <agent@local>
+ *
+ * This file is part of libtiled.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE CONTRIBUTORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TILEREGION_H
+#define TILEREGION_H
+
+#include "tiled_global.h"
+
+#include <QRect>
+#include <QRegion>
+#include <QVector>
+
+namespace Tiled {
+
+/**
+ * A set of cells on a tile grid, stored as horizontal runs of cells sorted by
+ * row. Unlike QRegion, building it up one run at a time in row order and
+ * combining regions take linear time, which matters for the large and
+ * fragmented areas that come out of tile layers.
+ *
+ * Convert it to a QRegion using toRegion() where one is needed, for example
+ * for repainting.
+ */
+class TILEDSHARED_EXPORT TileRegion
+{
+public:
+    /**
+     * A run of cells in a single row, from \a left up to but not including
+     * \a right.
+     */
+    struct Span
+    {
+        Span() : y(0), left(0), right(0) {}
+        Span(int y, int left, int right) : y(y), left(left), right(right) {}
+
+        bool operator==(const Span &other) const
+        {
+            return y == other.y && left == other.left && right == other.right;
+        }
+
+        int y;
+        int left;
+        int right;
+    };
+
+    TileRegion() {}
+    TileRegion(const QRect &rect);
+    explicit TileRegion(const QRegion &region);
+
+    bool isEmpty() const { return mSpans.isEmpty(); }
+
+    /**
+     * Returns the runs of cells in this region, sorted by row and then by
+     * column. Runs in the same row never touch.
+     */
+    const QVector<Span> &spans() const { return mSpans; }
+
+    /**
+     * Returns the number of cells in this region.
+     */
+    int cellCount() const;
+
+    QRect boundingRect() const;
+
+    bool contains(int x, int y) const;
+    bool contains(const QPoint &point) const
+    { return contains(point.x(), point.y()); }
+
+    /**
+     * Adds the \a width cells starting at \a x, \a y to this region. This is
+     * fastest when the cells are added in row order, left to right.
+     */
+    void addSpan(int x, int y, int width);
+
+    /**
+     * Adds the cells within \a rect to this region.
+     */
+    void addRect(const QRect &rect);
+
+    TileRegion united(const TileRegion &other) const;
+    TileRegion intersected(const TileRegion &other) const;
+    TileRegion subtracted(const TileRegion &other) const;
+    TileRegion translated(const QPoint &offset) const;
+    TileRegion translated(int dx, int dy) const
+    { return translated(QPoint(dx, dy)); }
+
+    bool intersects(const TileRegion &other) const;
+
+    /**
+     * Returns a set of non-overlapping rectangles covering this region.
+     * Consecutive rows with the same runs are combined into a single
+     * rectangle per run.
+     */
+    QVector<QRect> rects() const;
+
+    /**
+     * Returns this region as a QRegion.
+     */
+    QRegion toRegion() const;
+
+    TileRegion operator|(const TileRegion &other) const
+    { return united(other); }
+    TileRegion operator&(const TileRegion &other) const
+    { return intersected(other); }
+    TileRegion operator-(const TileRegion &other) const
+    { return subtracted(other); }
+
+    TileRegion &operator|=(const TileRegion &other)
+    { return *this = united(other); }
+    TileRegion &operator&=(const TileRegion &other)
+    { return *this = intersected(other); }
+    TileRegion &operator-=(const TileRegion &other)
+    { return *this = subtracted(other); }
+
+    bool operator==(const TileRegion &other) const
+    { return mSpans == other.mSpans; }
+    bool operator!=(const TileRegion &other) const
+    { return mSpans != other.mSpans; }
+
+private:
+    void appendSpan(int y, int left, int right);
+
+    QVector<Span> mSpans;
+};
+
+} // namespace Tiled
+
+#endif // TILEREGION_H
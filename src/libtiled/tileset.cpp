@@ -28,9 +28,10 @@
  */
 
 #include "tileset.h"
+#include "imageutils.h"
 #include "tile.h"
 
-#include <QBitmap>
+#include <QImage>
 
 using namespace Tiled;
 
@@ -51,38 +52,83 @@ bool Tileset::loadFromImage(const QImage &image, const QString &fileName)
     if (image.isNull())
         return false;
 
+    // Images larger than this are still split into a pixmap per tile,
+    // since not all paint engines can handle them as a single pixmap
+    static const int MaxAtlasSize = 8192;
+
+    // The transparent color is turned into alpha, rather than setting a
+    // mask on each tile
+    const QImage maskedImage = mTransparentColor.isValid()
+            ? makeColorTransparent(image, mTransparentColor)
+            : image;
+
     const int stopWidth = image.width() - mTileWidth;
     const int stopHeight = image.height() - mTileHeight;
 
+    QList<QRect> imageRects;
+    int columns = 0;
+    for (int y = mMargin; y <= stopHeight; y += mTileHeight + mTileSpacing) {
+        for (int x = mMargin; x <= stopWidth; x += mTileWidth + mTileSpacing)
+            imageRects.append(QRect(x, y, mTileWidth, mTileHeight));
+        if (columns == 0)
+            columns = imageRects.size();
+    }
+
+    // In the atlas, each tile gets a border of one pixel
+    const int rows = columns > 0 ? imageRects.size() / columns : 0;
+    const bool useAtlas = columns * (mTileWidth + 2) <= MaxAtlasSize
+            && rows * (mTileHeight + 2) <= MaxAtlasSize;
+
+    // The border repeats the edge pixels of the tile, so that drawing the
+    // tile with smooth scaling does not pick up pixels of other tiles
+    QList<QRect> atlasRects;
+    QPixmap atlas;
+    if (useAtlas) {
+        atlas = QPixmap::fromImage(extrudeImageAreas(maskedImage, imageRects,
+                                                     columns, &atlasRects));
+    }
+
+    // Without an atlas, the tiles are cut out on the thread pool and only
+    // uploaded as pixmaps here
+    QList<QImage> tileImages;
+    if (!useAtlas)
+        tileImages = copyImageAreas(maskedImage, imageRects);
+
+    // Used when the tiles are drawn too small to be recognized
+    const QList<QRgb> averageColors = Tiled::averageColors(maskedImage,
+                                                           imageRects);
+
     int oldTilesetSize = mTiles.size();
     int tileNum = 0;
 
-    for (int y = mMargin; y <= stopHeight; y += mTileHeight + mTileSpacing) {
-        for (int x = mMargin; x <= stopWidth; x += mTileWidth + mTileSpacing) {
-            const QImage tileImage = image.copy(x, y, mTileWidth, mTileHeight);
-            QPixmap tilePixmap = QPixmap::fromImage(tileImage);
-
-            if (mTransparentColor.isValid()) {
-                const QImage mask =
-                        tileImage.createMaskFromColor(mTransparentColor.rgb());
-                tilePixmap.setMask(QBitmap::fromImage(mask));
-            }
-
-            if (tileNum < oldTilesetSize) {
-                mTiles.at(tileNum)->setImage(tilePixmap);
-            } else {
-                mTiles.append(new Tile(tilePixmap, tileNum, this));
-            }
-            ++tileNum;
+    for (; tileNum < imageRects.size(); ++tileNum) {
+        QPixmap tileImage = atlas;
+        QRect imageRect;
+
+        if (useAtlas) {
+            imageRect = atlasRects.at(tileNum);
+        } else {
+            tileImage = QPixmap::fromImage(tileImages.at(tileNum));
+            imageRect = tileImage.rect();
         }
+
+        if (tileNum < oldTilesetSize) {
+            mTiles.at(tileNum)->setImage(tileImage, imageRect);
+        } else {
+            mTiles.append(new Tile(tileImage, imageRect, tileNum, this));
+        }
+        mTiles.at(tileNum)->setAverageColor(averageColors.at(tileNum));
     }
 
     // Blank out any remaining tiles to avoid confusion
-    while (tileNum < oldTilesetSize) {
+    if (tileNum < oldTilesetSize) {
         QPixmap tilePixmap = QPixmap(mTileWidth, mTileHeight);
         tilePixmap.fill();
-        mTiles.at(tileNum)->setImage(tilePixmap);
-        ++tileNum;
+
+        while (tileNum < oldTilesetSize) {
+            mTiles.at(tileNum)->setImage(tilePixmap);
+            ++tileNum;
+        }
     }
 
     mImageWidth = image.width();
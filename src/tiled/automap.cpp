@@ -31,14 +31,12 @@
 #include "tilelayer.h"
 #include "tilepainter.h"
 #include "tileset.h"
-#include "tilesetmanager.h"
-#include "tmxmapreader.h"
 
-#include <QFile>
 #include <QFileInfo>
 #include <QFileSystemWatcher>
 #include <QObject>
-#include <QTextStream>
+#include <QSemaphore>
+#include <QThreadPool>
 
 using namespace Tiled;
 using namespace Tiled::Internal;
@@ -46,10 +44,10 @@ using namespace Tiled::Internal;
 AutoMapper::AutoMapper(MapDocument *workingDocument, QString setlayer)
     : mMapDocument(workingDocument)
     , mMapWork(workingDocument ? workingDocument->map() : 0)
-    , mMapRules(0)
-    , mLayerRuleRegions(0)
+    , mRuleMap(0)
     , mSetLayer(setlayer)
     , mLayerSet(0)
+    , mRandomSeed(0)
 {
 
     connect(mMapDocument, SIGNAL(layerAdded(int)), SLOT(layerAdd(int)));
@@ -71,14 +69,14 @@ QSet<QString> AutoMapper::getTouchedLayers() const
     return mTouchedLayers;
 }
 
-bool AutoMapper::prepareLoad(Map *rules, const QString &rulePath)
+bool AutoMapper::prepareLoad(RuleMap *ruleMap)
 {
     mError.clear();
 
     if (!setupMapDocumentLayers())
         return false;
 
-    if (!setupRulesMap(rules, rulePath))
+    if (!setupRulesMap(ruleMap))
         return false;
 
     if (!setupRuleMapLayers())
@@ -87,9 +85,6 @@ bool AutoMapper::prepareLoad(Map *rules, const QString &rulePath)
     if (!setupRulesUsedCheck())
         return false;
 
-    if (!setupRuleList())
-        return false;
-
     return true;
 }
 
@@ -125,12 +120,12 @@ TileLayer *AutoMapper::findTileLayer(Map *map, const QString &name)
     return ret;
 }
 
-bool AutoMapper::setupRulesMap(Map *rules, const QString &rulePath)
+bool AutoMapper::setupRulesMap(RuleMap *ruleMap)
 {
-    Q_ASSERT(!mMapRules);
+    Q_ASSERT(!mRuleMap);
 
-    mMapRules = rules;
-    mRulePath = rulePath;
+    mRuleMap = ruleMap;
+    Map *rules = mRuleMap->map();
 
     QVariant p = rules->property(QLatin1String("DeleteTiles"));
 
@@ -146,41 +141,16 @@ bool AutoMapper::setupRulesMap(Map *rules, const QString &rulePath)
 bool AutoMapper::setupRuleMapLayers()
 {
     Q_ASSERT(mLayerList.isEmpty());
-    Q_ASSERT(!mLayerRuleRegions);
-    Q_ASSERT(mLayerRuleSets.isEmpty());
-    Q_ASSERT(mLayerRuleNotSets.isEmpty());
     Q_ASSERT(mAddedTilesets.isEmpty());
 
     QString prefix = QLatin1String("rule");
 
-    foreach (Layer *layer, mMapRules->layers()) {
-    if (TileLayer *tileLayer = layer->asTileLayer()) {
-
-        if (!tileLayer->name().startsWith(prefix, Qt::CaseInsensitive))
-            continue;
-
+    // the ruleSet, ruleNotSet and ruleRegions layers are sorted out already
+    foreach (TileLayer *tileLayer, mRuleMap->ruleOutputs()) {
         // strip leading prefix, to make handling better
         QString layername = tileLayer->name();
         layername.remove(0, prefix.length());
 
-        if (layername.startsWith(
-                QLatin1String("set"), Qt::CaseInsensitive)) {
-            mLayerRuleSets.append(tileLayer);
-            continue;
-        }
-
-        if (layername.startsWith(
-                QLatin1String("notset"), Qt::CaseInsensitive)) {
-            mLayerRuleNotSets.append(tileLayer);
-            continue;
-        }
-
-        if (layername.startsWith(
-                QLatin1String("regions"), Qt::CaseInsensitive)) {
-            mLayerRuleRegions = tileLayer;
-            continue;
-        }
-
         int pos = layername.indexOf(QLatin1Char('_')) + 1;
         QString group = layername.left(pos) ;
 
@@ -217,25 +187,24 @@ bool AutoMapper::setupRuleMapLayers()
         } else {
             list->append(addPair);
         }
-    } // if (asTileLayer)
-    } // foreach (layer)
+    }
 
     QString error;
 
-    if (!mLayerRuleRegions)
+    if (!mRuleMap->ruleRegions())
         error += tr("No ruleRegions layer found!") + QLatin1Char('\n');
 
     if (!mLayerSet)
         error += tr("No set layers found!") + QLatin1Char('\n');
 
-    if (mLayerRuleSets.size() == 0)
+    if (mRuleMap->ruleSets().size() == 0)
         error += tr("No ruleSet layer found!") + QLatin1Char('\n');
 
-    // no need to check for mLayerRuleNotSets.size() == 0 here.
+    // no need to check for ruleNotSets().size() == 0 here.
     // these layers are not necessary.
 
     if (!error.isEmpty()) {
-        error = mRulePath + QLatin1Char('\n') + error;
+        error = mRuleMap->fileName() + QLatin1Char('\n') + error;
         mError += error;
         return false;
     }
@@ -246,12 +215,12 @@ bool AutoMapper::setupRuleMapLayers()
 bool AutoMapper::setupRulesUsedCheck()
 {
     QList<Tileset*> tilesetWork = mLayerSet->usedTilesets().toList();
-    foreach (TileLayer *tl, mLayerRuleSets)
+    foreach (TileLayer *tl, mRuleMap->ruleSets())
         foreach (Tileset *ts, tl->usedTilesets())
             if (ts->findSimilarTileset(tilesetWork))
                 return true;
 
-    foreach (TileLayer *tl, mLayerRuleNotSets)
+    foreach (TileLayer *tl, mRuleMap->ruleNotSets())
         foreach (Tileset *ts, tl->usedTilesets())
             if (ts->findSimilarTileset(tilesetWork))
                 return true;
@@ -259,80 +228,63 @@ bool AutoMapper::setupRulesUsedCheck()
     return false;
 }
 
-bool AutoMapper::setupRuleList()
+bool AutoMapper::prepareAutoMap()
 {
-    Q_ASSERT(mRules.isEmpty());
-    Q_ASSERT(mLayerRuleRegions);
-
-    for (int y = 1; y < mMapRules->height(); y++ ) {
-        for (int x = 1; x < mMapRules->width();  x++ ) {
-            if (!mLayerRuleRegions->cellAt(x, y).isEmpty()
-                    && !isPartOfExistingRule(QPoint(x, y))) {
-                QRegion rule = createRule(x, y);
-                mRules << rule;
-            }
-        }
-    }
-    return true;
-}
+    if (!setupMissingLayers())
+        return false;
 
-bool AutoMapper::isPartOfExistingRule(const QPoint &p) const
-{
-    foreach (const QRegion &region, mRules)
-        if (region.contains(p))
-            return true;
+    if (!setupTilesets(mRuleMap->map(), mMapWork))
+        return false;
 
-    return false;
+    return true;
 }
 
-QRegion AutoMapper::createRule(int x, int y) const
+/**
+ * Returns whether the properties of the tiles of \a tileset are already
+ * merged into those of the similar \a target tileset.
+ */
+static bool hasMergedProperties(const Tileset *tileset, const Tileset *target)
 {
-    Q_ASSERT(mLayerRuleRegions);
-    QRegion ret(x, y, 1, 1);
-    QList<QPoint> addPoints;
-    const Cell &match = mLayerRuleRegions->cellAt(x, y);
-    addPoints.append(QPoint(x, y));
-
-    while (!addPoints.empty()) {
-        const QPoint current = addPoints.takeFirst();
-        x = current.x();
-        y = current.y();
-        if (mLayerRuleRegions->contains(x - 1, y)
-            && mLayerRuleRegions->cellAt(x - 1, y) == match
-            && !ret.contains(QPoint(x - 1, y))) {
-            ret += QRegion(x - 1, y, 1, 1);
-            addPoints.append(QPoint(x - 1, y));
-        }
-        if (mLayerRuleRegions->contains(x + 1, y)
-            && mLayerRuleRegions->cellAt(x + 1, y) == match
-            && !ret.contains(QPoint(x + 1, y))) {
-            ret += QRegion(x + 1, y, 1, 1);
-            addPoints.append(QPoint(x + 1, y));
-        }
-        if (mLayerRuleRegions->contains(x, y - 1)
-            && mLayerRuleRegions->cellAt(x, y - 1) == match
-            && !ret.contains(QPoint(x, y - 1))) {
-            ret += QRegion(x, y - 1, 1, 1);
-            addPoints.append(QPoint(x, y - 1));
-        }
-        if (mLayerRuleRegions->contains(x, y + 1)
-            && mLayerRuleRegions->cellAt(x, y + 1) == match
-            && !ret.contains(QPoint(x, y + 1))) {
-            ret += QRegion(x, y + 1, 1, 1);
-            addPoints.append(QPoint(x, y + 1));
-        }
+    const int sharedTileCount = qMin(tileset->tileCount(),
+                                     target->tileCount());
+    for (int i = 0; i < sharedTileCount; ++i) {
+        const Tile *targetTile = target->tileAt(i);
+        Properties properties = targetTile->properties();
+        properties.merge(tileset->tileAt(i)->properties());
+        if (properties != targetTile->properties())
+            return false;
     }
-
-    return ret;
+    return true;
 }
 
-bool AutoMapper::prepareAutoMap()
+/**
+ * Returns the tileset of \a existingTilesets used instead of the rules
+ * tileset \a tileset, or 0 when it needs to be added to the map.
+ */
+static Tileset *targetTileset(Tileset *tileset,
+                              const QList<Tileset*> &existingTilesets)
 {
-    if (!setupMissingLayers())
-        return false;
+    if (existingTilesets.contains(tileset))
+        return tileset;
+    return tileset->findSimilarTileset(existingTilesets);
+}
 
-    if (!setupTilesets(mMapRules, mMapWork))
-        return false;
+bool AutoMapper::isPrepared() const
+{
+    foreach (const QString &name, mAddLayers)
+        if (mMapWork->indexOfLayer(name) == -1)
+            return false;
+
+    // The tilesets of the rules need to be in the map, or similar ones
+    // with the properties of the rule tiles
+    const QList<Tileset*> existingTilesets = mMapWork->tilesets();
+    foreach (Tileset *tileset, mRuleMap->map()->tilesets()) {
+        const Tileset *target = targetTileset(tileset, existingTilesets);
+        if (!target)
+            return false;
+        if (target != tileset && !hasMergedProperties(tileset, target))
+            return false;
+    }
 
     return true;
 }
@@ -340,6 +292,10 @@ bool AutoMapper::prepareAutoMap()
 bool AutoMapper::setupMissingLayers()
 {
     foreach (QString name, mAddLayers) {
+        // The layer may have been added by an earlier automapping
+        if (mMapWork->indexOfLayer(name) != -1)
+            continue;
+
         const int index = mMapWork->layerCount();
 
         TileLayer *t = new TileLayer(name, 0, 0,
@@ -412,49 +368,171 @@ void AutoMapper::layerRemove(int index)
 }
 
 /**
- * this cannot just be replaced by MapDocument::unifyTileset(Map),
- * because here mAddedTileset is modified
+ * The rules map is shared with other automappers, so its tilesets are not
+ * replaced. Instead, the similar tilesets of dst are looked up, and the
+ * tiles are translated when matching and copying the rules.
  */
 bool AutoMapper::setupTilesets(Map *src, Map *dst)
 {
-    QList<Tileset*> existingTilesets = dst->tilesets();
+    mTilesetTranslation.clear();
+    mRuleTilesets.clear();
 
-    // Add tilesets that are not yet part of dst map
-    foreach (Tileset *tileset, src->tilesets()) {
-        if (existingTilesets.contains(tileset))
-            continue;
+    const QList<Tileset*> existingTilesets = dst->tilesets();
+    QUndoStack *undoStack = mMapDocument->undoStack();
 
-        QUndoStack *undoStack = mMapDocument->undoStack();
+    foreach (Tileset *tileset, src->tilesets()) {
+        Tileset *target = targetTileset(tileset, existingTilesets);
 
-        Tileset *replacement = tileset->findSimilarTileset(existingTilesets);
-        if (!replacement) {
+        // Add tilesets that are not yet part of dst map
+        if (!target) {
             mAddedTilesets.append(tileset);
             undoStack->push(new AddTileset(mMapDocument, tileset));
-            continue;
+            target = tileset;
         }
 
-        // Merge the tile properties
-        const int sharedTileCount = qMin(tileset->tileCount(),
-                                         replacement->tileCount());
-        for (int i = 0; i < sharedTileCount; ++i) {
-            Tile *replacementTile = replacement->tileAt(i);
-            Properties properties = replacementTile->properties();
-            properties.merge(tileset->tileAt(i)->properties());
-
-            undoStack->push(new ChangeProperties(tr("Tile"),
-                                                 replacementTile,
-                                                 properties));
+        if (target == tileset)
+            continue;
+
+        // Merge the tile properties, where they are not merged yet
+        if (!hasMergedProperties(tileset, target)) {
+            const int sharedTileCount = qMin(tileset->tileCount(),
+                                             target->tileCount());
+            for (int i = 0; i < sharedTileCount; ++i) {
+                Tile *targetTile = target->tileAt(i);
+                Properties properties = targetTile->properties();
+                properties.merge(tileset->tileAt(i)->properties());
+
+                if (properties != targetTile->properties()) {
+                    undoStack->push(new ChangeProperties(tr("Tile"),
+                                                         targetTile,
+                                                         properties));
+                }
+            }
         }
-        src->replaceTileset(tileset, replacement);
 
-        TilesetManager *tilesetManager = TilesetManager::instance();
-        tilesetManager->addReference(replacement);
-        tilesetManager->removeReference(tileset);
+        mTilesetTranslation.insert(tileset, target);
+        mRuleTilesets.insert(target, tileset);
     }
+
     return true;
 }
 
+Cell AutoMapper::documentCell(const Cell &ruleCell) const
+{
+    if (ruleCell.isEmpty())
+        return ruleCell;
+
+    const Tileset *target =
+            mTilesetTranslation.value(ruleCell.tile->tileset());
+    if (!target)
+        return ruleCell;
+
+    Cell cell = ruleCell;
+    cell.tile = target->tileAt(ruleCell.tile->id());
+    return cell;
+}
+
+const RuleMatcher::TilesetMap *AutoMapper::ruleTilesets() const
+{
+    return mRuleTilesets.isEmpty() ? 0 : &mRuleTilesets;
+}
+
 void AutoMapper::autoMap(QRegion *where)
+{
+    if (!writesToSetLayer()) {
+        Matches matches;
+        findMatches(mLayerSet, where, &matches);
+        applyMatches(matches);
+        return;
+    }
+
+    // When the rules write to the set layer, a rule may match at places that
+    // did not match before the previous rules were applied. In that case the
+    // matches cannot be looked up in advance, and each position is checked
+    // right before the rule is applied there.
+    applyRadius(where);
+    deleteTiles(*where);
+
+    // Increase the given region where the next automapper should work.
+    // This needs to be done, so you can rely on the order of the rules at all
+    // locations
+    QRegion ret;
+
+    // Seeds the choice between the groups of rule layers
+    mRandomSeed = qrand();
+
+    const RuleMatcher *ruleMatcher = mRuleMap->ruleMatcher();
+    foreach (const QRect &rect, where->rects()) {
+        for (int rule = 0; rule < ruleMatcher->ruleCount(); ++rule) {
+            if (mLayerList.isEmpty())
+                break;
+
+            const QRect area = ruleMatcher->searchArea(rule, rect);
+            QRect applied;
+            for (int y = area.top(); y <= area.bottom(); ++y) {
+                for (int x = area.left(); x <= area.right(); ++x) {
+                    const QPoint offset(x, y);
+                    if (ruleMatcher->matches(rule, mLayerSet, offset,
+                                             ruleTilesets()))
+                        applied |= applyRuleAt(rule, offset);
+                }
+            }
+            ret = ret.united(applied);
+        }
+    }
+    *where = where->united(ret);
+}
+
+void AutoMapper::findMatches(const TileLayer *setLayer, QRegion *where,
+                             Matches *matches) const
+{
+    applyRadius(where);
+
+    matches->cleared = *where;
+    matches->rects = where->rects();
+    matches->offsets.clear();
+
+    // Increase the given region where the next automapper should work.
+    // This needs to be done, so you can rely on the order of the rules at all
+    // locations
+    QRegion ret;
+
+    const RuleMatcher *ruleMatcher = mRuleMap->ruleMatcher();
+    foreach (const QRect &rect, matches->rects) {
+        const QVector<QVector<QPoint> > offsets =
+                ruleMatcher->findMatches(setLayer, rect, ruleTilesets());
+        matches->offsets.append(offsets);
+
+        // Rules are not applied when there are no layers to copy
+        if (mLayerList.isEmpty())
+            continue;
+
+        for (int rule = 0; rule < offsets.size(); ++rule) {
+            const QRect rbr = ruleMatcher->ruleRegion(rule).boundingRect();
+            QRect applied;
+            foreach (const QPoint &offset, offsets.at(rule))
+                applied |= rbr.translated(offset);
+            ret = ret.united(applied);
+        }
+    }
+    *where = where->united(ret);
+}
+
+void AutoMapper::applyMatches(const Matches &matches, bool checkMatches)
+{
+    deleteTiles(matches.cleared);
+
+    // Seeds the choice between the groups of rule layers
+    mRandomSeed = qrand();
+
+    for (int i = 0; i < matches.rects.size(); ++i) {
+        const QVector<QVector<QPoint> > &offsets = matches.offsets.at(i);
+        for (int rule = 0; rule < offsets.size(); ++rule)
+            applyRule(rule, offsets.at(rule), checkMatches);
+    }
+}
+
+void AutoMapper::applyRadius(QRegion *where) const
 {
     // first resize the active area
     if (mAutoMappingRadius) {
@@ -467,28 +545,30 @@ void AutoMapper::autoMap(QRegion *where)
         }
         *where += n;
     }
+}
 
+void AutoMapper::deleteTiles(const QRegion &where)
+{
     // delete all the relevant area, if the property "DeleteTiles" is set
     if (mDeleteTiles) {
         QList<QList<QPair<TileLayer*, TileLayer*> >* >::const_iterator j;
         QList<QPair<TileLayer*, TileLayer*> >::const_iterator i;
         for (j = mLayerList.constBegin(); j != mLayerList.constEnd(); ++j)
             for (i = (*j)->constBegin(); i != (*j)->constEnd(); ++i)
-                clearRegion(i->second, *where);
+                clearRegion(i->second, where);
     }
+}
 
-    // Increase the given region where the next automapper should work.
-    // This needs to be done, so you can rely on the order of the rules at all
-    // locations
-    QRegion ret;
-    foreach (const QRect &rect, where->rects())
-        foreach (const QRegion &rule, mRules) {
-            // at the moment the parallel execution does not work yet
-            // TODO: make multithreading available!
-            // either by dividing the rules or the region to multiple threads
-            ret = ret.united(applyRule(rule, rect));
-        }
-    *where = where->united(ret);
+bool AutoMapper::writesToSetLayer() const
+{
+    QList<QList<QPair<TileLayer*, TileLayer*> >* >::const_iterator j;
+    QList<QPair<TileLayer*, TileLayer*> >::const_iterator i;
+    for (j = mLayerList.constBegin(); j != mLayerList.constEnd(); ++j)
+        for (i = (*j)->constBegin(); i != (*j)->constEnd(); ++i)
+            if (i->second == mLayerSet)
+                return true;
+
+    return false;
 }
 
 void AutoMapper::clearRegion(TileLayer *dstLayer, const QRegion &where)
@@ -502,219 +582,57 @@ void AutoMapper::clearRegion(TileLayer *dstLayer, const QRegion &where)
                         dstLayer->setCell(x, y, Cell());
 }
 
-static bool compareLayerTo(TileLayer *l1, QVector<TileLayer*> listYes,
-            QVector<TileLayer*> listNo, const QRegion &r1, QPoint offset);
+/**
+ * Returns a pseudo-random number for a match of \a rule at \a offset. Unlike
+ * qrand(), the result does not depend on the order in which the matches are
+ * applied.
+ */
+static uint matchRandom(uint seed, int rule, const QPoint &offset)
+{
+    uint h = seed;
+    h ^= uint(rule) * 0x9e3779b9u;
+    h ^= uint(offset.x()) * 0x85ebca6bu;
+    h ^= uint(offset.y()) * 0xc2b2ae35u;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
 
-QRect AutoMapper::applyRule(const QRegion &rule, const QRect &where)
+QRect AutoMapper::applyRule(int rule, const QVector<QPoint> &offsets,
+                            bool checkMatches)
 {
     QRect ret;
 
     if (mLayerList.isEmpty())
         return ret;
 
-    QRect rbr = rule.boundingRect();
-
-    // Since the rule itself is translated, we need to adjust the borders of the
-    // loops. Decrease the size at all sides by one: There must be at least one
-    // tile overlap to the rule.
-    const int min_x = where.left() - rbr.left() - rbr.width() + 1 ;
-    const int min_y = where.top() - rbr.top() - rbr.height() + 1;
-
-    const int max_x = where.right() - rbr.left() + rbr.width() - 1;
-    const int max_y = where.bottom() - rbr.top() + rbr.height() - 1;
-
-    for (int y = min_y; y <= max_y; y++)
-        for (int x = min_x; x <= max_x; x++)
-            if (compareLayerTo(mLayerSet, mLayerRuleSets,
-                               mLayerRuleNotSets, rule, QPoint(x, y))) {
-                int r = 0;
-                // choose by chance which group of rule_layers should be used:
-                if (mLayerList.size()>1)
-                    r = qrand() % mLayerList.size();
-                copyMapRegion(rule, QPoint(x, y), *mLayerList.at(r));
-                ret = ret.united(rbr.translated(QPoint(x, y)));
-            }
+    const RuleMatcher *ruleMatcher = mRuleMap->ruleMatcher();
 
-    return ret;
-}
+    foreach (const QPoint &offset, offsets) {
+        if (checkMatches && !ruleMatcher->matches(rule, mLayerSet, offset,
+                                                  ruleTilesets()))
+            continue;
 
-/**
- * Returns a list of all cells which can be found within all tile layers
- * within the given region.
- */
-static QVector<Cell> cellsInRegion(QVector<TileLayer*> list, const QRegion &r)
-{
-    QVector<Cell> cells;
-    foreach (TileLayer *l, list) {
-        foreach (const QRect &rect, r.rects()) {
-            for (int x = rect.left(); x <= rect.right(); x++) {
-                for (int y = rect.top(); y <= rect.bottom(); y++) {
-                    const Cell &cell = l->cellAt(x, y);
-                    if (!cells.contains(cell))
-                        cells.append(cell);
-                }
-            }
-        }
+        ret |= applyRuleAt(rule, offset);
     }
-    return cells;
+
+    return ret;
 }
 
-/**
- * This function is one of the core functions for understanding the
- * automapping.
- * In this function a certain region (of the set layer) is compared to
- * several other layers (ruleSet and ruleNotSet).
- * This comparision will determine if a rule of automapping matches,
- * so if this rule is applied at this region given
- * by a QRegion and Offset given by a QPoint.
- *
- * This compares the tile layer l1 (set layer) to several others given
- * in the QList listYes (ruleSet) and OList listNo (ruleNotSet).
- * The tile layer l1 is examined at QRegion r1 + offset
- * The tile layers within listYes and listNo are examined at QRegion r1.
- *
- * Basically all matches between l1 and a layer of listYes are considered
- * good, while all matches between l1 and listNo are considered bad and lead to
- * canceling the comparison, returning false.
- *
- * The comparison is done for each position within the QRegion r1.
- * If all positions of the region are considered "good" return true.
- *
- * Now there are several cases to distinguish:
- * - l1 is 0:
- *      obviously there should be no automapping.
- *      So here no rule should be applied. return false
- * - l1 is not 0:
- *      - both listYes and listNo are empty:
- *          should not happen, because with that configuration, absolutly
- *          no condition is given.
- *          return false, assuming this is an errornous rule being applied
- *
- *      - both listYes and listNo are not empty:
- *          When comparing a tile at a certain position of TileLayer l1
- *          to all available tiles in listYes, there must be at least
- *          one layer, in which there is a match of tiles of l1 and listYes
- *          to consider this position good.
- *          In listNo there must not be a match to consider this position
- *          good.
- *          If there are no tiles within all available tiles within all layers
- *          of one list, all tiles in l1 are considered good,
- *          while inspecting this list.
- *          All available tiles are all tiles within the whole rule region in
- *          all tile layers of the list.
- *
- *      - either of both lists is empty
- *          When comparing a certain position of TileLayer l1 to all Tiles
- *          at the corresponding position this can happen:
- *          A tile of l1 matches a tile of a layer in the list. Then this
- *          is considered as good, if the layer is from the listYes.
- *          Otherwise it is considered bad.
- *
- *          Exception, when having only the listYes:
- *          if at the examined position there are no tiles within all Layers
- *          of the listYes, all tiles except all used tiles within
- *          the layers of that list are considered good.
- *
- *          This exception was added to have a better functionality
- *          (need of less layers.)
- *          It was not added to the case, when having only listNo layers to
- *          avoid total symmetrie between those lists.
- *
- * If all positions are considered good, return true.
- * return false otherwise.
- *
- * @return bool, if the tile layer matches the given list of layers.
- */
-static bool compareLayerTo(TileLayer *l1, QVector<TileLayer*> listYes,
-            QVector<TileLayer*> listNo, const QRegion &r1, QPoint offset)
+QRect AutoMapper::applyRuleAt(int rule, const QPoint &offset)
 {
-    if (listYes.size() == 0 && listNo.size() == 0)
-        return false;
-
-    QVector<Cell> cells;
-    if (listYes.size() == 0)
-        cells = cellsInRegion(listNo, r1);
-    if (listNo.size() == 0)
-        cells = cellsInRegion(listYes, r1);
-
-    foreach (QRect rect, r1.rects()) {
-        for (int x = rect.left(); x <= rect.right(); x++) {
-            for (int y = rect.top(); y <= rect.bottom(); y++) {
-                // this is only used in the case where only one list has layers
-                // it is needed for the exception mentioned above
-                bool ruleDefinedListYes = false;
-
-                bool matchListYes = false;
-                bool matchListNo  = false;
-
-                if (!l1->contains(x + offset.x(), y + offset.y()))
-                    return false;
-
-                const Cell &c1 = l1->cellAt(x + offset.x(), y + offset.y());
-
-                // when there is no tile in l1 (= set layer),
-                // there should be no rule at all
-                if (c1.isEmpty())
-                    return false;
-
-                // ruleDefined will be set when there is a tile in at least
-                // one layer. if there is a tile in at least one layer, only
-                // the given tiles in the different listYes layers are valid.
-                // if there is given no tile at all in the listYes layers,
-                // consider all tiles valid.
-
-                foreach (TileLayer *l2, listYes) {
+    const QRegion &region = mRuleMap->ruleMatcher()->ruleRegion(rule);
 
-                    if (!l2->contains(x, y))
-                        return false;
+    int r = 0;
+    // choose by chance which group of rule_layers should be used:
+    if (mLayerList.size() > 1)
+        r = matchRandom(mRandomSeed, rule, offset) % mLayerList.size();
+    copyMapRegion(region, offset, *mLayerList.at(r));
 
-                    const Cell &c2 = l2->cellAt(x, y);
-                    if (!c2.isEmpty())
-                        ruleDefinedListYes = true;
-
-                    if (!c2.isEmpty() && c1 == c2)
-                        matchListYes = true;
-                }
-                foreach (TileLayer *l2, listNo) {
-
-                    if (!l2->contains(x, y))
-                        return false;
-
-                    const Cell &c2 = l2->cellAt(x, y);
-
-                    if (!c2.isEmpty() && c1 == c2)
-                        matchListNo = true;
-                }
-
-                // when there are only layers in the listNo
-                // check only if these layers are unmatched
-                // no need to check explicitly the exception in this case.
-                if (listYes.size() == 0 ) {
-                    if (matchListNo)
-                        return false;
-                    else
-                        continue;
-                }
-                // when there are only layers in the listYes
-                // check if these layers are matched, or if the exception works
-                if (listNo.size() == 0 ) {
-                    if (matchListYes)
-                        continue;
-                    if (!ruleDefinedListYes && !cells.contains(c1))
-                        continue;
-                    return false;
-                }
-
-                // there are layers in both lists:
-                // no need to consider ruleDefinedListXXX
-                if ((matchListYes || !ruleDefinedListYes) && !matchListNo)
-                    continue;
-                else
-                    return false;
-            }
-        }
-    }
-    return true;
+    return region.boundingRect().translated(offset);
 }
 
 void AutoMapper::copyMapRegion(const QRegion &region, QPoint offset,
@@ -738,7 +656,8 @@ void AutoMapper::copyRegion(TileLayer *srcLayer, int srcX, int srcY,
 {
     for (int x = 0; x < width; x++) {
         for (int y = 0; y < height; y++) {
-            const Cell &cell = srcLayer->cellAt(srcX + x, srcY + y);
+            const Cell cell = documentCell(srcLayer->cellAt(srcX + x,
+                                                            srcY + y));
             if (!cell.isEmpty()) {
                 // this is without graphics update, it's done afterwards for all
                 dstLayer->setCell(dstX + x, dstY + y, cell);
@@ -771,18 +690,15 @@ void AutoMapper::cleanUpRulesMap()
 {
     cleanTilesets();
 
-    // mMapRules can be empty, when in prepareLoad the very first stages fail.
-    if (!mMapRules)
+    // mRuleMap can be empty, when in prepareLoad the very first stages fail.
+    if (!mRuleMap)
         return;
 
-    TilesetManager *tilesetManager = TilesetManager::instance();
-    tilesetManager->removeReferences(mMapRules->tilesets());
-
-    delete mMapRules;
-    mMapRules = 0;
+    // do not delete mRuleMap, it is owned by the rule map cache, which
+    // shares it with the automappers of other maps
+    mRuleMap = 0;
 
     cleanUpRuleMapLayers();
-    mRules.clear();
 }
 
 void AutoMapper::cleanUpRuleMapLayers()
@@ -803,89 +719,137 @@ void AutoMapper::cleanUpRuleMapLayers()
         delete (*j);
 
     mLayerList.clear();
-    // do not delete mLayerRuleRegions, it is owned by the map mapWork, which
-    // cares for it
-    mLayerRuleRegions = 0;
-    mLayerRuleSets.clear();
-    mLayerRuleNotSets.clear();
 }
 
-AutoMapperWrapper::AutoMapperWrapper(MapDocument *mapDocument, QVector<AutoMapper*> autoMapper, QRegion *where)
+AutoMapperWrapper::AutoMapperWrapper(
+        MapDocument *mapDocument,
+        QVector<AutoMapper*> autoMapper,
+        QRegion *where,
+        const QVector<AutoMapper::Matches> *matches)
+    : mSetLayer(autoMapper.isEmpty() ? 0 : autoMapper.first()->setLayer())
+    , mMergeable(false)
 {
     mMapDocument = mapDocument;
     Map *map = mMapDocument->map();
 
     QSet<QString> touchedlayers;
     foreach (AutoMapper *a, autoMapper) {
-        a->prepareAutoMap();
+        if (!matches)
+            a->prepareAutoMap();
         touchedlayers|= a->getTouchedLayers();
     }
+
+    // The clones share their cells with the layers until these are changed,
+    // so they are cheap and make finding the changed cells fast
+    QStringList layerNames;
+    QVector<TileLayer*> layersBefore;
     foreach (const QString &layerName, touchedlayers) {
         const int layerindex = map->indexOfLayer(layerName);
         Q_ASSERT(layerindex != -1);
-        mLayersBefore << map->layerAt(layerindex)->clone();
+        if (TileLayer *tileLayer = map->layerAt(layerindex)->asTileLayer()) {
+            layerNames << layerName;
+            layersBefore << static_cast<TileLayer*>(tileLayer->clone());
+        }
     }
 
-    foreach (AutoMapper *a, autoMapper) {
-        a->autoMap(where);
+    for (int i = 0; i < autoMapper.size(); ++i) {
+        if (matches)
+            autoMapper.at(i)->applyMatches(matches->at(i), true);
+        else
+            autoMapper.at(i)->autoMap(where);
     }
 
-    foreach (const QString &layerName, touchedlayers) {
-        const int layerindex = map->indexOfLayer(layerName);
+    for (int i = 0; i < layerNames.size(); ++i) {
+        const int layerindex = map->indexOfLayer(layerNames.at(i));
         // layerindex exists, because AutoMapper is still alive, dont check
         Q_ASSERT(layerindex != -1);
-        mLayersAfter << map->layerAt(layerindex)->clone();
-    }
-    foreach (AutoMapper *a, autoMapper) {
-        a->cleanAll();
+        mChanges.addLayer(layerNames.at(i), *layersBefore.at(i),
+                          *map->layerAt(layerindex)->asTileLayer());
     }
-}
+    qDeleteAll(layersBefore);
 
-AutoMapperWrapper::~AutoMapperWrapper()
-{
-    QVector<Layer*>::iterator i;
-    for (i = mLayersAfter.begin(); i != mLayersAfter.end(); ++i)
-        delete *i;
-    for (i = mLayersBefore.begin(); i != mLayersBefore.end(); ++i)
-        delete *i;
+    // Live automapping leaves the added tilesets in place, since removing
+    // them would add an undo command for each pass
+    if (!matches) {
+        foreach (AutoMapper *a, autoMapper)
+            a->cleanAll();
+    }
 }
 
 void AutoMapperWrapper::undo()
 {
-    Map *map = mMapDocument->map();
-    QVector<Layer*>::iterator i;
-    for (i = mLayersBefore.begin(); i != mLayersBefore.end(); ++i) {
-        const int layerindex = map->indexOfLayer((*i)->name());
-        if (layerindex != -1)
-            //just put a clone, so the saved layers wont be altered by others.
-            delete swapLayer(layerindex, (*i)->clone());
-    }
+    mMapDocument->emitRegionChanged(mChanges.apply(mMapDocument->map(),
+                                                   false));
 }
+
 void AutoMapperWrapper::redo()
 {
-    Map *map = mMapDocument->map();
-    QVector<Layer*>::iterator i;
-    for (i = mLayersAfter.begin(); i != mLayersAfter.end(); ++i) {
-        const int layerindex = (map->indexOfLayer((*i)->name()));
-        if (layerindex != -1)
-            // just put a clone, so the saved layers wont be altered by others.
-            delete swapLayer(layerindex, (*i)->clone());
-    }
+    mMapDocument->emitRegionChanged(mChanges.apply(mMapDocument->map(),
+                                                   true));
 }
 
-Layer *AutoMapperWrapper::swapLayer(int layerIndex, Layer *layer)
+namespace Tiled {
+namespace Internal {
+
+/**
+ * Finds the matches of the rules of a list of automappers in the background,
+ * against a clone of the set layer.
+ */
+class LiveAutoMapJob : public QRunnable
 {
-    const int currentIndex = mMapDocument->currentLayerIndex();
+public:
+    LiveAutoMapJob(const QVector<AutoMapper*> &autoMappers,
+                   TileLayer *setLayer, const QRegion &where,
+                   QObject *receiver)
+        : mAutoMappers(autoMappers)
+        , mSetLayer(setLayer)
+        , mRequested(where)
+        , mWhere(where)
+        , mReceiver(receiver)
+    {
+        setAutoDelete(false);
+    }
 
-    LayerModel *layerModel = mMapDocument->layerModel();
-    Layer *replaced = layerModel->takeLayerAt(layerIndex);
-    layerModel->insertLayer(layerIndex, layer);
+    ~LiveAutoMapJob() { delete mSetLayer; }
 
-    if (layerIndex == currentIndex)
-        mMapDocument->setCurrentLayerIndex(layerIndex);
+    void run()
+    {
+        foreach (const AutoMapper *autoMapper, mAutoMappers) {
+            AutoMapper::Matches matches;
+            autoMapper->findMatches(mSetLayer, &mWhere, &matches);
+            mMatches.append(matches);
+        }
 
-    return replaced;
-}
+        QMetaObject::invokeMethod(mReceiver, "liveAutoMapFinished",
+                                  Qt::QueuedConnection);
+        mFinished.release();
+    }
+
+    void waitForFinished()
+    {
+        mFinished.acquire();
+        mFinished.release();
+    }
+
+    const QRegion &requested() const { return mRequested; }
+    QRegion *where() { return &mWhere; }
+    const QVector<AutoMapper::Matches> &matches() const { return mMatches; }
+
+private:
+    QVector<AutoMapper*> mAutoMappers;
+    TileLayer *mSetLayer;
+    QRegion mRequested;
+    QRegion mWhere;
+    QObject *mReceiver;
+    QVector<AutoMapper::Matches> mMatches;
+    QSemaphore mFinished;
+};
+
+} // namespace Internal
+} // namespace Tiled
+
+// Edits are collected for this many milliseconds before they are automapped
+static const int LiveAutoMapDelay = 30;
 
 AutomaticMappingManager *AutomaticMappingManager::mInstance = 0;
 
@@ -894,6 +858,9 @@ AutomaticMappingManager::AutomaticMappingManager(QObject *parent)
     , mMapDocument(0)
     , mLoaded(false)
     , mWatcher(new QFileSystemWatcher(this))
+    , mLiveJob(0)
+    , mLiveJobIndex(-1)
+    , mLiveJobOutdated(false)
 {
     connect(mWatcher, SIGNAL(fileChanged(QString)),
             this, SLOT(fileChanged(QString)));
@@ -901,6 +868,10 @@ AutomaticMappingManager::AutomaticMappingManager(QObject *parent)
     mChangedFilesTimer.setSingleShot(true);
     connect(&mChangedFilesTimer, SIGNAL(timeout()),
             this, SLOT(fileChangedTimeout()));
+    mLiveTimer.setInterval(LiveAutoMapDelay);
+    mLiveTimer.setSingleShot(true);
+    connect(&mLiveTimer, SIGNAL(timeout()),
+            this, SLOT(startLiveAutoMap()));
     // this should be stored in the project file later on.
     // now just default to the value we always had.
     mSetLayer = QLatin1String("set");
@@ -949,12 +920,9 @@ void AutomaticMappingManager::automap(QRegion where, Layer *l)
     if (l->name() != mSetLayer)
         return;
 
-    if (!mLoaded) {
-        const QString mapPath = QFileInfo(mMapDocument->fileName()).path();
-        const QString rulesFileName = mapPath + QLatin1String("/rules.txt");
-        if (loadFile(rulesFileName))
-            mLoaded = true;
-    }
+    // The automappers may not be used while matching in the background
+    cancelLiveAutoMap();
+    loadRules();
 
     Map *map = mMapDocument->map();
 
@@ -975,28 +943,157 @@ void AutomaticMappingManager::automap(QRegion where, Layer *l)
     mMapDocument->setCurrentLayerIndex(map->indexOfLayer(layer));
 }
 
+void AutomaticMappingManager::queueAutoMap(QRegion where, Layer *layer)
+{
+    if (!mMapDocument || layer->name() != mSetLayer)
+        return;
+
+    mLiveRegion += where;
+
+    // Not restarted on further edits, so the map updates while painting
+    if (!mLiveTimer.isActive())
+        mLiveTimer.start();
+}
+
+void AutomaticMappingManager::startLiveAutoMap()
+{
+    // Started again once the running one has finished
+    if (!mMapDocument || mLiveJob || mLiveRegion.isEmpty())
+        return;
+
+    loadRules();
+
+    Map *map = mMapDocument->map();
+    const int setLayerIndex = map->indexOfLayer(mSetLayer);
+    TileLayer *setLayer = setLayerIndex != -1
+            ? map->layerAt(setLayerIndex)->asTileLayer() : 0;
+    if (!setLayer)
+        return;
+
+    const QRegion where = mLiveRegion;
+    mLiveRegion = QRegion();
+
+    // When the rules write to the set layer, matching needs the map itself
+    foreach (AutoMapper *autoMapper, mAutoMappers) {
+        if (autoMapper->writesToSetLayer()) {
+            automap(where, setLayer);
+            return;
+        }
+    }
+
+    // The map only needs to be set up the first time, or after that was
+    // undone, in which case it becomes a single command of its own. The
+    // automappers are always prepared, since the tilesets may have changed.
+    bool prepared = true;
+    foreach (AutoMapper *autoMapper, mAutoMappers)
+        prepared = prepared && autoMapper->isPrepared();
+
+    QUndoStack *undoStack = mMapDocument->undoStack();
+    if (!prepared)
+        undoStack->beginMacro(tr("Apply AutoMap rules"));
+    foreach (AutoMapper *autoMapper, mAutoMappers)
+        autoMapper->prepareAutoMap();
+    if (!prepared)
+        undoStack->endMacro();
+
+    // The clone shares its cells with the set layer, so it is cheap and is
+    // not affected by further painting
+    TileLayer *snapshot = static_cast<TileLayer*>(setLayer->clone());
+
+    mLiveJob = new LiveAutoMapJob(mAutoMappers, snapshot, where, this);
+    mLiveJobIndex = undoStack->index();
+    mLiveJobOutdated = false;
+    QThreadPool::globalInstance()->start(mLiveJob);
+}
+
+void AutomaticMappingManager::liveAutoMapFinished()
+{
+    // The job may have been cancelled in the meantime
+    if (!mLiveJob)
+        return;
+
+    LiveAutoMapJob *job = mLiveJob;
+    mLiveJob = 0;
+    job->waitForFinished();
+
+    // The command on top is not the one the matches were found for, so the
+    // region is automapped again
+    if (mLiveJobOutdated) {
+        mLiveRegion += job->requested();
+        delete job;
+        if (!mLiveTimer.isActive())
+            mLiveTimer.start();
+        return;
+    }
+
+    // Merges into the paint command when it was the last command, so the
+    // automapping is undone along with the painting that caused it
+    AutoMapperWrapper *aw = new AutoMapperWrapper(mMapDocument, mAutoMappers,
+                                                  job->where(),
+                                                  &job->matches());
+    aw->setText(tr("Apply AutoMap rules"));
+    aw->setMergeable(true);
+    mMapDocument->undoStack()->push(aw);
+    delete job;
+
+    // The edits made in the meantime are automapped next
+    if (!mLiveRegion.isEmpty() && !mLiveTimer.isActive())
+        mLiveTimer.start();
+}
+
+void AutomaticMappingManager::undoIndexChanged(int index)
+{
+    // Undoing and then pushing a new command passes through another index
+    // first, so the flag stays set even when the index ends up the same
+    if (mLiveJob && index != mLiveJobIndex)
+        mLiveJobOutdated = true;
+}
+
+void AutomaticMappingManager::loadRules()
+{
+    if (!mLoaded) {
+        // Left over when loading the rules failed before
+        qDeleteAll(mAutoMappers);
+        mAutoMappers.clear();
+
+        const QString mapPath = QFileInfo(mMapDocument->fileName()).path();
+        const QString rulesFileName = mapPath + QLatin1String("/rules.txt");
+        if (loadFile(rulesFileName))
+            mLoaded = true;
+    }
+}
+
+void AutomaticMappingManager::cancelLiveAutoMap()
+{
+    if (!mLiveJob)
+        return;
+
+    mLiveJob->waitForFinished();
+    delete mLiveJob;
+    mLiveJob = 0;
+}
+
 bool AutomaticMappingManager::loadFile(const QString &filePath)
 {
     mError.clear();
     bool ret = true;
     const QString absPath = QFileInfo(filePath).path();
-    QFile rulesFile(filePath);
 
-    if (!rulesFile.exists()) {
+    if (!QFileInfo(filePath).exists()) {
         mError += tr("No rules file found at:\n%1").arg(filePath)
                   + QLatin1Char('\n');
         return false;
     }
-    if (!rulesFile.open(QIODevice::ReadOnly)) {
+
+    QStringList lines;
+    if (!mRuleMapCache.readRulesFile(filePath, &lines)) {
         mError += tr("Error opening rules file:\n%1").arg(filePath)
                   + QLatin1Char('\n');
         return false;
     }
+    watchFile(filePath);
 
-    QTextStream in(&rulesFile);
-    QString line = in.readLine();
-
-    for (; !line.isNull(); line = in.readLine()) {
+    foreach (const QString &line, lines) {
         QString rulePath = line.trimmed();
         if (rulePath.isEmpty()
                 || rulePath.startsWith(QLatin1Char('#'))
@@ -1007,28 +1104,26 @@ bool AutomaticMappingManager::loadFile(const QString &filePath)
             rulePath = absPath + QLatin1Char('/') + rulePath;
 
         if (!QFileInfo(rulePath).exists()) {
-            mError += tr("File not found:\n%1").arg(rulePath) + QLatin1Char('\n');
+            mError += tr("File not found:\n%1").arg(rulePath)
+                      + QLatin1Char('\n');
             ret = false;
             continue;
         }
         if (rulePath.endsWith(QLatin1String(".tmx"), Qt::CaseInsensitive)){
-            TmxMapReader mapReader;
+            // Only read again when it was modified
+            RuleMap *ruleMap = mRuleMapCache.ruleMap(rulePath);
+            watchFile(rulePath);
 
-            Map *rules = mapReader.read(rulePath);
-
-            TilesetManager *tilesetManager = TilesetManager::instance();
-            tilesetManager->addReferences(rules->tilesets());
-
-            if (!rules) {
+            if (!ruleMap->map()) {
                 mError += tr("Opening rules map failed:\n%1").arg(
-                        mapReader.errorString()) + QLatin1Char('\n');
+                        ruleMap->errorString()) + QLatin1Char('\n');
                 ret = false;
                 continue;
             }
             AutoMapper *autoMapper;
             autoMapper = new AutoMapper(mMapDocument, mSetLayer);
 
-            if (autoMapper->prepareLoad(rules, rulePath))
+            if (autoMapper->prepareLoad(ruleMap))
                 mAutoMappers.append(autoMapper);
             else
                 delete autoMapper;
@@ -1041,23 +1136,38 @@ bool AutomaticMappingManager::loadFile(const QString &filePath)
     return ret;
 }
 
+void AutomaticMappingManager::watchFile(const QString &fileName)
+{
+    if (!mWatcher->files().contains(fileName))
+        mWatcher->addPath(fileName);
+}
+
 void AutomaticMappingManager::setMapDocument(MapDocument *mapDocument)
 {
     cleanUp();
-    if (mMapDocument)
+    if (mMapDocument) {
         mMapDocument->disconnect(this);
+        mMapDocument->undoStack()->disconnect(this);
+    }
 
     mMapDocument = mapDocument;
 
-    if (mMapDocument)
+    if (mMapDocument) {
         connect(mMapDocument, SIGNAL(regionEdited(QRegion,Layer*)),
-                this, SLOT(automap(QRegion,Layer*)));
+                this, SLOT(queueAutoMap(QRegion,Layer*)));
+        connect(mMapDocument->undoStack(), SIGNAL(indexChanged(int)),
+                this, SLOT(undoIndexChanged(int)));
+    }
     mLoaded = false;
 
 }
 
 void AutomaticMappingManager::cleanUp()
 {
+    cancelLiveAutoMap();
+    mLiveTimer.stop();
+    mLiveRegion = QRegion();
+
     foreach (AutoMapper *autoMapper, mAutoMappers) {
         delete autoMapper;
     }
@@ -1078,27 +1188,19 @@ void AutomaticMappingManager::fileChanged(const QString &path)
 
 void AutomaticMappingManager::fileChangedTimeout()
 {
-    for (int i = 0; i != mAutoMappers.size(); i++) {
-        AutoMapper *am = mAutoMappers.at(i);
-        QString fileName = am->ruleSetPath();
-        if (mChangedFiles.contains(fileName)) {
-            delete am;
-
-            TmxMapReader mapReader;
-            Map *rules = mapReader.read(fileName);
-            if (!rules) {
-                mAutoMappers.remove(i);
-                continue;
-            }
+    cancelLiveAutoMap();
 
-            AutoMapper *autoMapper = new AutoMapper(mMapDocument, mSetLayer);
-            if (autoMapper->prepareLoad(rules, fileName)) {
-                mAutoMappers.replace(i, autoMapper);
-            } else {
-                delete autoMapper;
-                mAutoMappers.remove(i);
-            }
-        }
-    }
+    // The automappers may be using the rules maps that changed
+    qDeleteAll(mAutoMappers);
+    mAutoMappers.clear();
+    mLoaded = false;
+
+    foreach (const QString &fileName, mChangedFiles)
+        mRuleMapCache.remove(fileName);
     mChangedFiles.clear();
+
+    // Reads the changed files again, while the rules compile in the
+    // background until they are needed
+    if (mMapDocument)
+        loadRules();
 }
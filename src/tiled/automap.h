@@ -21,6 +21,11 @@
 #ifndef AUTOMAP_H
 #define AUTOMAP_H
 
+#include "automappingchanges.h"
+#include "rulemapcache.h"
+#include "undocommands.h"
+
+#include <QHash>
 #include <QList>
 #include <QPair>
 #include <QRegion>
@@ -43,6 +48,7 @@ class Tileset;
 
 namespace Internal {
 
+class LiveAutoMapJob;
 class MapDocument;
 
 /**
@@ -68,13 +74,15 @@ public:
 
     MapDocument *mapDocument() const { return mMapDocument; }
 
-    QString ruleSetPath() const { return mRulePath; }
+    QString ruleSetPath() const
+    { return mRuleMap ? mRuleMap->fileName() : QString(); }
 
     /**
      * This sets up some internal data structures, which do not change,
-     * so it is needed only when loading the rules map.
+     * so it is needed only when loading the rules map. The \a ruleMap is
+     * not owned by the automapper.
      */
-    bool prepareLoad(Map *rules, const QString &rulePath);
+    bool prepareLoad(RuleMap *ruleMap);
 
     /**
      * Call prepareLoad first! Returns a set of strings describing the layers,
@@ -91,11 +99,67 @@ public:
      */
     bool prepareAutoMap();
 
+    /**
+     * Returns whether prepareAutoMap() has nothing left to set up, because
+     * the layers and tilesets needed by the rules are already in the map.
+     */
+    bool isPrepared() const;
+
+    /**
+     * Returns whether any of the rules writes to the set layer.
+     */
+    bool writesToSetLayer() const;
+
+    /**
+     * Returns the layer of the working map the rules are matched against.
+     */
+    TileLayer *setLayer() const { return mLayerSet; }
+
     /**
      * Here is done all the automapping.
      */
     void autoMap(QRegion *where);
 
+    /**
+     * The places at which the rules matched, as found by findMatches().
+     */
+    struct Matches
+    {
+        QRegion cleared;
+        QVector<QRect> rects;
+        QVector<QVector<QVector<QPoint> > > offsets; // For each rect and rule
+    };
+
+    /**
+     * Finds where the rules match \a setLayer within \a where, without
+     * changing the map. Like autoMap(), this increases \a where by the area
+     * in which the rules got applied.
+     *
+     * Only reads \a setLayer and the compiled rules, so it can be called
+     * from another thread on a clone of the set layer. Can not be used when
+     * the rules write to the set layer.
+     */
+    void findMatches(const TileLayer *setLayer, QRegion *where,
+                     Matches *matches) const;
+
+    /**
+     * Applies the \a matches found by findMatches() to the map. When
+     * \a checkMatches is set, the rules are only applied where they still
+     * match, for matches found against an older copy of the set layer.
+     */
+    void applyMatches(const Matches &matches, bool checkMatches = false);
+
+    /**
+     * Increases \a where by mAutoMappingRadius.
+     */
+    void applyRadius(QRegion *where) const;
+
+    /**
+     * Clears \a where in the layers touched by the rules, if the property
+     * "DeleteTiles" is set.
+     */
+    void deleteTiles(const QRegion &where);
+
     /**
      * This cleans all datastructures, which are setup via prepareAutoMap,
      * so the auto mapper becomes ready for its next automatic mapping.
@@ -122,12 +186,10 @@ private:
      * Calls all setup-functions in the right order needed for processing
      * a new rules file.
      *
-     * param rulePath is only used to have better error message descriptions.
-     *
      * @return returns true when anything is ok, false when errors occured.
      *        (in that case will be a msg box anyway)
      */
-    bool setupRulesMap(Map *rules, const QString &rulePath);
+    bool setupRulesMap(RuleMap *ruleMap);
 
     void cleanUpRulesMap();
 
@@ -138,16 +200,9 @@ private:
      */
     bool setupMapDocumentLayers();
 
-    /**
-     * Searches the rules layer for regions and stores these in \a rules.
-     * @return returns true when anything is ok, false when errors occured.
-     *        (in that case will be a msg box anyway)
-     */
-    bool setupRuleList();
-
     /**
      * Sets up the layers in the rules map, which are used for automapping.
-     * The layers are detected and put in the internal data structures
+     * The layers to copy to mMapWork are put in the internal data structures
      * @return returns true when anything is ok, false when errors occured.
      *        (in that case will be a msg box anyway)
      */
@@ -160,6 +215,18 @@ private:
      */
     bool setupTilesets(Map *src, Map *dst);
 
+    /**
+     * Returns \a ruleCell with the tile of the rules map replaced by the one
+     * of the similar tileset in mMapWork.
+     */
+    Cell documentCell(const Cell &ruleCell) const;
+
+    /**
+     * Returns the translation of the tilesets of mMapWork to those of the
+     * rules map, or 0 when the tiles do not need to be translated.
+     */
+    const RuleMatcher::TilesetMap *ruleTilesets() const;
+
     /**
      * sets all tiles to 0 in the specified rectangle of the given tile layer.
      */
@@ -192,29 +259,22 @@ private:
             const QList< QPair<TileLayer*, TileLayer*> > &LayerTranslation);
 
     /**
-     * This goes through all the positions of the mMapWork and checks if
-     * there fits the rule given by the region in mMapRuleSet.
-     * if there is a match all Layers are copied to mMapWork.
-     * @param rule: the region which should be compared to all positions
-     *              of mMapWork
+     * This applies the rule at the given \a offsets, copying all Layers to
+     * mMapWork.
+     * @param rule: the index of the rule in the rule matcher of mRuleMap
+     * @param offsets: the positions at which the rule should be applied
+     * @param checkMatches: whether to check if the rule fits mMapWork at
+     *                      each offset first, rather than assuming it does
      * @return where: an rectangle where the rule actually got applied
      */
-    QRect applyRule(const QRegion &rule, const QRect &where);
-
-    /**
-     * This returns whether the given point \a p is part of an existing rule.
-     */
-    bool isPartOfExistingRule(const QPoint &p) const;
+    QRect applyRule(int rule, const QVector<QPoint> &offsets,
+                    bool checkMatches);
 
     /**
-     * This creates a rule from a given point.
-     * So it will be checked, which regions are coherent to this point
-     * and all these regions will be treated as a new rule,
-     * which will be returned. To check what is coherent, a
-     * breadth first search will be performed, whereas each Tile is a node,
-     * and the 4 coherent tiles are connected to this node.
+     * Applies the rule at the given \a offset, assuming it matches there.
+     * Returns the rectangle the rule got applied to.
      */
-    QRegion createRule(int x, int y) const;
+    QRect applyRuleAt(int rule, const QPoint &offset);
 
     /**
      * This searches \a map for a layer with the given \a name. Returns that
@@ -253,9 +313,10 @@ private:
     Map *mMapWork;
 
     /**
-     * map containing the rules, usually different than mMapWork
+     * map containing the rules, usually different than mMapWork, along with
+     * its compiled rules. It is owned by the rule map cache.
      */
-    Map *mMapRules;
+    RuleMap *mRuleMap;
 
     /**
      * This contains all added tilesets as pointers.
@@ -268,22 +329,17 @@ private:
     QVector<Tileset*> mAddedTilesets;
 
     /**
-     * description see: mAddedTilesets, just described by Strings
+     * The tilesets of mMapWork used instead of the similar tilesets of the
+     * rules map, and the other way around. Set up by setupTilesets(), since
+     * the rules map itself is not changed.
      */
-    QList<QString> mAddedTileLayers;
+    QHash<Tileset*, Tileset*> mTilesetTranslation;
+    RuleMatcher::TilesetMap mRuleTilesets;
 
     /**
-     * RuleRegions is the layer where the regions are defined.
-     */
-    TileLayer *mLayerRuleRegions;
-
-    /**
-     * mLayerSet is compared at each tile if it matches any Tile within the
-     * mLayerRuleSets list
-     * it must not match with any Tile to mLayerRuleNotSets
+     * description see: mAddedTilesets, just described by Strings
      */
-    QVector<TileLayer*> mLayerRuleSets;
-    QVector<TileLayer*> mLayerRuleNotSets;
+    QList<QString> mAddedTileLayers;
 
     /**
      * This stores the name of the layer, which is used in the working map to
@@ -299,25 +355,14 @@ private:
      */
     TileLayer *mLayerSet;
 
-    /**
-     * List of Regions in mMapRules to know where the rules are
-     */
-    QList<QRegion> mRules;
-
     /**
      *  The inner List of Tuples with layers is needed for translating
-     * tile layers from mMapRules to mMapWork.
+     * tile layers from mRuleMap to mMapWork.
      * the outer list is used to hold different translation tables
      * => one of the inner lists is chosen by chance
      */
     QList<QList<QPair<TileLayer*, TileLayer*> >* > mLayerList;
 
-    /**
-     * store the name of the processed rules file, to have detailed
-     * error messages available
-     */
-    QString mRulePath;
-
     /**
      * determines if all tiles in all touched layers should be deleted first.
      */
@@ -340,6 +385,12 @@ private:
 
     QSet<QString> mTouchedLayers;
 
+    /**
+     * Seeds the choice between the groups of rule layers in mLayerList, so
+     * that it does not depend on the order in which matches are applied.
+     */
+    uint mRandomSeed;
+
     QString mError;
 };
 
@@ -347,26 +398,44 @@ private:
  * This is a wrapper class for the AutoMapper class.
  * Here in this class only undo/redo functionality for one rulemap
  * is provided.
- * This class will take a snapshot of the layers before and after the
- * automapping is done. In between instances of AutoMapper are doing the work.
+ * This class records the cells of the touched layers that were changed by
+ * the automapping, along with their contents before and after. In between
+ * instances of AutoMapper are doing the work.
  */
 
 class AutoMapperWrapper : public QUndoCommand
 {
 public:
+    /**
+     * Runs the automappers on \a where. When \a matches are given, these are
+     * applied where they still match instead, and the automappers are
+     * expected to be prepared already.
+     */
     AutoMapperWrapper(MapDocument *mapDocument, QVector<AutoMapper*> autoMapper,
-                      QRegion *where);
-    ~AutoMapperWrapper();
+                      QRegion *where,
+                      const QVector<AutoMapper::Matches> *matches = 0);
+
+    /**
+     * Sets whether the changes may be merged into the paint command that
+     * caused them. Only a paint command on the set layer takes them.
+     */
+    void setMergeable(bool mergeable) { mMergeable = mergeable; }
+    bool isMergeable() const { return mMergeable; }
+
+    MapDocument *mapDocument() const { return mMapDocument; }
+    const TileLayer *setLayer() const { return mSetLayer; }
+    const AutoMappingChanges &changes() const { return mChanges; }
 
     void undo();
     void redo();
 
-private:
-    Layer *swapLayer(int layerIndex, Layer *layer);
+    int id() const { return mMergeable ? Cmd_PaintTileLayer : -1; }
 
+private:
     MapDocument *mMapDocument;
-    QVector<Layer*> mLayersAfter;
-    QVector<Layer*> mLayersBefore;
+    const TileLayer *mSetLayer;
+    AutoMappingChanges mChanges;
+    bool mMergeable;
 };
 
 /**
@@ -408,6 +477,32 @@ public slots:
     void automap(QRegion where, Layer *layer);
 
 private slots:
+    /**
+     * Adds the region edited by the user to the region to automap in the
+     * background. Connected to the regionEdited signal of the map document.
+     */
+    void queueAutoMap(QRegion where, Layer *layer);
+
+    /**
+     * Starts finding the matches of the rules in the queued region on the
+     * thread pool, against a clone of the set layer.
+     */
+    void startLiveAutoMap();
+
+    /**
+     * Applies the matches found in the background, unless the undo stack
+     * changed in the meantime.
+     */
+    void liveAutoMapFinished();
+
+    /**
+     * Marks the results of the running live automapping as outdated when
+     * the undo stack moves to another \a index than it had when the job
+     * started, because a command was undone, redone or added. Paint commands
+     * merging into the top command keep the index, and the results.
+     */
+    void undoIndexChanged(int index);
+
     /**
      * connected to the QFileWatcher, which monitors all rules files for changes
      */
@@ -442,6 +537,22 @@ private:
      */
     bool loadFile(const QString &filePath);
 
+    /**
+     * Loads the rules file next to the map, if not done yet.
+     */
+    void loadRules();
+
+    /**
+     * Adds \a fileName to the watched files, if it is not watched yet.
+     */
+    void watchFile(const QString &fileName);
+
+    /**
+     * Waits for the live automapping running in the background to finish,
+     * and discards its results.
+     */
+    void cancelLiveAutoMap();
+
     /**
      * deletes all its data structures
      */
@@ -458,6 +569,12 @@ private:
      */
     QVector<AutoMapper*> mAutoMappers;
 
+    /**
+     * The rules files and rules maps read so far, for all map documents.
+     * Only the files that were modified are read again.
+     */
+    RuleMapCache mRuleMapCache;
+
     /**
      * This tells you if the rules for the current map document were already
      * loaded.
@@ -484,6 +601,17 @@ private:
      */
     QTimer mChangedFilesTimer;
 
+    /**
+     * The region edited since the live automapping last started, and the
+     * timer that delays it, so that quick edits are automapped together.
+     */
+    QRegion mLiveRegion;
+    QTimer mLiveTimer;
+
+    LiveAutoMapJob *mLiveJob;
+    int mLiveJobIndex;
+    bool mLiveJobOutdated;
+
     QString mError;
 
     /**
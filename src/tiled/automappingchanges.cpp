@@ -0,0 +1,136 @@
+/*
+ * automappingchanges.cpp
+ * Copyright 2026, agent <agent@local>
+ *
+ * This file is part of Tiled.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "automappingchanges.h"
+
+#include "map.h"
+
+#include <QHash>
+
+using namespace Tiled;
+using namespace Tiled::Internal;
+
+/**
+ * Returns a key for the cell at \a x, \a y. Sorting the keys puts the cells
+ * in row order, also for negative coordinates.
+ */
+static quint64 cellKey(int x, int y)
+{
+    return (quint64(quint32(y) ^ 0x80000000u) << 32)
+            | (quint32(x) ^ 0x80000000u);
+}
+
+static int cellX(quint64 key)
+{
+    return int(quint32(key) ^ 0x80000000u);
+}
+
+static int cellY(quint64 key)
+{
+    return int(quint32(key >> 32) ^ 0x80000000u);
+}
+
+void AutoMappingChanges::addLayer(const QString &layerName,
+                                  const TileLayer &before,
+                                  const TileLayer &after)
+{
+    const TileRegion region = after.differences(before);
+    if (region.isEmpty())
+        return;
+
+    LayerChanges changes;
+    changes.layerName = layerName;
+    changes.cells.reserve(region.cellCount());
+
+    foreach (const TileRegion::Span &span, region.spans()) {
+        const int y = span.y - after.y();
+        for (int x = span.left; x < span.right; ++x) {
+            CellChange change;
+            change.before = before.cellAt(x - after.x(), y);
+            change.after = after.cellAt(x - after.x(), y);
+            changes.cells.insert(cellKey(x, span.y), change);
+        }
+    }
+
+    mLayers.append(changes);
+}
+
+void AutoMappingChanges::merge(const AutoMappingChanges &later)
+{
+    foreach (const LayerChanges &laterChanges, later.mLayers) {
+        LayerChanges *changes = 0;
+        for (int i = 0; i < mLayers.size() && !changes; ++i)
+            if (mLayers.at(i).layerName == laterChanges.layerName)
+                changes = &mLayers[i];
+
+        if (!changes) {
+            mLayers.append(laterChanges);
+            continue;
+        }
+
+        // Only the later cells are touched, so that merging many small
+        // changes does not copy the earlier ones each time
+        QHash<quint64, CellChange>::const_iterator it =
+                laterChanges.cells.constBegin();
+        QHash<quint64, CellChange>::const_iterator end =
+                laterChanges.cells.constEnd();
+
+        for (; it != end; ++it) {
+            QHash<quint64, CellChange>::iterator existing =
+                    changes->cells.find(it.key());
+            if (existing != changes->cells.end())
+                existing->after = it->after;
+            else
+                changes->cells.insert(it.key(), it.value());
+        }
+    }
+}
+
+QRegion AutoMappingChanges::apply(Map *map, bool after) const
+{
+    TileRegion changed;
+
+    foreach (const LayerChanges &changes, mLayers) {
+        const int layerindex = map->indexOfLayer(changes.layerName);
+        if (layerindex == -1)
+            continue;
+
+        TileLayer *layer = map->layerAt(layerindex)->asTileLayer();
+        if (!layer)
+            continue;
+
+        QList<quint64> keys = changes.cells.keys();
+        qSort(keys);
+
+        TileRegion region;
+        foreach (quint64 key, keys) {
+            const CellChange &change = changes.cells.value(key);
+            const int x = cellX(key);
+            const int y = cellY(key);
+            layer->setCell(x - layer->x(), y - layer->y(),
+                           after ? change.after : change.before);
+            region.addSpan(x, y, 1);
+        }
+
+        changed |= region;
+    }
+
+    return changed.toRegion();
+}
@@ -0,0 +1,90 @@
+/*
+ * automappingchanges.h
+ * Copyright 2026, agent <agent@local>
+ *
+ * This file is part of Tiled.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUTOMAPPINGCHANGES_H
+#define AUTOMAPPINGCHANGES_H
+
+#include "tilelayer.h"
+#include "tileregion.h"
+
+#include <QHash>
+#include <QRegion>
+#include <QString>
+#include <QVector>
+
+namespace Tiled {
+
+class Map;
+
+namespace Internal {
+
+/**
+ * The cells of the map changed by automapping, along with their contents
+ * before and after the change. The cells are set again in place on undo and
+ * redo.
+ */
+class AutoMappingChanges
+{
+public:
+    /**
+     * Records the cells in which the layer \a after differs from \a before,
+     * which is expected to be a clone of it from before the automapping.
+     */
+    void addLayer(const QString &layerName,
+                  const TileLayer &before, const TileLayer &after);
+
+    /**
+     * Adds the \a later changes to these changes. The cells are set to what
+     * they were before these changes, or after the later ones.
+     */
+    void merge(const AutoMappingChanges &later);
+
+    /**
+     * Sets the cells of \a map from before or \a after the changes. Returns
+     * the region of the changed cells.
+     */
+    QRegion apply(Map *map, bool after) const;
+
+    bool isEmpty() const { return mLayers.isEmpty(); }
+
+private:
+    struct CellChange
+    {
+        Cell before;
+        Cell after;
+    };
+
+    /**
+     * The cells of a layer changed by the automapping, by their position.
+     * Merging later changes only needs to look at the cells they changed.
+     */
+    struct LayerChanges
+    {
+        QString layerName;
+        QHash<quint64, CellChange> cells;
+    };
+
+    QVector<LayerChanges> mLayers;
+};
+
+} // namespace Internal
+} // namespace Tiled
+
+#endif // AUTOMAPPINGCHANGES_H
@@ -60,7 +60,7 @@ void BrushItem::setTileLayer(const TileLayer *tileLayer)
 
     if (tileLayer) {
         mTileLayer = static_cast<TileLayer*>(tileLayer->clone());
-        mRegion = mTileLayer->region();
+        mRegion = mTileLayer->region().toRegion();
     } else {
         mTileLayer = 0;
         mRegion = QRegion();
@@ -0,0 +1,157 @@
+/*
+ * dirtytiles.cpp
+ * Copyright 2026, agent <agent@local>
+ *
+ * This file is part of Tiled.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dirtytiles.h"
+
+#include "maprenderer.h"
+
+using namespace Tiled;
+using namespace Tiled::Internal;
+
+// More rects than this are first snapped to a coarser grid of tiles, to keep
+// the cost of combining them down
+static const int MaxCandidateRects = 128;
+
+// The cost of marking an additional rect for repainting, in pixels
+static const int DirtyRectOverhead = 64 * 64;
+
+namespace {
+
+/**
+ * A rect of changed tiles, along with the area it covers in the scene.
+ */
+struct DirtyRect
+{
+    QRect tiles;
+    QRect pixels;
+};
+
+} // anonymous namespace
+
+static qint64 area(const QRect &rect)
+{
+    return qint64(rect.width()) * rect.height();
+}
+
+static int floorDiv(int value, int divisor)
+{
+    return value >= 0 ? value / divisor : (value - divisor + 1) / divisor;
+}
+
+/**
+ * Returns the tile-aligned rects covering \a region, using no more than
+ * MaxCandidateRects rects. When the region is too fragmented, it is snapped
+ * to an increasingly coarse grid of tiles.
+ */
+static QVector<QRect> candidateRects(const TileRegion &region)
+{
+    QVector<QRect> rects = region.rects();
+    if (rects.size() <= MaxCandidateRects)
+        return rects;
+
+    const QVector<QRect> tileRects = rects;
+    const QRect bounds = region.boundingRect();
+    int cellSize = 1;
+
+    while (rects.size() > MaxCandidateRects) {
+        cellSize *= 4;
+
+        TileRegion cells;
+        foreach (const QRect &r, tileRects) {
+            cells.addRect(QRect(QPoint(floorDiv(r.left(), cellSize),
+                                       floorDiv(r.top(), cellSize)),
+                                QPoint(floorDiv(r.right(), cellSize),
+                                       floorDiv(r.bottom(), cellSize))));
+        }
+
+        rects = cells.rects();
+        for (int i = 0; i < rects.size(); ++i) {
+            const QRect &r = rects.at(i);
+            rects[i] = QRect(r.x() * cellSize, r.y() * cellSize,
+                             r.width() * cellSize, r.height() * cellSize)
+                    & bounds;
+        }
+    }
+
+    return rects;
+}
+
+DirtyTiles::DirtyTiles()
+    : mRepaintedPixels(0)
+{
+}
+
+QVector<QRect> DirtyTiles::takeRects(const MapRenderer *renderer,
+                                     const QSize &extraTileSize)
+{
+    const TileRegion tiles = mTiles;
+    mTiles = TileRegion();
+    mRepaintedPixels = 0;
+
+    QVector<DirtyRect> rects;
+    foreach (const QRect &r, candidateRects(tiles)) {
+        DirtyRect dirtyRect;
+        dirtyRect.tiles = r;
+        dirtyRect.pixels = renderer->boundingRect(r)
+                .adjusted(0, -extraTileSize.height(),
+                          extraTileSize.width(), 0);
+        rects.append(dirtyRect);
+    }
+
+    // Keep combining the pair of rects that adds the least area, as long as
+    // that saves more than the overhead of a rect or there are too many rects
+    while (rects.size() > 1) {
+        int bestI = -1;
+        int bestJ = -1;
+        qint64 bestCost = 0;
+
+        for (int i = 0; i < rects.size(); ++i) {
+            const QRect &a = rects.at(i).pixels;
+            for (int j = i + 1; j < rects.size(); ++j) {
+                const QRect &b = rects.at(j).pixels;
+                const qint64 covered = area(a) + area(b) - area(a & b);
+                const qint64 cost = area(a | b) - covered - DirtyRectOverhead;
+                if (bestI == -1 || cost < bestCost) {
+                    bestI = i;
+                    bestJ = j;
+                    bestCost = cost;
+                }
+            }
+        }
+
+        if (bestCost > 0 && rects.size() <= MaxRects)
+            break;
+
+        DirtyRect &merged = rects[bestI];
+        merged.tiles |= rects.at(bestJ).tiles;
+        merged.pixels = renderer->boundingRect(merged.tiles)
+                .adjusted(0, -extraTileSize.height(),
+                          extraTileSize.width(), 0);
+        rects.remove(bestJ);
+    }
+
+    QVector<QRect> result;
+    result.reserve(rects.size());
+    foreach (const DirtyRect &dirtyRect, rects) {
+        result.append(dirtyRect.pixels);
+        mRepaintedPixels += area(dirtyRect.pixels);
+    }
+    return result;
+}
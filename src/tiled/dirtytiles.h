@@ -0,0 +1,89 @@
+/*
+ * dirtytiles.h
+ * Copyright 2026, agent <agent@local>
+ *
+ * This file is part of Tiled.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DIRTYTILES_H
+#define DIRTYTILES_H
+
+#include "tileregion.h"
+
+#include <QRect>
+#include <QSize>
+#include <QVector>
+
+namespace Tiled {
+
+class MapRenderer;
+
+namespace Internal {
+
+/**
+ * Collects the tiles changed since the last repaint, and combines them into
+ * a limited number of rects to repaint.
+ */
+class DirtyTiles
+{
+public:
+    /**
+     * The changed tiles are marked for repainting using at most this many
+     * rects.
+     */
+    static const int MaxRects = 32;
+
+    DirtyTiles();
+
+    /**
+     * Marks the tiles in \a region as changed.
+     */
+    void add(const TileRegion &region) { mTiles |= region; }
+
+    /**
+     * Forgets about the changed tiles.
+     */
+    void clear() { mTiles = TileRegion(); }
+
+    bool isEmpty() const { return mTiles.isEmpty(); }
+
+    /**
+     * Returns the areas in the scene that need to be repainted for the
+     * changed tiles, using at most MaxRects rects, and clears the changed
+     * tiles. The area of the returned rects is remembered as
+     * repaintedPixels().
+     *
+     * @param renderer      the renderer used to find the area of the tiles
+     * @param extraTileSize how far the tiles may extend beyond the grid
+     */
+    QVector<QRect> takeRects(const MapRenderer *renderer,
+                             const QSize &extraTileSize);
+
+    /**
+     * Returns the number of pixels covered by the rects returned by the last
+     * call to takeRects().
+     */
+    qint64 repaintedPixels() const { return mRepaintedPixels; }
+
+private:
+    TileRegion mTiles;
+    qint64 mRepaintedPixels;
+};
+
+} // namespace Internal
+} // namespace Tiled
+
+#endif // DIRTYTILES_H
@@ -20,6 +20,7 @@
 
 #include "mainwindow.h"
 #include "languagemanager.h"
+#include "preferences.h"
 #include "tiledapplication.h"
 
 #include <QDebug>
@@ -31,6 +32,7 @@ Q_IMPORT_PLUGIN(qjpeg)
 Q_IMPORT_PLUGIN(qtiff)
 #endif
 
+using namespace Tiled;
 using namespace Tiled::Internal;
 
 namespace {
@@ -39,10 +41,14 @@ struct CommandLineOptions {
     CommandLineOptions()
         : showHelp(false)
         , showVersion(false)
+        , compressionLevel(DefaultCompression)
+        , compressionStrategy(DefaultStrategy)
     {}
 
     bool showHelp;
     bool showVersion;
+    int compressionLevel;
+    CompressionStrategy compressionStrategy;
     QStringList filesToOpen;
 };
 
@@ -53,7 +59,11 @@ void showHelp()
             "Usage: tiled [option] [files...]\n\n"
             "Options:\n"
             "  -h --help    : Display this help\n"
-            "  -v --version : Display the version";
+            "  -v --version : Display the version\n"
+            "  --compression-level <0-9|fast|default|best>\n"
+            "               : Compression level used when saving maps\n"
+            "  --compression-strategy <default|filtered|rle>\n"
+            "               : Compression strategy used when saving maps";
 }
 
 void showVersion()
@@ -62,6 +72,22 @@ void showVersion()
             << qPrintable(QApplication::applicationVersion());
 }
 
+bool parseCompressionLevel(const QString &value, int *level)
+{
+    if (value == QLatin1String("fast")) {
+        *level = FastestCompression;
+    } else if (value == QLatin1String("default")) {
+        *level = DefaultCompression;
+    } else if (value == QLatin1String("best")) {
+        *level = BestCompression;
+    } else {
+        bool ok;
+        *level = value.toInt(&ok);
+        return ok && *level >= NoCompression && *level <= BestCompression;
+    }
+    return true;
+}
+
 void parseCommandLineArguments(CommandLineOptions &options)
 {
     const QStringList arguments = QCoreApplication::arguments();
@@ -76,6 +102,23 @@ void parseCommandLineArguments(CommandLineOptions &options)
         } else if (arg == QLatin1String("--version")
                 || arg == QLatin1String("-v")) {
             options.showVersion = true;
+        } else if (arg == QLatin1String("--compression-level")) {
+            const QString value = (++i < arguments.size()) ? arguments.at(i)
+                                                           : QString();
+            if (!parseCompressionLevel(value, &options.compressionLevel)) {
+                qWarning() << "Invalid compression level" << value;
+                options.showHelp = true;
+            }
+        } else if (arg == QLatin1String("--compression-strategy")) {
+            const QString value = (++i < arguments.size()) ? arguments.at(i)
+                                                           : QString();
+            bool ok;
+            options.compressionStrategy =
+                    compressionStrategyFromString(value, &ok);
+            if (!ok) {
+                qWarning() << "Invalid compression strategy" << value;
+                options.showHelp = true;
+            }
         } else if (arg.at(0) == QLatin1Char('-')) {
             qWarning() << "Unknown option" << arg;
             options.showHelp = true;
@@ -120,6 +163,10 @@ int main(int argc, char *argv[])
     if (options.showVersion || options.showHelp)
         return 0;
 
+    Preferences *prefs = Preferences::instance();
+    prefs->setCompressionLevel(options.compressionLevel);
+    prefs->setCompressionStrategy(options.compressionStrategy);
+
     MainWindow w;
     w.show();
 
@@ -163,10 +163,19 @@ MapObjectItem::MapObjectItem(MapObject *object, MapDocument *mapDocument,
     mMapDocument(mapDocument),
     mIsEditable(false),
     mSyncing(false),
-    mResizeHandle(new ResizeHandle(this))
+    mResizeHandle(0)
 {
     syncWithMapObject();
-    mResizeHandle->setVisible(false);
+}
+
+void MapObjectItem::setMapObject(MapObject *object)
+{
+    setEditable(false);
+
+    mObject = object;
+    mName.clear();
+    syncWithMapObject();
+    update();
 }
 
 void MapObjectItem::syncWithMapObject()
@@ -195,14 +204,26 @@ void MapObjectItem::syncWithMapObject()
         // Notify the graphics scene about the geometry change in advance
         prepareGeometryChange();
         mBoundingRect = bounds;
-        const QPointF bottomRight = mObject->bounds().bottomRight();
-        const QPointF handlePos = renderer->tileToPixelCoords(bottomRight);
-        mSyncing = true;
-        mResizeHandle->setPos(handlePos - pixelPos);
-        mSyncing = false;
+        syncResizeHandle();
     }
 }
 
+/**
+ * Moves the resize handle to the bottom-right corner of the object.
+ */
+void MapObjectItem::syncResizeHandle()
+{
+    if (!mResizeHandle)
+        return;
+
+    MapRenderer *renderer = mMapDocument->renderer();
+    const QPointF bottomRight = mObject->bounds().bottomRight();
+    const QPointF handlePos = renderer->tileToPixelCoords(bottomRight);
+    mSyncing = true;
+    mResizeHandle->setPos(handlePos - pos());
+    mSyncing = false;
+}
+
 void MapObjectItem::setEditable(bool editable)
 {
     if (editable == mIsEditable)
@@ -210,13 +231,24 @@ void MapObjectItem::setEditable(bool editable)
 
     mIsEditable = editable;
 
-    mResizeHandle->setVisible(mIsEditable && !mObject->tile());
+    // The resize handle is only created once it is needed
+    if (mIsEditable && !mResizeHandle && !mObject->tile()) {
+        mResizeHandle = new ResizeHandle(this);
+        syncResizeHandle();
+    }
+    if (mResizeHandle)
+        mResizeHandle->setVisible(mIsEditable && !mObject->tile());
+
     if (mIsEditable)
         setCursor(Qt::SizeAllCursor);
     else
         unsetCursor();
 
     update();
+
+    // The object group draws the object while this item is not editable
+    if (QGraphicsItem *parent = parentItem())
+        parent->update(mapRectToParent(mBoundingRect));
 }
 
 QRectF MapObjectItem::boundingRect() const
@@ -235,6 +267,10 @@ void MapObjectItem::paint(QPainter *painter,
                           const QStyleOptionGraphicsItem *,
                           QWidget *)
 {
+    // Drawn by the object group item unless editable
+    if (parentItem() && !mIsEditable)
+        return;
+
     painter->translate(-pos());
     const QColor color = MapObjectItem::color();
     mMapDocument->renderer()->drawMapObject(painter, mObject, color);
@@ -269,9 +305,14 @@ MapDocument *MapObjectItem::mapDocument() const
 }
 
 QColor MapObjectItem::color() const
+{
+    return objectColor(mObject);
+}
+
+QColor MapObjectItem::objectColor(const MapObject *object)
 {
     // Get color from object group
-    const ObjectGroup *objectGroup = mObject->objectGroup();
+    const ObjectGroup *objectGroup = object->objectGroup();
     if (objectGroup && objectGroup->color().isValid())
         return objectGroup->color();
 
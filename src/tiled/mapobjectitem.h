@@ -36,7 +36,12 @@ class ObjectGroupItem;
 class ResizeHandle;
 
 /**
- * A graphics item displaying a map object.
+ * A graphics item for interacting with a map object.
+ *
+ * Items are only created for the objects near the visible area of the map
+ * and for selected objects. While the item is not editable, the object is
+ * drawn by its ObjectGroupItem, so the item only provides the shape and
+ * tool tip of the object.
  */
 class MapObjectItem : public QGraphicsItem
 {
@@ -55,6 +60,12 @@ public:
     MapObject *mapObject() const
     { return mObject; }
 
+    /**
+     * Makes this item refer to another map object, so that it can be reused
+     * rather than creating a new item.
+     */
+    void setMapObject(MapObject *object);
+
     /**
      * Should be called when the map object this item refers to was changed.
      */
@@ -83,9 +94,15 @@ public:
      */
     void resize(const QSizeF &size);
 
+    /**
+     * Returns the color used to draw the given \a object.
+     */
+    static QColor objectColor(const MapObject *object);
+
 private:
     MapDocument *mapDocument() const;
     QColor color() const;
+    void syncResizeHandle();
 
     MapObject *mObject;
     MapDocument *mMapDocument;
@@ -41,6 +41,7 @@
 #include "tilesetmanager.h"
 
 #include <QGraphicsSceneMouseEvent>
+#include <QGraphicsView>
 #include <QPainter>
 #include <QKeyEvent>
 #include <QApplication>
@@ -50,6 +51,12 @@
 using namespace Tiled;
 using namespace Tiled::Internal;
 
+// More objects than this near the visible area do not get an item each
+static const int MaxObjectItems = 5000;
+
+// The number of unused object items kept around for reuse
+static const int MaxUnusedObjectItems = 1000;
+
 MapScene::MapScene(QObject *parent):
     QGraphicsScene(parent),
     mMapDocument(0),
@@ -58,7 +65,8 @@ MapScene::MapScene(QObject *parent):
     mActiveTool(0),
     mGridVisible(true),
     mUnderMouse(false),
-    mCurrentModifiers(Qt::NoModifier)
+    mCurrentModifiers(Qt::NoModifier),
+    mFlushPending(false)
 {
     Preferences *preferences = Preferences::instance();
     QBrush backBrush(preferences->backgroundColor());
@@ -128,6 +136,201 @@ void MapScene::setSelectedObjectItems(const QSet<MapObjectItem *> &items)
     mMapDocument->setSelectedObjects(selectedObjects);
 }
 
+QSet<MapObjectItem*> MapScene::objectItemsIn(const QRectF &rect)
+{
+    QSet<MapObjectItem*> result;
+    if (!mMapDocument)
+        return result;
+
+    const Map *map = mMapDocument->map();
+    const MapRenderer *renderer = mMapDocument->renderer();
+
+    for (int i = 0; i < map->layerCount(); ++i) {
+        ObjectGroup *objectGroup = map->layerAt(i)->asObjectGroup();
+        if (!objectGroup || !objectGroup->isVisible())
+            continue;
+
+        ObjectGroupItem *ogItem =
+                static_cast<ObjectGroupItem*>(mLayerItems.at(i));
+        const QRectF itemRect = ogItem->mapFromScene(rect).boundingRect();
+
+        foreach (MapObject *object, ogItem->objectsIn(itemRect)) {
+            // Check the exact shape before creating an item for the object
+            if (renderer->shape(object).intersects(itemRect))
+                result.insert(objectItem(object));
+        }
+    }
+
+    return result;
+}
+
+MapObjectItem *MapScene::topMostObjectItemAt(const QPointF &pos)
+{
+    // Make sure the objects at this position have an item
+    objectItemsIn(QRectF(pos, QSizeF(1, 1)));
+
+    foreach (QGraphicsItem *item, items(pos)) {
+        if (MapObjectItem *objectItem = dynamic_cast<MapObjectItem*>(item))
+            return objectItem;
+    }
+    return 0;
+}
+
+void MapScene::updateObjectItems()
+{
+    if (!mMapDocument)
+        return;
+
+    QRectF visibleArea;
+    foreach (QGraphicsView *view, views())
+        visibleArea |= view->mapToScene(view->viewport()->rect())
+                .boundingRect();
+
+    if (visibleArea.isEmpty() || mObjectItemsArea.contains(visibleArea))
+        return;
+
+    // Also cover the area around the view, so that scrolling a bit does not
+    // immediately need new items
+    const qreal marginX = visibleArea.width() / 2;
+    const qreal marginY = visibleArea.height() / 2;
+    mObjectItemsArea = visibleArea.adjusted(-marginX, -marginY,
+                                            marginX, marginY);
+
+    const Map *map = mMapDocument->map();
+    QSet<MapObject*> nearObjects;
+
+    for (int i = 0; i < map->layerCount(); ++i) {
+        ObjectGroup *objectGroup = map->layerAt(i)->asObjectGroup();
+        if (!objectGroup || !objectGroup->isVisible())
+            continue;
+
+        ObjectGroupItem *ogItem =
+                static_cast<ObjectGroupItem*>(mLayerItems.at(i));
+        const QRectF itemRect =
+                ogItem->mapFromScene(mObjectItemsArea).boundingRect();
+        foreach (MapObject *object, ogItem->objectsIn(itemRect))
+            nearObjects.insert(object);
+    }
+
+    // When zoomed out this far, the objects are only drawn by their groups
+    // and items are created as they are clicked
+    if (nearObjects.size() > MaxObjectItems)
+        nearObjects.clear();
+
+    // Items can not be reused while a tool may be holding on to them
+    if (QApplication::mouseButtons() == Qt::NoButton) {
+        foreach (MapObjectItem *item, mObjectItems.values()) {
+            if (!item->isEditable() && !nearObjects.contains(item->mapObject()))
+                releaseObjectItem(item);
+        }
+    }
+
+    foreach (MapObject *object, nearObjects)
+        objectItem(object);
+}
+
+/**
+ * Creates or releases the items of the given \a objects only, depending on
+ * whether they are near the visible area. Used when objects are added or
+ * changed, since the visible area itself did not change.
+ */
+void MapScene::updateObjectItems(const QList<MapObject*> &objects)
+{
+    if (mObjectItemsArea.isNull()) {
+        updateObjectItems();
+        return;
+    }
+
+    const MapRenderer *renderer = mMapDocument->renderer();
+
+    // Items can not be reused while a tool may be holding on to them
+    const bool canRelease = QApplication::mouseButtons() == Qt::NoButton;
+
+    foreach (MapObject *object, objects) {
+        ObjectGroupItem *ogItem = objectGroupItem(object->objectGroup());
+        if (!ogItem)
+            continue;
+
+        const QRectF itemRect =
+                ogItem->mapFromScene(mObjectItemsArea).boundingRect();
+        const bool near = ogItem->isVisible() &&
+                renderer->boundingRect(object).intersects(itemRect);
+
+        MapObjectItem *item = mObjectItems.value(object);
+        if (near && !item && mObjectItems.size() < MaxObjectItems)
+            objectItem(object);
+        else if (!near && item && canRelease && !item->isEditable())
+            releaseObjectItem(item);
+    }
+}
+
+/**
+ * Returns the item of the given \a objectGroup.
+ */
+ObjectGroupItem *MapScene::objectGroupItem(ObjectGroup *objectGroup) const
+{
+    const int index = mMapDocument->map()->layers().indexOf(objectGroup);
+    if (index == -1)
+        return 0;
+
+    return static_cast<ObjectGroupItem*>(mLayerItems.at(index));
+}
+
+/**
+ * Returns the item of the given \a object, creating it when it does not
+ * exist yet. Unused items are reused when available.
+ */
+MapObjectItem *MapScene::objectItem(MapObject *object)
+{
+    if (MapObjectItem *item = mObjectItems.value(object))
+        return item;
+
+    ObjectGroupItem *ogItem = objectGroupItem(object->objectGroup());
+    Q_ASSERT(ogItem);
+
+    MapObjectItem *item;
+    if (!mUnusedObjectItems.isEmpty()) {
+        item = mUnusedObjectItems.takeLast();
+        item->setParentItem(ogItem);
+        item->setMapObject(object);
+        item->show();
+    } else {
+        item = new MapObjectItem(object, mMapDocument, ogItem);
+    }
+
+    mObjectItems.insert(object, item);
+    return item;
+}
+
+/**
+ * Removes the given \a item from its object, keeping it around for reuse.
+ */
+void MapScene::releaseObjectItem(MapObjectItem *item)
+{
+    mObjectItems.remove(item->mapObject());
+    mSelectedObjectItems.remove(item);
+
+    if (mUnusedObjectItems.size() >= MaxUnusedObjectItems) {
+        delete item;
+        return;
+    }
+
+    item->setEditable(false);
+    item->hide();
+    item->setParentItem(0);
+    mUnusedObjectItems.append(item);
+}
+
+/**
+ * Makes the next call to updateObjectItems() look for the objects near the
+ * visible area again.
+ */
+void MapScene::resetObjectItems()
+{
+    mObjectItemsArea = QRectF();
+    updateObjectItems();
+}
+
 void MapScene::setSelectedTool(AbstractTool *tool)
 {
     mSelectedTool = tool;
@@ -138,6 +341,10 @@ void MapScene::refreshScene()
     mSelectedObjectGroupItem = 0;
     mLayerItems.clear();
     mObjectItems.clear();
+    mSelectedObjectItems.clear();
+    mUnusedObjectItems.clear();
+    mObjectItemsArea = QRectF();
+    mDirtyTiles.clear();
 
     clear();
 
@@ -164,6 +371,8 @@ void MapScene::refreshScene()
     TileSelectionItem *selectionItem = new TileSelectionItem(mMapDocument);
     selectionItem->setZValue(10000 - 1);
     addItem(selectionItem);
+
+    updateObjectItems();
 }
 
 QGraphicsItem *MapScene::createLayerItem(Layer *layer)
@@ -173,13 +382,8 @@ QGraphicsItem *MapScene::createLayerItem(Layer *layer)
     if (TileLayer *tl = dynamic_cast<TileLayer*>(layer)) {
         layerItem = new TileLayerItem(tl, mMapDocument->renderer());
     } else if (ObjectGroup *og = dynamic_cast<ObjectGroup*>(layer)) {
-        ObjectGroupItem *ogItem = new ObjectGroupItem(og);
-        foreach (MapObject *object, og->objects()) {
-            MapObjectItem *item = new MapObjectItem(object, mMapDocument,
-                                                    ogItem);
-            mObjectItems.insert(object, item);
-        }
-        layerItem = ogItem;
+        // Items for the objects are created when needed
+        layerItem = new ObjectGroupItem(og, mMapDocument->renderer());
     } else if (ImageLayer *il = dynamic_cast<ImageLayer*>(layer)) {
         layerItem = new ImageLayerItem(il, mMapDocument->renderer());
     }
@@ -192,12 +396,35 @@ QGraphicsItem *MapScene::createLayerItem(Layer *layer)
 
 void MapScene::repaintRegion(const QRegion &region)
 {
+    // The region does not tell which layer changed
+    foreach (QGraphicsItem *item, mLayerItems) {
+        if (TileLayerItem *tli = dynamic_cast<TileLayerItem*>(item))
+            tli->invalidateRegion(region);
+    }
+
+    mDirtyTiles.add(TileRegion(region));
+
+    if (!mFlushPending) {
+        mFlushPending = true;
+        QMetaObject::invokeMethod(this, "flushDirtyRegion",
+                                  Qt::QueuedConnection);
+    }
+}
+
+void MapScene::flushDirtyRegion()
+{
+    mFlushPending = false;
+
+    if (!mMapDocument) {
+        mDirtyTiles.clear();
+        return;
+    }
+
     const MapRenderer *renderer = mMapDocument->renderer();
     const QSize extra = mMapDocument->map()->extraTileSize();
 
-    foreach (const QRect &r, region.rects())
-        update(renderer->boundingRect(r)
-               .adjusted(0, -extra.height(), extra.width(), 0));
+    foreach (const QRect &rect, mDirtyTiles.takeRects(renderer, extra))
+        update(rect);
 }
 
 /**
@@ -274,8 +501,13 @@ void MapScene::tilesetChanged(Tileset *tileset)
     if (!mMapDocument)
         return;
 
-    if (mMapDocument->map()->tilesets().contains(tileset))
+    if (mMapDocument->map()->tilesets().contains(tileset)) {
+        foreach (QGraphicsItem *item, mLayerItems) {
+            if (TileLayerItem *tli = dynamic_cast<TileLayerItem*>(item))
+                tli->invalidateCache();
+        }
         update();
+    }
 }
 
 void MapScene::backgroundColorChanged(QColor backgroundColor)
@@ -295,6 +527,8 @@ void MapScene::layerAdded(int index)
     int z = 0;
     foreach (QGraphicsItem *item, mLayerItems)
         item->setZValue(z++);
+
+    resetObjectItems();
 }
 
 void MapScene::layerRemoved(int index)
@@ -303,6 +537,11 @@ void MapScene::layerRemoved(int index)
     if (layerItem == mSelectedObjectGroupItem)
         mSelectedObjectGroupItem = 0;
 
+    // Reuse the items of the objects in the removed group
+    foreach (MapObjectItem *item, mObjectItems.values())
+        if (item->parentItem() == layerItem)
+            releaseObjectItem(item);
+
     delete layerItem;
     mLayerItems.remove(index);
 }
@@ -319,34 +558,25 @@ void MapScene::layerChanged(int index)
     if (layer->isVisible() != layerItem->isVisible()) {
         layerItem->setVisible(layer->isVisible());
         updateInteractionMode();
+        resetObjectItems();
     }
     if (layer->opacity() != layerItem->opacity())
         layerItem->setOpacity(layer->opacity());
 }
 
 /**
- * Inserts map object items for the given objects.
+ * Draws the given objects, and creates items for them when they are near the
+ * visible area.
  */
 void MapScene::objectsAdded(const QList<MapObject*> &objects)
 {
     foreach (MapObject *object, objects) {
-        ObjectGroup *og = object->objectGroup();
-        ObjectGroupItem *ogItem = 0;
-
-        // Find the object group item for the map object's object group
-        foreach (QGraphicsItem *item, mLayerItems) {
-            if (ObjectGroupItem *ogi = dynamic_cast<ObjectGroupItem*>(item)) {
-                if (ogi->objectGroup() == og) {
-                    ogItem = ogi;
-                    break;
-                }
-            }
-        }
-
+        ObjectGroupItem *ogItem = objectGroupItem(object->objectGroup());
         Q_ASSERT(ogItem);
-        MapObjectItem *item = new MapObjectItem(object, mMapDocument, ogItem);
-        mObjectItems.insert(object, item);
+        ogItem->objectsChanged(QList<MapObject*>() << object);
     }
+
+    updateObjectItems(objects);
 }
 
 /**
@@ -355,13 +585,14 @@ void MapScene::objectsAdded(const QList<MapObject*> &objects)
 void MapScene::objectsRemoved(const QList<MapObject*> &objects)
 {
     foreach (MapObject *o, objects) {
-        ObjectItems::iterator i = mObjectItems.find(o);
-        Q_ASSERT(i != mObjectItems.end());
-
-        mSelectedObjectItems.remove(i.value());
-        delete i.value();
-        mObjectItems.erase(i);
+        if (MapObjectItem *item = mObjectItems.value(o))
+            releaseObjectItem(item);
     }
+
+    // The objects are no longer part of their group, so repaint all groups
+    foreach (QGraphicsItem *item, mLayerItems)
+        if (ObjectGroupItem *ogItem = dynamic_cast<ObjectGroupItem*>(item))
+            ogItem->update();
 }
 
 /**
@@ -370,11 +601,14 @@ void MapScene::objectsRemoved(const QList<MapObject*> &objects)
 void MapScene::objectsChanged(const QList<MapObject*> &objects)
 {
     foreach (MapObject *o, objects) {
-        MapObjectItem *item = mObjectItems.value(o);
-        Q_ASSERT(item);
+        if (MapObjectItem *item = mObjectItems.value(o))
+            item->syncWithMapObject();
 
-        item->syncWithMapObject();
+        if (ObjectGroupItem *ogItem = objectGroupItem(o->objectGroup()))
+            ogItem->objectsChanged(QList<MapObject*>() << o);
     }
+
+    updateObjectItems(objects);
 }
 
 void MapScene::updateSelectedObjectItems()
@@ -382,12 +616,8 @@ void MapScene::updateSelectedObjectItems()
     const QList<MapObject *> &objects = mMapDocument->selectedObjects();
 
     QSet<MapObjectItem*> items;
-    foreach (MapObject *object, objects) {
-        MapObjectItem *item = mObjectItems.value(object);
-        Q_ASSERT(item);
-
-        items.insert(item);
-    }
+    foreach (MapObject *object, objects)
+        items.insert(objectItem(object));
 
     // Update the editable state of the items
     foreach (MapObjectItem *item, mSelectedObjectItems - items)
@@ -24,6 +24,8 @@
 #ifndef MAPSCENE_H
 #define MAPSCENE_H
 
+#include "dirtytiles.h"
+
 #include <QGraphicsScene>
 #include <QMap>
 #include <QSet>
@@ -32,6 +34,7 @@ namespace Tiled {
 
 class Layer;
 class MapObject;
+class ObjectGroup;
 class Tileset;
 
 namespace Internal {
@@ -94,6 +97,27 @@ public:
      */
     void setSelectedObjectItems(const QSet<MapObjectItem*> &items);
 
+    /**
+     * Returns the items of the map objects in visible object groups of which
+     * the shape intersects \a rect, given in scene coordinates. Uses the
+     * spatial index of the object groups to find the objects, and creates
+     * their items when needed.
+     */
+    QSet<MapObjectItem*> objectItemsIn(const QRectF &rect);
+
+    /**
+     * Returns the top-most map object item at the given \a pos, in scene
+     * coordinates, or 0 if there is none.
+     */
+    MapObjectItem *topMostObjectItemAt(const QPointF &pos);
+
+    /**
+     * Makes sure there are items for the objects near the area visible in
+     * the views, and reuses the items of objects that are no longer near.
+     * Should be called when a view scrolled, resized or zoomed.
+     */
+    void updateObjectItems();
+
     /**
      * Enables the selected tool at this map scene.
      * Therefore it tells that tool, that this is the active map scene.
@@ -106,6 +130,14 @@ public:
      */
     void setSelectedTool(AbstractTool *tool);
 
+    /**
+     * Returns the number of pixels that were marked for repainting the last
+     * time the changed tiles were flushed. Since changes are flushed at most
+     * once per event loop iteration, this is the area repainted per frame
+     * because of edits to the map.
+     */
+    qint64 repaintedPixels() const { return mDirtyTiles.repaintedPixels(); }
+
 public slots:
     /**
      * Sets whether the tile grid is visible.
@@ -137,9 +169,18 @@ private slots:
 
     /**
      * Repaints the specified region. The region is in tile coordinates.
+     *
+     * The area is not marked for repainting right away. Instead, the changed
+     * tiles are collected until the next event loop iteration, where
+     * flushDirtyRegion() combines them into a limited number of rects.
      */
     void repaintRegion(const QRegion &region);
 
+    /**
+     * Marks the pending changed tiles for repainting.
+     */
+    void flushDirtyRegion();
+
     void currentLayerIndexChanged();
 
     void mapChanged();
@@ -159,6 +200,12 @@ private slots:
 private:
     QGraphicsItem *createLayerItem(Layer *layer);
 
+    ObjectGroupItem *objectGroupItem(ObjectGroup *objectGroup) const;
+    MapObjectItem *objectItem(MapObject *object);
+    void releaseObjectItem(MapObjectItem *item);
+    void resetObjectItems();
+    void updateObjectItems(const QList<MapObject*> &objects);
+
     void updateInteractionMode();
     void preferencesChanged();
 
@@ -177,6 +224,11 @@ private:
     typedef QMap<MapObject*, MapObjectItem*> ObjectItems;
     ObjectItems mObjectItems;
     QSet<MapObjectItem*> mSelectedObjectItems;
+    QList<MapObjectItem*> mUnusedObjectItems;
+    QRectF mObjectItemsArea;
+
+    DirtyTiles mDirtyTiles;
+    bool mFlushPending;
 };
 
 } // namespace Internal
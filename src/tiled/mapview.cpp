@@ -72,6 +72,7 @@ void MapView::adjustScale(qreal scale)
     setTransform(QTransform::fromScale(scale, scale));
     setRenderHint(QPainter::SmoothPixmapTransform,
                   mZoomable->smoothTransform());
+    updateObjectItems();
 }
 
 void MapView::setUseOpenGL(bool useOpenGL)
@@ -163,3 +164,25 @@ void MapView::mouseMoveEvent(QMouseEvent *event)
     QGraphicsView::mouseMoveEvent(event);
     mLastMousePos = event->pos();
 }
+
+void MapView::scrollContentsBy(int dx, int dy)
+{
+    QGraphicsView::scrollContentsBy(dx, dy);
+    updateObjectItems();
+}
+
+void MapView::resizeEvent(QResizeEvent *event)
+{
+    QGraphicsView::resizeEvent(event);
+    updateObjectItems();
+}
+
+/**
+ * Lets the scene know which area is visible, so that it can create items for
+ * the objects in that area.
+ */
+void MapView::updateObjectItems()
+{
+    if (MapScene *scene = mapScene())
+        scene->updateObjectItems();
+}
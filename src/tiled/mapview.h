@@ -57,11 +57,16 @@ protected:
     void mouseReleaseEvent(QMouseEvent *event);
     void mouseMoveEvent(QMouseEvent *event);
 
+    void scrollContentsBy(int dx, int dy);
+    void resizeEvent(QResizeEvent *event);
+
 private slots:
     void adjustScale(qreal scale);
     void setUseOpenGL(bool useOpenGL);
 
 private:
+    void updateObjectItems();
+
     QPoint mLastMousePos;
     bool mHandScrolling;
     Zoomable *mZoomable;
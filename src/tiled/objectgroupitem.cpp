@@ -21,32 +21,119 @@
 #include "objectgroupitem.h"
 
 #include "map.h"
+#include "mapobject.h"
 #include "mapobjectitem.h"
+#include "maprenderer.h"
 #include "objectgroup.h"
 
+#include <QStyleOptionGraphicsItem>
+
 using namespace Tiled;
 using namespace Tiled::Internal;
 
-ObjectGroupItem::ObjectGroupItem(ObjectGroup *objectGroup):
-    mObjectGroup(objectGroup)
+namespace {
+
+/**
+ * Orders objects the same way as their items, which are stacked by their
+ * position on the screen.
+ */
+class DrawingOrder
+{
+public:
+    DrawingOrder(const MapRenderer *renderer)
+        : mRenderer(renderer)
+    {}
+
+    bool operator()(const MapObject *a, const MapObject *b) const
+    {
+        return mRenderer->tileToPixelCoords(a->position()).y() <
+                mRenderer->tileToPixelCoords(b->position()).y();
+    }
+
+private:
+    const MapRenderer *mRenderer;
+};
+
+} // anonymous namespace
+
+ObjectGroupItem::ObjectGroupItem(ObjectGroup *objectGroup,
+                                 MapRenderer *renderer):
+    mObjectGroup(objectGroup),
+    mRenderer(renderer)
 {
-    // Since we don't do any painting, we can spare us the call to paint()
-    setFlag(QGraphicsItem::ItemHasNoContents);
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
 
     const Map *map = objectGroup->map();
     setPos(objectGroup->x() * map->tileWidth(),
            objectGroup->y() * map->tileHeight());
 
     setOpacity(objectGroup->opacity());
+
+    mBoundingRect = renderer->boundingRect(QRect(QPoint(), map->size()));
+    objectsChanged(objectGroup->objects());
+}
+
+QList<MapObject*> ObjectGroupItem::objectsIn(const QRectF &rect) const
+{
+    const Map *map = mObjectGroup->map();
+
+    // Find the area in tile coordinates, which depends on the projection
+    const QPolygonF polygon(rect);
+    QPolygonF tilePolygon;
+    foreach (const QPointF &point, polygon)
+        tilePolygon.append(mRenderer->pixelToTileCoords(point));
+
+    // Tile objects are drawn outside of their bounds, by up to a tile
+    const qreal marginX =
+            qreal(map->maxTileSize().width()) / map->tileWidth() + 1;
+    const qreal marginY =
+            qreal(map->maxTileSize().height()) / map->tileHeight() + 1;
+
+    const QRectF tileRect = tilePolygon.boundingRect()
+            .adjusted(-marginX, -marginY, marginX, marginY);
+
+    return mObjectGroup->objectsInRect(tileRect);
+}
+
+void ObjectGroupItem::objectsChanged(const QList<MapObject*> &objects)
+{
+    QRectF boundingRect = mBoundingRect;
+    foreach (const MapObject *object, objects)
+        boundingRect |= mRenderer->boundingRect(object);
+
+    if (boundingRect != mBoundingRect) {
+        prepareGeometryChange();
+        mBoundingRect = boundingRect;
+    }
+
+    update();
 }
 
 QRectF ObjectGroupItem::boundingRect() const
 {
-    return QRectF();
+    return mBoundingRect;
 }
 
-void ObjectGroupItem::paint(QPainter *,
-                            const QStyleOptionGraphicsItem *,
+void ObjectGroupItem::paint(QPainter *painter,
+                            const QStyleOptionGraphicsItem *option,
                             QWidget *)
 {
+    // Editable objects are drawn by their own item, on top of the others
+    QSet<const MapObject*> drawnByItems;
+    foreach (QGraphicsItem *child, childItems()) {
+        MapObjectItem *item = static_cast<MapObjectItem*>(child);
+        if (item->isEditable())
+            drawnByItems.insert(item->mapObject());
+    }
+
+    QList<MapObject*> objects = objectsIn(option->exposedRect);
+    qStableSort(objects.begin(), objects.end(), DrawingOrder(mRenderer));
+
+    foreach (const MapObject *object, objects) {
+        if (drawnByItems.contains(object))
+            continue;
+
+        mRenderer->drawMapObject(painter, object,
+                                 MapObjectItem::objectColor(object));
+    }
 }
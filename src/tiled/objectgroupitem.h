@@ -25,24 +25,39 @@
 
 namespace Tiled {
 
+class MapObject;
+class MapRenderer;
 class ObjectGroup;
 
 namespace Internal {
 
 /**
- * A graphics item representing an object group in a QGraphicsView. It only
- * serves to group together the objects belonging to the same object group.
+ * A graphics item representing an object group in a QGraphicsView. It draws
+ * the objects of the group, and groups together the items of the objects
+ * that are being interacted with.
  *
  * @see MapObjectItem
  */
 class ObjectGroupItem : public QGraphicsItem
 {
 public:
-    ObjectGroupItem(ObjectGroup *objectGroup);
+    ObjectGroupItem(ObjectGroup *objectGroup, MapRenderer *renderer);
 
     ObjectGroup *objectGroup() const
     { return mObjectGroup; }
 
+    /**
+     * Returns the objects of the group that may be drawn within \a rect,
+     * given in item coordinates.
+     */
+    QList<MapObject*> objectsIn(const QRectF &rect) const;
+
+    /**
+     * Makes sure the bounding rect covers the given \a objects and schedules
+     * a repaint. Should be called when objects were added or changed.
+     */
+    void objectsChanged(const QList<MapObject*> &objects);
+
     // QGraphicsItem
     QRectF boundingRect() const;
     void paint(QPainter *painter,
@@ -51,6 +66,8 @@ public:
 
 private:
     ObjectGroup *mObjectGroup;
+    MapRenderer *mRenderer;
+    QRectF mBoundingRect;
 };
 
 } // namespace Internal
@@ -161,21 +161,12 @@ void ObjectSelectionTool::mouseMoved(const QPointF &pos,
     }
 }
 
-static MapObjectItem *topMostObjectItemAt(MapScene *scene, QPointF pos)
-{
-    foreach (QGraphicsItem *item, scene->items(pos)) {
-        if (MapObjectItem *objectItem = dynamic_cast<MapObjectItem*>(item))
-            return objectItem;
-    }
-    return 0;
-}
-
 void ObjectSelectionTool::mousePressed(QGraphicsSceneMouseEvent *event)
 {
     if (mMode != NoMode) // Ignore additional presses during select/move
         return;
 
-    mClickedObjectItem = topMostObjectItemAt(mMapScene, event->scenePos());
+    mClickedObjectItem = mMapScene->topMostObjectItemAt(event->scenePos());
 
     switch (event->button()) {
     case Qt::RightButton:
@@ -257,13 +248,7 @@ void ObjectSelectionTool::updateSelection(const QPointF &pos,
     rect.setWidth(qMax(qreal(1), rect.width()));
     rect.setHeight(qMax(qreal(1), rect.height()));
 
-    QSet<MapObjectItem*> selectedItems;
-
-    foreach (QGraphicsItem *item, mMapScene->items(rect)) {
-        MapObjectItem *mapObjectItem = dynamic_cast<MapObjectItem*>(item);
-        if (mapObjectItem)
-            selectedItems.insert(mapObjectItem);
-    }
+    const QSet<MapObjectItem*> selectedItems = mMapScene->objectItemsIn(rect);
 
     const QSet<MapObjectItem*> oldSelection = mMapScene->selectedObjectItems();
     QSet<MapObjectItem*> newSelection;
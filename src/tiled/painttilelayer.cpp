@@ -20,6 +20,7 @@
 
 #include "painttilelayer.h"
 
+#include "automap.h"
 #include "map.h"
 #include "mapdocument.h"
 #include "tilelayer.h"
@@ -41,7 +42,8 @@ PaintTileLayer::PaintTileLayer(MapDocument *mapDocument,
     mX(x),
     mY(y),
     mPaintedRegion(x, y, source->width(), source->height()),
-    mMergeable(false)
+    mMergeable(false),
+    mAutoMapping(0)
 {
     mErased = mTarget->copy(mX - mTarget->x(),
                             mY - mTarget->y(),
@@ -53,10 +55,15 @@ PaintTileLayer::~PaintTileLayer()
 {
     delete mSource;
     delete mErased;
+    delete mAutoMapping;
 }
 
 void PaintTileLayer::undo()
 {
+    if (mAutoMapping)
+        mMapDocument->emitRegionChanged(
+                    mAutoMapping->apply(mMapDocument->map(), false));
+
     TilePainter painter(mMapDocument, mTarget);
     painter.setCells(mX, mY, mErased, mPaintedRegion);
 }
@@ -65,10 +72,28 @@ void PaintTileLayer::redo()
 {
     TilePainter painter(mMapDocument, mTarget);
     painter.drawCells(mX, mY, mSource);
+
+    if (mAutoMapping)
+        mMapDocument->emitRegionChanged(
+                    mAutoMapping->apply(mMapDocument->map(), true));
 }
 
 bool PaintTileLayer::mergeWith(const QUndoCommand *other)
 {
+    // Live automapping shares the command ID, to be merged into the painting
+    if (const AutoMapperWrapper *autoMapping =
+            dynamic_cast<const AutoMapperWrapper*>(other)) {
+        if (!(autoMapping->mapDocument() == mMapDocument &&
+              autoMapping->setLayer() == mTarget &&
+              autoMapping->isMergeable()))
+            return false;
+
+        if (!mAutoMapping)
+            mAutoMapping = new AutoMappingChanges;
+        mAutoMapping->merge(autoMapping->changes());
+        return true;
+    }
+
     const PaintTileLayer *o = static_cast<const PaintTileLayer*>(other);
     if (!(mMapDocument == o->mMapDocument &&
           mTarget == o->mTarget &&
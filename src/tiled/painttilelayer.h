@@ -32,6 +32,7 @@ class TileLayer;
 
 namespace Internal {
 
+class AutoMappingChanges;
 class MapDocument;
 
 /**
@@ -58,6 +59,9 @@ public:
 
     /**
      * Sets whether this undo command can be merged with an existing command.
+     *
+     * Live automapping results are merged into the paint command on the set
+     * layer that caused them, so that they are undone along with it.
      */
     void setMergeable(bool mergeable)
     { mMergeable = mergeable; }
@@ -76,6 +80,7 @@ private:
     int mX, mY;
     QRegion mPaintedRegion;
     bool mMergeable;
+    AutoMappingChanges *mAutoMapping;
 };
 
 } // namespace Internal
@@ -45,12 +45,22 @@ void Preferences::deleteInstance()
 
 Preferences::Preferences()
     : mSettings(new QSettings)
+    , mCompressionLevel(DefaultCompression)
+    , mCompressionStrategy(DefaultStrategy)
 {
     // Retrieve storage settings
     mSettings->beginGroup(QLatin1String("Storage"));
     mLayerDataFormat = (MapWriter::LayerDataFormat)
                        mSettings->value(QLatin1String("LayerDataFormat"),
                                         MapWriter::Base64Zlib).toInt();
+
+    // Fall back when the stored format is not supported by this build
+    if ((mLayerDataFormat == MapWriter::Base64Zstandard
+         && !isCompressionMethodSupported(Zstandard))
+            || (mLayerDataFormat == MapWriter::Base64LZ4
+                && !isCompressionMethodSupported(LZ4)))
+        mLayerDataFormat = MapWriter::Base64Zlib;
+
     mDtdEnabled = mSettings->value(QLatin1String("DtdEnabled")).toBool();
     mReloadTilesetsOnChange =
             mSettings->value(QLatin1String("ReloadTilesets"), true).toBool();
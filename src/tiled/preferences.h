@@ -53,6 +53,19 @@ public:
     bool dtdEnabled() const;
     void setDtdEnabled(bool enabled);
 
+    /**
+     * The compression settings used when saving maps, overriding those of
+     * the maps themselves. These are only set from the command line and are
+     * not stored.
+     */
+    int compressionLevel() const { return mCompressionLevel; }
+    void setCompressionLevel(int level) { mCompressionLevel = level; }
+
+    CompressionStrategy compressionStrategy() const
+    { return mCompressionStrategy; }
+    void setCompressionStrategy(CompressionStrategy strategy)
+    { mCompressionStrategy = strategy; }
+
     QString language() const;
     void setLanguage(const QString &language);
 
@@ -98,6 +111,8 @@ private:
 
     MapWriter::LayerDataFormat mLayerDataFormat;
     bool mDtdEnabled;
+    int mCompressionLevel;
+    CompressionStrategy mCompressionStrategy;
     QString mLanguage;
     bool mReloadTilesetsOnChange;
     bool mUseOpenGL;
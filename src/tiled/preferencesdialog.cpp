@@ -26,6 +26,8 @@
 #include "gridstyle.h"
 #include "gridstylesmodel.h"
 
+#include "compression.h"
+
 #include <QAbstractItemDelegate>
 #include <QKeyEvent>
 
@@ -317,6 +319,14 @@ PreferencesDialog::PreferencesDialog(QWidget *parent) :
     mUi->languageCombo->model()->sort(0);
     mUi->languageCombo->insertItem(0, tr("System default"));
 
+    // The faster compression methods are optional
+    if (isCompressionMethodSupported(Zstandard))
+        mUi->layerDataCombo->addItem(tr("Base64 (Zstandard compressed)"),
+                                     MapWriter::Base64Zstandard);
+    if (isCompressionMethodSupported(LZ4))
+        mUi->layerDataCombo->addItem(tr("Base64 (LZ4 compressed)"),
+                                     MapWriter::Base64LZ4);
+
     fromPreferences();
 
     connect(mUi->languageCombo, SIGNAL(currentIndexChanged(int)),
@@ -409,6 +419,12 @@ void PreferencesDialog::fromPreferences()
     case MapWriter::CSV:
         formatIndex = 4;
         break;
+    case MapWriter::Base64Zstandard:
+    case MapWriter::Base64LZ4:
+        formatIndex = mUi->layerDataCombo->findData(prefs->layerDataFormat());
+        if (formatIndex == -1)
+            formatIndex = 3;
+        break;
     }
     mUi->layerDataCombo->setCurrentIndex(formatIndex);
 
@@ -439,6 +455,11 @@ void PreferencesDialog::toPreferences()
 
 MapWriter::LayerDataFormat PreferencesDialog::layerDataFormat() const
 {
+    const QVariant data = mUi->layerDataCombo->itemData(
+                mUi->layerDataCombo->currentIndex());
+    if (data.isValid())
+        return static_cast<MapWriter::LayerDataFormat>(data.toInt());
+
     switch (mUi->layerDataCombo->currentIndex()) {
     case 0:
         return MapWriter::XML;
@@ -0,0 +1,198 @@
+/*
+ * rulemapcache.cpp
+ * Copyright 2026, agent <agent@local>
+ *
+ * This file is part of Tiled.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rulemapcache.h"
+
+#include "map.h"
+#include "tilelayer.h"
+#include "tilesetmanager.h"
+#include "tmxmapreader.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QTextStream>
+#include <QThreadPool>
+
+namespace Tiled {
+namespace Internal {
+
+/**
+ * Compiles the rules of a rules map in the background.
+ */
+class CompileRulesJob : public QRunnable
+{
+public:
+    CompileRulesJob(RuleMap *ruleMap)
+        : mRuleMap(ruleMap)
+    {}
+
+    void run()
+    {
+        mRuleMap->mRuleMatcher.setRules(mRuleMap->mRuleRegions,
+                                        mRuleMap->mRuleSets,
+                                        mRuleMap->mRuleNotSets);
+        mRuleMap->mCompiled.release();
+    }
+
+private:
+    RuleMap *mRuleMap;
+};
+
+} // namespace Internal
+} // namespace Tiled
+
+using namespace Tiled;
+using namespace Tiled::Internal;
+
+RuleMap::RuleMap(const QString &fileName)
+    : mFileName(fileName)
+    , mLastModified(QFileInfo(fileName).lastModified())
+    , mMap(0)
+    , mRuleRegions(0)
+{
+    TmxMapReader mapReader;
+    mMap = mapReader.read(fileName);
+
+    if (!mMap) {
+        mError = mapReader.errorString();
+        mCompiled.release();
+        return;
+    }
+
+    TilesetManager::instance()->addReferences(mMap->tilesets());
+    setupRuleLayers();
+
+    // Without regions there are no rules to compile
+    if (mRuleRegions)
+        QThreadPool::globalInstance()->start(new CompileRulesJob(this));
+    else
+        mCompiled.release();
+}
+
+RuleMap::~RuleMap()
+{
+    ruleMatcher();
+
+    if (mMap) {
+        TilesetManager::instance()->removeReferences(mMap->tilesets());
+        delete mMap;
+    }
+}
+
+const RuleMatcher *RuleMap::ruleMatcher()
+{
+    // Released again, so that any thread can wait for the compiled rules
+    mCompiled.acquire();
+    mCompiled.release();
+    return &mRuleMatcher;
+}
+
+void RuleMap::setupRuleLayers()
+{
+    const QString prefix = QLatin1String("rule");
+
+    foreach (Layer *layer, mMap->layers()) {
+        TileLayer *tileLayer = layer->asTileLayer();
+        if (!tileLayer)
+            continue;
+
+        if (!tileLayer->name().startsWith(prefix, Qt::CaseInsensitive))
+            continue;
+
+        // strip leading prefix, to make handling better
+        QString layerName = tileLayer->name();
+        layerName.remove(0, prefix.length());
+
+        if (layerName.startsWith(QLatin1String("set"), Qt::CaseInsensitive))
+            mRuleSets.append(tileLayer);
+        else if (layerName.startsWith(QLatin1String("notset"),
+                                      Qt::CaseInsensitive))
+            mRuleNotSets.append(tileLayer);
+        else if (layerName.startsWith(QLatin1String("regions"),
+                                      Qt::CaseInsensitive))
+            mRuleRegions = tileLayer;
+        else
+            mRuleOutputs.append(tileLayer);
+    }
+}
+
+RuleMapCache::RuleMapCache()
+{
+}
+
+RuleMapCache::~RuleMapCache()
+{
+    clear();
+}
+
+bool RuleMapCache::readRulesFile(const QString &fileName, QStringList *lines)
+{
+    const QDateTime lastModified = QFileInfo(fileName).lastModified();
+
+    QHash<QString, RulesFile>::const_iterator it = mRulesFiles.find(fileName);
+    if (it != mRulesFiles.end() && it->lastModified == lastModified) {
+        *lines = it->lines;
+        return true;
+    }
+
+    QFile rulesFile(fileName);
+    if (!rulesFile.open(QIODevice::ReadOnly))
+        return false;
+
+    RulesFile file;
+    file.lastModified = lastModified;
+
+    QTextStream in(&rulesFile);
+    for (QString line = in.readLine(); !line.isNull(); line = in.readLine())
+        file.lines.append(line);
+
+    mRulesFiles.insert(fileName, file);
+    *lines = file.lines;
+    return true;
+}
+
+RuleMap *RuleMapCache::ruleMap(const QString &fileName)
+{
+    RuleMap *ruleMap = mRuleMaps.value(fileName);
+    if (ruleMap) {
+        if (ruleMap->lastModified() == QFileInfo(fileName).lastModified())
+            return ruleMap;
+
+        delete ruleMap;
+    }
+
+    ruleMap = new RuleMap(fileName);
+    mRuleMaps.insert(fileName, ruleMap);
+    return ruleMap;
+}
+
+void RuleMapCache::remove(const QString &fileName)
+{
+    mRulesFiles.remove(fileName);
+    delete mRuleMaps.take(fileName);
+}
+
+void RuleMapCache::clear()
+{
+    mRulesFiles.clear();
+    qDeleteAll(mRuleMaps);
+    mRuleMaps.clear();
+}
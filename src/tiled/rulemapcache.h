@@ -0,0 +1,165 @@
+/*
+ * rulemapcache.h
+ * Copyright 2026, agent <agent@local>
+ *
+ * This file is part of Tiled.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RULEMAPCACHE_H
+#define RULEMAPCACHE_H
+
+#include "rulematcher.h"
+
+#include <QDateTime>
+#include <QHash>
+#include <QSemaphore>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+namespace Tiled {
+
+class Map;
+class TileLayer;
+
+namespace Internal {
+
+/**
+ * A rules map, with its rule layers sorted out and its rules compiled. None
+ * of this depends on the map being automapped, so it is shared by the
+ * automappers of all map documents.
+ *
+ * The rules are compiled on the global thread pool. After that, the rules
+ * map is not changed anymore. The automappers translate its tiles to those
+ * of their map instead, so they can use it at the same time.
+ */
+class RuleMap
+{
+public:
+    /**
+     * Reads the rules map \a fileName and starts compiling its rules.
+     */
+    explicit RuleMap(const QString &fileName);
+
+    /**
+     * Waits for the rules to be compiled, and deletes the rules map.
+     */
+    ~RuleMap();
+
+    const QString &fileName() const { return mFileName; }
+    const QDateTime &lastModified() const { return mLastModified; }
+
+    /**
+     * Returns the rules map, or 0 when it could not be read.
+     */
+    Map *map() const { return mMap; }
+
+    /**
+     * Returns the error that occurred while reading the rules map.
+     */
+    const QString &errorString() const { return mError; }
+
+    TileLayer *ruleRegions() const { return mRuleRegions; }
+    const QVector<TileLayer*> &ruleSets() const { return mRuleSets; }
+    const QVector<TileLayer*> &ruleNotSets() const { return mRuleNotSets; }
+
+    /**
+     * Returns the other layers with the "rule" prefix, into which the tiles
+     * are copied when a rule matches.
+     */
+    const QVector<TileLayer*> &ruleOutputs() const { return mRuleOutputs; }
+
+    /**
+     * Returns the compiled rules, after waiting for them to be compiled.
+     */
+    const RuleMatcher *ruleMatcher();
+
+private:
+    Q_DISABLE_COPY(RuleMap)
+
+    friend class CompileRulesJob;
+
+    void setupRuleLayers();
+
+    QString mFileName;
+    QDateTime mLastModified;
+    Map *mMap;
+    QString mError;
+
+    TileLayer *mRuleRegions;
+    QVector<TileLayer*> mRuleSets;
+    QVector<TileLayer*> mRuleNotSets;
+    QVector<TileLayer*> mRuleOutputs;
+
+    RuleMatcher mRuleMatcher;
+    QSemaphore mCompiled;
+};
+
+/**
+ * Keeps the rules files and rules maps read for automapping, so that they
+ * are only read again when they were modified. The cache is shared by all
+ * map documents.
+ */
+class RuleMapCache
+{
+public:
+    RuleMapCache();
+    ~RuleMapCache();
+
+    /**
+     * Returns in \a lines the lines of the rules file \a fileName. Returns
+     * false when the file can not be opened.
+     */
+    bool readRulesFile(const QString &fileName, QStringList *lines);
+
+    /**
+     * Returns the rules map \a fileName. It is read again when it was
+     * modified, in which case the rules map that was returned before is
+     * deleted, so it may no longer be in use.
+     *
+     * Check RuleMap::map() to see whether the rules map could be read.
+     */
+    RuleMap *ruleMap(const QString &fileName);
+
+    /**
+     * Removes the file \a fileName from the cache, so that it is read again
+     * the next time it is needed. The rules map of the file, if any, may no
+     * longer be in use.
+     */
+    void remove(const QString &fileName);
+
+    /**
+     * Removes all files from the cache. None of the rules maps may be in use.
+     */
+    void clear();
+
+private:
+    Q_DISABLE_COPY(RuleMapCache)
+
+    struct RulesFile
+    {
+        QDateTime lastModified;
+        QStringList lines;
+    };
+
+    QHash<QString, RulesFile> mRulesFiles;
+    QHash<QString, RuleMap*> mRuleMaps;
+};
+
+} // namespace Internal
+} // namespace Tiled
+
+#endif // RULEMAPCACHE_H
@@ -0,0 +1,590 @@
+/*
+ * rulematcher.cpp
+ * Copyright 2026, agent <agent@local>
+ *
+ * This file is part of Tiled.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rulematcher.h"
+
+#include "tile.h"
+#include "tileregion.h"
+#include "tileset.h"
+
+#include <QSemaphore>
+#include <QThreadPool>
+
+using namespace Tiled;
+using namespace Tiled::Internal;
+
+RuleMatcher::RuleMatcher()
+{
+}
+
+/**
+ * Orders cells by row and then by column.
+ */
+static bool cellLessThan(const QPoint &a, const QPoint &b)
+{
+    return a.y() < b.y() || (a.y() == b.y() && a.x() < b.x());
+}
+
+/**
+ * This creates a rule from a given point.
+ * So it will be checked, which regions are coherent to this point
+ * and all these regions will be treated as a new rule,
+ * which will be returned. To check what is coherent, a
+ * depth first search will be performed, whereas each Tile is a node,
+ * and the 4 coherent tiles are connected to this node.
+ *
+ * The cells of the rule are marked in \a visited, which holds a flag for
+ * each cell of the \a regions layer.
+ */
+static QRegion createRule(const TileLayer *regions, int x, int y,
+                          QVector<bool> &visited)
+{
+    const int width = regions->width();
+    const Cell match = regions->cellAt(x, y);
+
+    QVector<QPoint> cells;
+    QVector<QPoint> addPoints;
+    addPoints.append(QPoint(x, y));
+    visited[x + y * width] = true;
+
+    while (!addPoints.isEmpty()) {
+        const QPoint current = addPoints.last();
+        addPoints.pop_back();
+        cells.append(current);
+
+        const QPoint neighbours[] = {
+            current + QPoint(-1, 0),
+            current + QPoint(1, 0),
+            current + QPoint(0, -1),
+            current + QPoint(0, 1)
+        };
+
+        for (int i = 0; i < 4; ++i) {
+            const QPoint &n = neighbours[i];
+            if (regions->contains(n)
+                    && !visited.at(n.x() + n.y() * width)
+                    && regions->cellAt(n) == match) {
+                visited[n.x() + n.y() * width] = true;
+                addPoints.append(n);
+            }
+        }
+    }
+
+    // Build up the region in row order, which is cheap for a TileRegion
+    qSort(cells.begin(), cells.end(), cellLessThan);
+
+    TileRegion rule;
+    foreach (const QPoint &cell, cells)
+        rule.addSpan(cell.x(), cell.y(), 1);
+
+    return rule.toRegion();
+}
+
+void RuleMatcher::setRules(const TileLayer *regions,
+                           const QVector<TileLayer*> &ruleSets,
+                           const QVector<TileLayer*> &ruleNotSets)
+{
+    clear();
+
+    mRuleSets = ruleSets;
+    mRuleNotSets = ruleNotSets;
+
+    // Marks the cells that are already part of a rule
+    QVector<bool> visited(regions->width() * regions->height());
+
+    for (int y = 1; y < regions->height(); y++) {
+        for (int x = 1; x < regions->width(); x++) {
+            if (!visited.at(x + y * regions->width())
+                    && !regions->cellAt(x, y).isEmpty()) {
+                compileRule(createRule(regions, x, y, visited));
+            }
+        }
+    }
+}
+
+void RuleMatcher::clear()
+{
+    mRuleSets.clear();
+    mRuleNotSets.clear();
+    mRules.clear();
+    mConditions.clear();
+    mCells.clear();
+    mIndex.clear();
+}
+
+bool RuleMatcher::containsCell(int begin, int end, const Cell &cell) const
+{
+    for (int i = begin; i < end; ++i)
+        if (mCells.at(i) == cell)
+            return true;
+    return false;
+}
+
+/**
+ * Compiles the rule covering \a region of the rules map into a condition for
+ * each of its cells.
+ *
+ * The set layer is compared to the layers in mRuleSets (listYes) and
+ * mRuleNotSets (listNo). At each position, all matches between the set layer
+ * and a layer of listYes are considered good, while all matches with a layer
+ * of listNo are considered bad. There are several cases to distinguish:
+ *
+ * - both listYes and listNo are empty:
+ *      no condition is given at all. The rule is assumed to be erroneous and
+ *      never matches.
+ *
+ * - both listYes and listNo are not empty:
+ *      the cell of the set layer needs to match one of the cells of listYes
+ *      at this position, unless there are none. It may not match any of the
+ *      cells of listNo at this position.
+ *
+ * - only listNo has layers:
+ *      the cell of the set layer may not match any of the cells of listNo at
+ *      this position.
+ *
+ * - only listYes has layers:
+ *      the cell of the set layer needs to match one of the cells of listYes
+ *      at this position. When there are none at this position, all tiles
+ *      except those used within the whole rule in listYes are allowed.
+ *
+ *      This exception was added to have a better functionality (need of less
+ *      layers). It was not added to the case when having only listNo layers
+ *      to avoid total symmetry between those lists.
+ *
+ * In any case, the set layer needs to have a cell at each position of the
+ * rule, and the rule never matches when part of it lies outside of the
+ * layers in listYes or listNo.
+ */
+void RuleMatcher::compileRule(const QRegion &region)
+{
+    const int ruleIndex = mRules.size();
+
+    Rule rule;
+    rule.region = region;
+    rule.conditionBegin = mConditions.size();
+    rule.conditionEnd = mConditions.size();
+    rule.indexed = false;
+    rule.valid = !(mRuleSets.isEmpty() && mRuleNotSets.isEmpty());
+
+    const QVector<QRect> rects = region.rects();
+
+    // Collect the cells used within the whole rule in listYes, which are
+    // forbidden where listYes has no cells when there is no listNo
+    const int usedBegin = mCells.size();
+    foreach (const QRect &rect, rects) {
+        for (int y = rect.top(); y <= rect.bottom(); ++y) {
+            for (int x = rect.left(); x <= rect.right(); ++x) {
+                foreach (const TileLayer *layer, mRuleNotSets)
+                    if (!layer->contains(x, y))
+                        rule.valid = false;
+
+                foreach (const TileLayer *layer, mRuleSets) {
+                    if (!layer->contains(x, y)) {
+                        rule.valid = false;
+                        continue;
+                    }
+
+                    const Cell cell = layer->cellAt(x, y);
+                    if (!cell.isEmpty()
+                            && !containsCell(usedBegin, mCells.size(), cell))
+                        mCells.append(cell);
+                }
+            }
+        }
+    }
+    const int usedEnd = mCells.size();
+
+    if (!rule.valid) {
+        mCells.resize(usedBegin);
+        mRules.append(rule);
+        return;
+    }
+
+    int anchor = -1;
+    int anchorAllowedCount = 0;
+
+    foreach (const QRect &rect, rects) {
+        for (int y = rect.top(); y <= rect.bottom(); ++y) {
+            for (int x = rect.left(); x <= rect.right(); ++x) {
+                Condition condition;
+                condition.pos = QPoint(x, y);
+
+                condition.allowedBegin = mCells.size();
+                foreach (const TileLayer *layer, mRuleSets) {
+                    const Cell cell = layer->cellAt(x, y);
+                    if (!cell.isEmpty() && !containsCell(condition.allowedBegin,
+                                                         mCells.size(), cell))
+                        mCells.append(cell);
+                }
+                condition.allowedEnd = mCells.size();
+
+                const int allowedCount =
+                        condition.allowedEnd - condition.allowedBegin;
+
+                if (mRuleNotSets.isEmpty() && allowedCount == 0) {
+                    condition.forbiddenBegin = usedBegin;
+                    condition.forbiddenEnd = usedEnd;
+                } else {
+                    condition.forbiddenBegin = mCells.size();
+                    foreach (const TileLayer *layer, mRuleNotSets) {
+                        const Cell cell = layer->cellAt(x, y);
+                        if (!cell.isEmpty()
+                                && !containsCell(condition.forbiddenBegin,
+                                                 mCells.size(), cell))
+                            mCells.append(cell);
+                    }
+                    condition.forbiddenEnd = mCells.size();
+                }
+
+                // The condition allowing the fewest cells is the anchor
+                if (allowedCount > 0 &&
+                        (anchor == -1 || allowedCount < anchorAllowedCount)) {
+                    anchor = mConditions.size();
+                    anchorAllowedCount = allowedCount;
+                }
+
+                mConditions.append(condition);
+            }
+        }
+    }
+
+    rule.conditionEnd = mConditions.size();
+
+    if (anchor != -1) {
+        // The anchor goes first, since it is the most likely to fail
+        qSwap(mConditions[rule.conditionBegin], mConditions[anchor]);
+
+        const Condition &condition = mConditions.at(rule.conditionBegin);
+        for (int i = condition.allowedBegin; i < condition.allowedEnd; ++i) {
+            QVector<Anchor> &anchors = mIndex[mCells.at(i).tile];
+            if (anchors.isEmpty() || anchors.last().rule != ruleIndex) {
+                Anchor a;
+                a.rule = ruleIndex;
+                a.pos = condition.pos;
+                anchors.append(a);
+            }
+        }
+
+        rule.indexed = true;
+    }
+
+    mRules.append(rule);
+}
+
+/**
+ * Returns \a cell with its tile replaced by the one of the rules map, when
+ * its tileset is mapped to one of the rules map by \a tilesets.
+ */
+static inline Cell ruleCell(const Cell &cell,
+                            const RuleMatcher::TilesetMap *tilesets)
+{
+    if (!tilesets || cell.isEmpty())
+        return cell;
+
+    const Tileset *ruleTileset = tilesets->value(cell.tile->tileset());
+    if (!ruleTileset)
+        return cell;
+
+    // Tiles the rules map lacks are left alone, and match no rule tile
+    Cell result = cell;
+    if (Tile *tile = ruleTileset->tileAt(cell.tile->id()))
+        result.tile = tile;
+    return result;
+}
+
+bool RuleMatcher::matches(int ruleIndex, const TileLayer *setLayer,
+                          const QPoint &offset,
+                          const TilesetMap *tilesets) const
+{
+    const Rule &rule = mRules.at(ruleIndex);
+    if (!rule.valid)
+        return false;
+
+    for (int i = rule.conditionBegin; i < rule.conditionEnd; ++i) {
+        const Condition &condition = mConditions.at(i);
+        const int x = condition.pos.x() + offset.x();
+        const int y = condition.pos.y() + offset.y();
+
+        if (!setLayer->contains(x, y))
+            return false;
+
+        const Cell cell = ruleCell(setLayer->cellAt(x, y), tilesets);
+
+        // When there is no tile in the set layer, there is no match at all
+        if (cell.isEmpty())
+            return false;
+
+        if (condition.allowedBegin != condition.allowedEnd &&
+                !containsCell(condition.allowedBegin, condition.allowedEnd,
+                              cell))
+            return false;
+
+        if (containsCell(condition.forbiddenBegin, condition.forbiddenEnd,
+                         cell))
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Returns the area of offsets to check for a rule with the given bounding
+ * rect when applying the rules to \a where.
+ */
+static QRect ruleSearchArea(const QRect &ruleBounds, const QRect &where)
+{
+    // Since the rule itself is translated, we need to adjust the borders of
+    // the loops. Decrease the size at all sides by one: There must be at
+    // least one tile overlap to the rule.
+    const int minX = where.left() - ruleBounds.left() - ruleBounds.width() + 1;
+    const int minY = where.top() - ruleBounds.top() - ruleBounds.height() + 1;
+
+    const int maxX = where.right() - ruleBounds.left() + ruleBounds.width() - 1;
+    const int maxY = where.bottom() - ruleBounds.top() + ruleBounds.height() - 1;
+
+    return QRect(QPoint(minX, minY), QPoint(maxX, maxY));
+}
+
+QRect RuleMatcher::searchArea(int rule, const QRect &where) const
+{
+    return ruleSearchArea(mRules.at(rule).region.boundingRect(), where);
+}
+
+/**
+ * Returns the position of the cell by which candidates for the given rule
+ * are found. For rules that are not indexed this is the top-left corner of
+ * their bounding rect.
+ */
+QPoint RuleMatcher::anchorPos(const Rule &rule) const
+{
+    if (rule.indexed)
+        return mConditions.at(rule.conditionBegin).pos;
+    return rule.region.boundingRect().topLeft();
+}
+
+/**
+ * Returns the area covered by the anchors of all candidates when applying
+ * the rules to \a where.
+ */
+QRect RuleMatcher::anchorArea(const QRect &where) const
+{
+    QRect area;
+    foreach (const Rule &rule, mRules) {
+        if (rule.valid) {
+            area |= ruleSearchArea(rule.region.boundingRect(), where)
+                    .translated(anchorPos(rule));
+        }
+    }
+    return area;
+}
+
+QVector<QVector<QPoint> > RuleMatcher::candidates(
+        const TileLayer *setLayer, const QRect &where,
+        const TilesetMap *tilesets) const
+{
+    const QRect area = anchorArea(where);
+    return candidates(setLayer, where, area.top(), area.bottom(), false,
+                      tilesets);
+}
+
+/**
+ * Returns the candidates of which the anchor is in the rows \a firstRow to
+ * \a lastRow. When \a checkMatches is set, only the candidates at which the
+ * rule matches are returned, which avoids collecting every position of the
+ * rules that are not indexed.
+ */
+QVector<QVector<QPoint> > RuleMatcher::candidates(
+        const TileLayer *setLayer, const QRect &where,
+        int firstRow, int lastRow, bool checkMatches,
+        const TilesetMap *tilesets) const
+{
+    QVector<QVector<QPoint> > result(mRules.size());
+    QVector<QRect> areas(mRules.size());
+
+    // The area of the set layer that may contain the anchors
+    QRect scanArea;
+
+    for (int i = 0; i < mRules.size(); ++i) {
+        const Rule &rule = mRules.at(i);
+        if (!rule.valid)
+            continue;
+
+        const QPoint anchor = anchorPos(rule);
+        areas[i] = ruleSearchArea(rule.region.boundingRect(), where);
+
+        if (rule.indexed) {
+            scanArea |= areas[i].translated(anchor);
+            continue;
+        }
+
+        // Without an anchor in the index, all positions are candidates
+        const QRect &area = areas.at(i);
+        const int top = qMax(area.top(), firstRow - anchor.y());
+        const int bottom = qMin(area.bottom(), lastRow - anchor.y());
+
+        for (int y = top; y <= bottom; ++y) {
+            for (int x = area.left(); x <= area.right(); ++x) {
+                const QPoint offset(x, y);
+                if (!checkMatches || matches(i, setLayer, offset, tilesets))
+                    result[i].append(offset);
+            }
+        }
+    }
+
+    scanArea &= QRect(0, 0, setLayer->width(), setLayer->height());
+
+    const int top = qMax(scanArea.top(), firstRow);
+    const int bottom = qMin(scanArea.bottom(), lastRow);
+
+    for (int y = top; y <= bottom; ++y) {
+        for (int x = scanArea.left(); x <= scanArea.right(); ++x) {
+            const Cell cell = ruleCell(setLayer->cellAt(x, y), tilesets);
+            if (cell.isEmpty())
+                continue;
+
+            QHash<const Tile*, QVector<Anchor> >::const_iterator it =
+                    mIndex.constFind(cell.tile);
+            if (it == mIndex.constEnd())
+                continue;
+
+            foreach (const Anchor &anchor, it.value()) {
+                const QPoint offset = QPoint(x, y) - anchor.pos;
+                if (!areas.at(anchor.rule).contains(offset))
+                    continue;
+                if (!checkMatches
+                        || matches(anchor.rule, setLayer, offset, tilesets))
+                    result[anchor.rule].append(offset);
+            }
+        }
+    }
+
+    return result;
+}
+
+QVector<QVector<QPoint> > RuleMatcher::findMatches(
+        const TileLayer *setLayer, const QRect &where,
+        int firstRow, int lastRow,
+        const TilesetMap *tilesets) const
+{
+    return candidates(setLayer, where, firstRow, lastRow, true, tilesets);
+}
+
+namespace {
+
+/**
+ * Bands with fewer rows than this are not worth matching on their own.
+ */
+const int MinimumBandHeight = 16;
+
+/**
+ * Finds the matches of which the anchor is within a band of rows.
+ */
+class MatchJob : public QRunnable
+{
+public:
+    MatchJob(const RuleMatcher *matcher, const TileLayer *setLayer,
+             const QRect &where, int firstRow, int lastRow,
+             const RuleMatcher::TilesetMap *tilesets,
+             QVector<QVector<QPoint> > *result, QSemaphore *done)
+        : mMatcher(matcher)
+        , mSetLayer(setLayer)
+        , mWhere(where)
+        , mFirstRow(firstRow)
+        , mLastRow(lastRow)
+        , mTilesets(tilesets)
+        , mResult(result)
+        , mDone(done)
+    {
+        setAutoDelete(false);
+    }
+
+    void run()
+    {
+        *mResult = mMatcher->findMatches(mSetLayer, mWhere,
+                                         mFirstRow, mLastRow, mTilesets);
+        if (mDone)
+            mDone->release();
+    }
+
+private:
+    const RuleMatcher *mMatcher;
+    const TileLayer *mSetLayer;
+    QRect mWhere;
+    int mFirstRow;
+    int mLastRow;
+    const RuleMatcher::TilesetMap *mTilesets;
+    QVector<QVector<QPoint> > *mResult;
+    QSemaphore *mDone;
+};
+
+/**
+ * The bands are matched on their own pool, because findMatches() is itself
+ * called from jobs on the global thread pool while automapping live. Waiting
+ * there for bands queued behind those jobs could block all of its threads.
+ */
+Q_GLOBAL_STATIC(QThreadPool, matchThreadPool)
+
+} // anonymous namespace
+
+QVector<QVector<QPoint> > RuleMatcher::findMatches(
+        const TileLayer *setLayer, const QRect &where,
+        const TilesetMap *tilesets) const
+{
+    const QRect area = anchorArea(where);
+    if (area.isEmpty())
+        return QVector<QVector<QPoint> >(mRules.size());
+
+    QThreadPool *pool = matchThreadPool();
+    const int threads = pool->maxThreadCount();
+    const int parts = qBound(1, area.height() / MinimumBandHeight,
+                             qMax(1, threads));
+
+    if (parts == 1)
+        return findMatches(setLayer, where, area.top(), area.bottom(),
+                           tilesets);
+
+    QVector<QVector<QVector<QPoint> > > bandResults(parts);
+    QSemaphore done;
+    QList<QRunnable*> jobs;
+
+    for (int i = 0; i < parts; ++i) {
+        const int firstRow = area.top() + area.height() * i / parts;
+        const int lastRow = area.top() + area.height() * (i + 1) / parts - 1;
+        jobs.append(new MatchJob(this, setLayer, where, firstRow, lastRow,
+                                 tilesets, &bandResults[i],
+                                 i < parts - 1 ? &done : 0));
+    }
+
+    // The last band is matched on the calling thread
+    for (int i = 0; i < parts - 1; ++i)
+        pool->start(jobs.at(i));
+
+    jobs.last()->run();
+    done.acquire(parts - 1);
+    qDeleteAll(jobs);
+
+    // Joining the bands in order keeps the offsets in row order
+    QVector<QVector<QPoint> > result(mRules.size());
+    for (int rule = 0; rule < mRules.size(); ++rule)
+        for (int i = 0; i < parts; ++i)
+            result[rule] += bandResults.at(i).at(rule);
+
+    return result;
+}
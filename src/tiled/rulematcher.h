@@ -0,0 +1,180 @@
+/*
+ * rulematcher.h
+ * Copyright 2026, agent <agent@local>
+ *
+ * This file is part of Tiled.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RULEMATCHER_H
+#define RULEMATCHER_H
+
+#include "tilelayer.h"
+
+#include <QHash>
+#include <QRegion>
+#include <QVector>
+
+namespace Tiled {
+
+class Tile;
+class Tileset;
+
+namespace Internal {
+
+/**
+ * Finds the rules in the layers of an AutoMapping rules map and checks
+ * where they match the set layer of a map.
+ *
+ * The rules are compiled into a flat list of conditions, one for each cell
+ * of a rule. For each rule, the condition allowing the fewest tiles is used
+ * as its anchor. An index from those tiles to the rules makes it possible to
+ * find the places where a rule may match by looking at each cell of the set
+ * layer only once, rather than by comparing each rule at every position.
+ */
+class RuleMatcher
+{
+public:
+    /**
+     * Maps tilesets of the map being automapped to the similar tilesets of
+     * the rules map. The cells of the set layer are compared as if they used
+     * the tiles of the rules map instead.
+     */
+    typedef QHash<Tileset*, Tileset*> TilesetMap;
+
+    RuleMatcher();
+
+    /**
+     * Finds the rules defined in the \a regions layer and compiles them,
+     * using the conditions given by the \a ruleSets and \a ruleNotSets
+     * layers.
+     */
+    void setRules(const TileLayer *regions,
+                  const QVector<TileLayer*> &ruleSets,
+                  const QVector<TileLayer*> &ruleNotSets);
+
+    /**
+     * Removes all rules.
+     */
+    void clear();
+
+    int ruleCount() const { return mRules.size(); }
+
+    /**
+     * Returns the region of the rules map covered by the given \a rule.
+     */
+    const QRegion &ruleRegion(int rule) const
+    { return mRules.at(rule).region; }
+
+    /**
+     * Returns whether the given \a rule matches the set layer when it is
+     * moved by \a offset. The tiles of the set layer are translated using
+     * \a tilesets, when given.
+     */
+    bool matches(int rule, const TileLayer *setLayer,
+                 const QPoint &offset,
+                 const TilesetMap *tilesets = 0) const;
+
+    /**
+     * Returns the area of offsets at which the given \a rule needs to be
+     * checked when applying the rules to \a where.
+     */
+    QRect searchArea(int rule, const QRect &where) const;
+
+    /**
+     * Returns for each rule the offsets within searchArea() at which its
+     * anchor matches the set layer, in row order. These are the only offsets
+     * at which the rule can match, but matches() still needs to be checked
+     * for each of them. For rules without an anchor, this is every offset.
+     */
+    QVector<QVector<QPoint> > candidates(const TileLayer *setLayer,
+                                         const QRect &where,
+                                         const TilesetMap *tilesets = 0) const;
+
+    /**
+     * Returns for each rule the offsets within searchArea() at which it
+     * matches the set layer, in row order.
+     *
+     * The candidates are split into bands by the row of their anchor, and
+     * the bands are matched on a thread pool of their own. The set layer may
+     * not be changed while this function runs.
+     */
+    QVector<QVector<QPoint> > findMatches(const TileLayer *setLayer,
+                                          const QRect &where,
+                                          const TilesetMap *tilesets = 0) const;
+
+    /**
+     * Returns for each rule the offsets at which it matches the set layer,
+     * like findMatches(), but only for the candidates of which the anchor is
+     * in the rows \a firstRow to \a lastRow. Does not use any threads.
+     */
+    QVector<QVector<QPoint> > findMatches(const TileLayer *setLayer,
+                                          const QRect &where,
+                                          int firstRow, int lastRow,
+                                          const TilesetMap *tilesets = 0) const;
+
+private:
+    /**
+     * The condition a rule puts on one cell of the set layer. The cell must
+     * not be empty, must be one of the allowed cells when there are any,
+     * and must not be one of the forbidden cells.
+     */
+    struct Condition
+    {
+        QPoint pos;
+        int allowedBegin;
+        int allowedEnd;
+        int forbiddenBegin;
+        int forbiddenEnd;
+    };
+
+    struct Rule
+    {
+        QRegion region;
+        int conditionBegin;
+        int conditionEnd;
+        bool indexed;       // Whether the first condition is in the index
+        bool valid;         // False for rules that can never match
+    };
+
+    struct Anchor
+    {
+        int rule;
+        QPoint pos;
+    };
+
+    void compileRule(const QRegion &region);
+    QPoint anchorPos(const Rule &rule) const;
+    QRect anchorArea(const QRect &where) const;
+    QVector<QVector<QPoint> > candidates(const TileLayer *setLayer,
+                                         const QRect &where,
+                                         int firstRow, int lastRow,
+                                         bool checkMatches,
+                                         const TilesetMap *tilesets) const;
+    bool containsCell(int begin, int end, const Cell &cell) const;
+
+    QVector<TileLayer*> mRuleSets;
+    QVector<TileLayer*> mRuleNotSets;
+
+    QVector<Rule> mRules;
+    QVector<Condition> mConditions;
+    QVector<Cell> mCells;
+    QHash<const Tile*, QVector<Anchor> > mIndex;
+};
+
+} // namespace Internal
+} // namespace Tiled
+
+#endif // RULEMATCHER_H
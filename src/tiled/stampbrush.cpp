@@ -265,8 +265,8 @@ void StampBrush::configureBrush(const QVector<QPoint> &list)
     if (!mStamp)
         return;
 
-    QRegion reg;
-    QRegion stampRegion(mStamp->region());
+    TileRegion reg;
+    const TileRegion stampRegion = mStamp->region();
 
     Map *map = mapDocument()->map();
 
@@ -274,10 +274,10 @@ void StampBrush::configureBrush(const QVector<QPoint> &list)
                                      map->width(), map->height());
 
     foreach (QPoint p, list) {
-        const QRegion update = stampRegion.translated(p.x() - mStampX,
-                                                      p.y() - mStampY);
+        const TileRegion update = stampRegion.translated(p.x() - mStampX,
+                                                         p.y() - mStampY);
         if (!reg.intersects(update)) {
-            reg += update;
+            reg |= update;
             stamp->merge(p, mStamp);
         }
     }
@@ -39,7 +39,9 @@ OBJECTS_DIR = .obj
 
 SOURCES += aboutdialog.cpp \
     automap.cpp \
+    automappingchanges.cpp \
     brushitem.cpp \
+    dirtytiles.cpp \
     documentmanager.cpp \
     filesystemwatcher.cpp \
     languagemanager.cpp \
@@ -118,11 +120,15 @@ SOURCES += aboutdialog.cpp \
     imagelayeritem.cpp \
     imagelayerpropertiesdialog.cpp \
     changeimagelayerproperties.cpp \
-    gridstylesmodel.cpp
+    gridstylesmodel.cpp \
+    rulematcher.cpp \
+    rulemapcache.cpp
 
 HEADERS += aboutdialog.h \
     automap.h \
+    automappingchanges.h \
     brushitem.h \
+    dirtytiles.h \
     documentmanager.h \
     filesystemwatcher.h \
     languagemanager.h \
@@ -203,7 +209,9 @@ HEADERS += aboutdialog.h \
     imagelayeritem.h \
     imagelayerpropertiesdialog.h \
     changeimagelayerproperties.h \
-    gridstylesmodel.h
+    gridstylesmodel.h \
+    rulematcher.h \
+    rulemapcache.h
 
 FORMS += aboutdialog.ui \
     mainwindow.ui \
@@ -28,12 +28,27 @@
 #include <QPainter>
 #include <QStyleOptionGraphicsItem>
 
+#include <cmath>
+
 using namespace Tiled;
 using namespace Tiled::Internal;
 
+// The minimum number of chunks kept in the cache, which is about 16 MB
+static const int MinimumCachedChunks = 64;
+
+// Tiles drawn smaller than this many pixels are drawn using the overview
+static const qreal MinimumTilePixels = 4;
+
+static inline quint64 chunkKey(int x, int y)
+{
+    return (quint64(quint32(x)) << 32) | quint32(y);
+}
+
 TileLayerItem::TileLayerItem(TileLayer *layer, MapRenderer *renderer)
     : mLayer(layer)
     , mRenderer(renderer)
+    , mChunks(MinimumCachedChunks)
+    , mCacheScale(0)
 {
     setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
 
@@ -45,6 +60,45 @@ void TileLayerItem::syncWithTileLayer()
 {
     prepareGeometryChange();
     mBoundingRect = mRenderer->boundingRect(mLayer->bounds());
+    invalidateCache();
+}
+
+void TileLayerItem::invalidateRegion(const QRegion &region)
+{
+    if (!mOverview.isNull()) {
+        const QPoint layerPos(mLayer->x(), mLayer->y());
+        foreach (const QRect &r, region.rects())
+            updateOverview(r.translated(-layerPos));
+    }
+
+    if (mChunks.isEmpty())
+        return;
+
+    const QSize extra = mLayer->map()->extraTileSize();
+    const qreal chunkSize = ChunkPixels / mCacheScale;
+
+    foreach (const QRect &r, region.rects()) {
+        const QRectF changed = QRectF(mRenderer->boundingRect(r))
+                .adjusted(0, -extra.height(), extra.width(), 0);
+
+        foreach (quint64 key, mChunks.keys()) {
+            const int x = qint32(key >> 32);
+            const int y = qint32(key & 0xFFFFFFFF);
+            const QRectF chunkRect(x * chunkSize, y * chunkSize,
+                                   chunkSize, chunkSize);
+
+            if (chunkRect.intersects(changed))
+                mChunks.remove(key);
+        }
+    }
+}
+
+void TileLayerItem::invalidateCache()
+{
+    mChunks.clear();
+    mChunks.setMaxCost(MinimumCachedChunks);
+    mOverview = QImage();
+    update();
 }
 
 QRectF TileLayerItem::boundingRect() const
@@ -57,5 +111,134 @@ void TileLayerItem::paint(QPainter *painter,
                           QWidget *)
 {
     // TODO: Display a border around the layer when selected
-    mRenderer->drawTileLayer(painter, mLayer, option->exposedRect);
+
+    // The cache is only used when the view is scaled evenly, without
+    // rotation or shearing
+    const QTransform transform = painter->worldTransform();
+
+    // Drawing the tiles is pointless when they are this small
+    const qreal tileScale = std::sqrt(qAbs(transform.determinant()));
+    if (mLayer->map()->tileWidth() * tileScale < MinimumTilePixels) {
+        drawOverview(painter);
+        return;
+    }
+
+    if (transform.type() > QTransform::TxScale
+            || transform.m11() != transform.m22()
+            || transform.m11() <= 0) {
+        mRenderer->drawTileLayer(painter, mLayer, option->exposedRect);
+        return;
+    }
+
+    const qreal scale = transform.m11();
+    if (scale != mCacheScale) {
+        mChunks.clear();
+        mChunks.setMaxCost(MinimumCachedChunks);
+        mCacheScale = scale;
+    }
+
+    const QRectF exposed = option->exposedRect & mBoundingRect;
+    if (exposed.isEmpty())
+        return;
+
+    // The chunk size in item coordinates
+    const qreal chunkSize = ChunkPixels / scale;
+
+    const int startX = (int) std::floor(exposed.left() / chunkSize);
+    const int startY = (int) std::floor(exposed.top() / chunkSize);
+    const int endX = (int) std::floor(exposed.right() / chunkSize);
+    const int endY = (int) std::floor(exposed.bottom() / chunkSize);
+
+    // Make sure the cache can hold at least all visible chunks
+    const int visibleChunks = (endX - startX + 1) * (endY - startY + 1);
+    if (visibleChunks * 2 > mChunks.maxCost())
+        mChunks.setMaxCost(visibleChunks * 2);
+
+    const QRectF source(0, 0, ChunkPixels, ChunkPixels);
+
+    for (int y = startY; y <= endY; ++y) {
+        for (int x = startX; x <= endX; ++x) {
+            const QRectF target(x * chunkSize, y * chunkSize,
+                                chunkSize, chunkSize);
+            painter->drawPixmap(target, *chunkPixmap(x, y, painter), source);
+        }
+    }
+}
+
+/**
+ * Returns the pixmap of the chunk at the given chunk coordinates, rendering
+ * it first when it is not in the cache. The returned pointer is only valid
+ * until the next chunk is rendered.
+ */
+const QPixmap *TileLayerItem::chunkPixmap(int x, int y, QPainter *painter)
+{
+    const quint64 key = chunkKey(x, y);
+    if (const QPixmap *pixmap = mChunks.object(key))
+        return pixmap;
+
+    const qreal chunkSize = ChunkPixels / mCacheScale;
+    const QRectF chunkRect(x * chunkSize, y * chunkSize,
+                           chunkSize, chunkSize);
+
+    QPixmap *pixmap = new QPixmap(ChunkPixels, ChunkPixels);
+    pixmap->fill(Qt::transparent);
+
+    QPainter chunkPainter(pixmap);
+    chunkPainter.setRenderHints(painter->renderHints());
+    chunkPainter.scale(mCacheScale, mCacheScale);
+    chunkPainter.translate(-chunkRect.topLeft());
+    mRenderer->drawTileLayer(&chunkPainter, mLayer, chunkRect);
+    chunkPainter.end();
+
+    mChunks.insert(key, pixmap);
+    return pixmap;
+}
+
+/**
+ * Draws the layer as its overview image, creating it first when needed. The
+ * image is stretched so that each of its pixels covers the area of a cell.
+ */
+void TileLayerItem::drawOverview(QPainter *painter)
+{
+    if (mOverview.isNull()) {
+        mOverview = QImage(mLayer->width(), mLayer->height(),
+                           QImage::Format_ARGB32_Premultiplied);
+        updateOverview(mOverview.rect());
+    }
+
+    // Both orthogonal and isometric projections are affine, so the way the
+    // renderer places a cell follows from the placement of its corners
+    const QPointF origin = mRenderer->tileToPixelCoords(mLayer->x(),
+                                                        mLayer->y());
+    const QPointF right = mRenderer->tileToPixelCoords(mLayer->x() + 1,
+                                                       mLayer->y());
+    const QPointF down = mRenderer->tileToPixelCoords(mLayer->x(),
+                                                      mLayer->y() + 1);
+    const QTransform cellTransform(right.x() - origin.x(),
+                                   right.y() - origin.y(),
+                                   down.x() - origin.x(),
+                                   down.y() - origin.y(),
+                                   origin.x(), origin.y());
+
+    painter->save();
+    painter->setTransform(cellTransform, true);
+    painter->drawImage(0, 0, mOverview);
+    painter->restore();
+}
+
+/**
+ * Updates the pixels of the overview image for the cells in \a rect, given
+ * in layer coordinates.
+ */
+void TileLayerItem::updateOverview(const QRect &rect)
+{
+    const QRect area = rect & mOverview.rect();
+
+    for (int y = area.top(); y <= area.bottom(); ++y) {
+        QRgb *pixel = reinterpret_cast<QRgb*>(mOverview.scanLine(y));
+        for (int x = area.left(); x <= area.right(); ++x) {
+            const Cell cell = mLayer->cellAt(x, y);
+            pixel[x] = cell.isEmpty() ? 0 : cell.tile->averageColor();
+        }
+    }
 }
@@ -21,7 +21,10 @@
 #ifndef TILELAYERITEM_H
 #define TILELAYERITEM_H
 
+#include <QCache>
 #include <QGraphicsItem>
+#include <QImage>
+#include <QPixmap>
 
 namespace Tiled {
 
@@ -32,6 +35,15 @@ namespace Internal {
 
 /**
  * A graphics item displaying a tile layer in a QGraphicsView.
+ *
+ * The layer is rendered in chunks of a fixed size on the screen, which are
+ * cached as pixmaps. Repainting the layer while scrolling only needs to draw
+ * these pixmaps. The cache is cleared when the zoom level changes, and needs
+ * to be invalidated when the layer changes.
+ *
+ * When zoomed out so far that the tiles become only a few pixels in size,
+ * the layer is instead drawn as an overview image with one pixel per cell,
+ * colored with the average color of its tile.
  */
 class TileLayerItem : public QGraphicsItem
 {
@@ -54,6 +66,18 @@ public:
      */
     void syncWithTileLayer();
 
+    /**
+     * Discards the cached rendering of the given \a region, in tile
+     * coordinates. Does not schedule a repaint.
+     */
+    void invalidateRegion(const QRegion &region);
+
+    /**
+     * Discards all cached rendering of the layer and schedules a repaint.
+     * Needed when for example the image of a used tileset changed.
+     */
+    void invalidateCache();
+
     // QGraphicsItem
     QRectF boundingRect() const;
     void paint(QPainter *painter,
@@ -61,9 +85,22 @@ public:
                QWidget *widget = 0);
 
 private:
+    // Size in device pixels of the cached chunks
+    enum { ChunkPixels = 256 };
+
+    const QPixmap *chunkPixmap(int x, int y, QPainter *painter);
+
+    void drawOverview(QPainter *painter);
+    void updateOverview(const QRect &rect);
+
     TileLayer *mLayer;
     MapRenderer *mRenderer;
     QRectF mBoundingRect;
+
+    QCache<quint64, QPixmap> mChunks;
+    qreal mCacheScale;
+
+    QImage mOverview;
 };
 
 } // namespace Internal
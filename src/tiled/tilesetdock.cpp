@@ -297,10 +297,10 @@ void TilesetDock::removeTileset(int index)
         undoStack->beginMacro(remove->text());
         foreach (Layer *layer, mMapDocument->map()->layers()) {
             if (TileLayer *tileLayer = layer->asTileLayer()) {
-                const QRegion refs = tileLayer->tilesetReferences(tileset);
+                const TileRegion refs = tileLayer->tilesetReferences(tileset);
                 if (!refs.isEmpty()) {
-                    undoStack->push(new EraseTiles(mMapDocument,
-                                                   tileLayer, refs));
+                    undoStack->push(new EraseTiles(mMapDocument, tileLayer,
+                                                   refs.toRegion()));
                 }
             } else if (ObjectGroup *objectGroup = layer->asObjectGroup()) {
                 foreach (MapObject *object, objectGroup->objects()) {
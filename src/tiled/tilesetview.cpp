@@ -69,15 +69,19 @@ void TileDelegate::paint(QPainter *painter,
                          const QStyleOptionViewItem &option,
                          const QModelIndex &index) const
 {
-    // Draw the tile image
-    const QVariant display = index.model()->data(index, Qt::DisplayRole);
-    const QPixmap tileImage = display.value<QPixmap>();
+    // Draw the tile image, straight from the image of its tileset
+    const TilesetModel *m = static_cast<const TilesetModel*>(index.model());
+    const Tile *tile = m->tileAt(index);
+    if (!tile)
+        return;
+
     const int extra = mTilesetView->drawGrid() ? -1 : 0;
 
     if (mTilesetView->zoomable()->smoothTransform())
         painter->setRenderHint(QPainter::SmoothPixmapTransform);
 
-    painter->drawPixmap(option.rect.adjusted(0, 0, extra, extra), tileImage);
+    painter->drawPixmap(option.rect.adjusted(0, 0, extra, extra),
+                        tile->atlas(), tile->imageRect());
 
     // Overlay with highlight color when selected
     if (option.state & QStyle::State_Selected) {
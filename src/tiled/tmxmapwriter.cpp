@@ -35,6 +35,8 @@ bool TmxMapWriter::write(const Map *map, const QString &fileName)
     MapWriter writer;
     writer.setLayerDataFormat(prefs->layerDataFormat());
     writer.setDtdEnabled(prefs->dtdEnabled());
+    writer.setCompressionLevel(prefs->compressionLevel());
+    writer.setCompressionStrategy(prefs->compressionStrategy());
 
     bool result = writer.writeMap(map, fileName);
     if (!result)
@@ -0,0 +1,150 @@
+#include "automappingchanges.h"
+#include "map.h"
+#include "tilelayer.h"
+#include "tileset.h"
+
+#include <QImage>
+#include <QtTest/QtTest>
+
+using namespace Tiled;
+using namespace Tiled::Internal;
+
+class test_AutoMappingChanges : public QObject
+{
+    Q_OBJECT
+
+public:
+    test_AutoMappingChanges();
+    ~test_AutoMappingChanges();
+
+private slots:
+    void applyRestoresCells();
+    void mergedChangesUndoToOriginal();
+
+private:
+    Map *createMap();
+    Cell cell(int index) const { return Cell(mTileset->tileAt(index)); }
+
+    Tileset *mTileset;
+};
+
+test_AutoMappingChanges::test_AutoMappingChanges()
+{
+    QImage image(128, 32, QImage::Format_ARGB32);
+    image.fill(0xff808080);
+
+    mTileset = new Tileset(QLatin1String("tiles"), 32, 32);
+    mTileset->loadFromImage(image, QString());
+}
+
+test_AutoMappingChanges::~test_AutoMappingChanges()
+{
+    delete mTileset;
+}
+
+/**
+ * Returns a map with a "ground" and a "walls" layer, with some cells set.
+ */
+Map *test_AutoMappingChanges::createMap()
+{
+    Map *map = new Map(Map::Orthogonal, 20, 20, 32, 32);
+    map->addTileset(mTileset);
+
+    TileLayer *ground = new TileLayer(QLatin1String("ground"), 0, 0, 20, 20);
+    for (int x = 0; x < 20; ++x)
+        ground->setCell(x, 5, cell(0));
+    map->addLayer(ground);
+
+    map->addLayer(new TileLayer(QLatin1String("walls"), 0, 0, 20, 20));
+    return map;
+}
+
+static TileLayer *layer(Map *map, const char *name)
+{
+    const int index = map->indexOfLayer(QLatin1String(name));
+    return map->layerAt(index)->asTileLayer();
+}
+
+static TileLayer *cloneLayer(const TileLayer *layer)
+{
+    return static_cast<TileLayer*>(layer->clone());
+}
+
+void test_AutoMappingChanges::applyRestoresCells()
+{
+    QScopedPointer<Map> map(createMap());
+    TileLayer *ground = layer(map.data(), "ground");
+    QScopedPointer<TileLayer> original(cloneLayer(ground));
+
+    ground->setCell(3, 5, cell(1));
+    ground->setCell(4, 6, cell(2));
+    ground->setCell(7, 5, Cell());
+
+    AutoMappingChanges changes;
+    changes.addLayer(ground->name(), *original, *ground);
+    QVERIFY(!changes.isEmpty());
+
+    QScopedPointer<TileLayer> after(cloneLayer(ground));
+
+    QRegion changed = changes.apply(map.data(), false);
+    QCOMPARE(changed, QRegion(3, 5, 1, 1) | QRegion(4, 6, 1, 1)
+                      | QRegion(7, 5, 1, 1));
+    QVERIFY(ground->differences(*original).isEmpty());
+
+    changed = changes.apply(map.data(), true);
+    QCOMPARE(changed.rects().size(), 3);
+    QVERIFY(ground->differences(*after).isEmpty());
+}
+
+/**
+ * Two passes of automapping are merged, like when live automapping merges
+ * into a paint command. Undoing the merged changes needs to give the cells
+ * from before the first pass, also where the passes changed the same cells.
+ */
+void test_AutoMappingChanges::mergedChangesUndoToOriginal()
+{
+    QScopedPointer<Map> map(createMap());
+    TileLayer *ground = layer(map.data(), "ground");
+    TileLayer *walls = layer(map.data(), "walls");
+
+    QScopedPointer<TileLayer> originalGround(cloneLayer(ground));
+    QScopedPointer<TileLayer> originalWalls(cloneLayer(walls));
+
+    // The first pass only changes the ground
+    for (int x = 2; x < 8; ++x)
+        ground->setCell(x, 5, cell(1));
+
+    AutoMappingChanges changes;
+    changes.addLayer(ground->name(), *originalGround, *ground);
+
+    // The second pass changes some of the same cells, and the walls
+    QScopedPointer<TileLayer> groundBefore(cloneLayer(ground));
+    QScopedPointer<TileLayer> wallsBefore(cloneLayer(walls));
+
+    for (int x = 6; x < 12; ++x)
+        ground->setCell(x, 5, cell(2));
+    walls->setCell(6, 4, cell(3));
+
+    AutoMappingChanges later;
+    later.addLayer(ground->name(), *groundBefore, *ground);
+    later.addLayer(walls->name(), *wallsBefore, *walls);
+
+    changes.merge(later);
+
+    QScopedPointer<TileLayer> finalGround(cloneLayer(ground));
+    QScopedPointer<TileLayer> finalWalls(cloneLayer(walls));
+
+    changes.apply(map.data(), false);
+    QVERIFY(ground->differences(*originalGround).isEmpty());
+    QVERIFY(walls->differences(*originalWalls).isEmpty());
+    QCOMPARE(ground->cellAt(6, 5), cell(0));
+
+    changes.apply(map.data(), true);
+    QVERIFY(ground->differences(*finalGround).isEmpty());
+    QVERIFY(walls->differences(*finalWalls).isEmpty());
+    QCOMPARE(ground->cellAt(6, 5), cell(2));
+    QCOMPARE(ground->cellAt(3, 5), cell(1));
+}
+
+QTEST_MAIN(test_AutoMappingChanges)
+#include "test_automappingchanges.moc"
@@ -0,0 +1,85 @@
+#include "dirtytiles.h"
+#include "map.h"
+#include "orthogonalrenderer.h"
+
+#include <QtTest/QtTest>
+
+using namespace Tiled;
+using namespace Tiled::Internal;
+
+class test_DirtyTiles : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void singleRect();
+    void fragmentedRegion();
+};
+
+static qint64 totalArea(const QVector<QRect> &rects)
+{
+    qint64 total = 0;
+    foreach (const QRect &r, rects)
+        total += qint64(r.width()) * r.height();
+    return total;
+}
+
+void test_DirtyTiles::singleRect()
+{
+    Map map(Map::Orthogonal, 100, 100, 32, 32);
+    OrthogonalRenderer renderer(&map);
+
+    DirtyTiles dirtyTiles;
+    dirtyTiles.add(TileRegion(QRect(2, 3, 4, 5)));
+
+    const QVector<QRect> rects = dirtyTiles.takeRects(&renderer, QSize());
+    QCOMPARE(rects.size(), 1);
+    QCOMPARE(rects.first(), QRect(64, 96, 128, 160));
+    QCOMPARE(dirtyTiles.repaintedPixels(), qint64(128 * 160));
+    QVERIFY(dirtyTiles.isEmpty());
+}
+
+/**
+ * A scattered set of changed tiles has to be combined into at most MaxRects
+ * rects, which still need to cover all of the changed tiles.
+ */
+void test_DirtyTiles::fragmentedRegion()
+{
+    Map map(Map::Orthogonal, 200, 200, 32, 32);
+    OrthogonalRenderer renderer(&map);
+
+    TileRegion changed;
+    for (int y = 0; y < 200; y += 3)
+        for (int x = (y * 7) % 5; x < 200; x += 5)
+            changed.addRect(QRect(x, y, 1, 1));
+    QVERIFY(changed.rects().size() > DirtyTiles::MaxRects);
+
+    DirtyTiles dirtyTiles;
+    dirtyTiles.add(changed);
+
+    const QSize extra(0, 32);
+    const QVector<QRect> rects = dirtyTiles.takeRects(&renderer, extra);
+    QVERIFY(!rects.isEmpty());
+    QVERIFY(rects.size() <= DirtyTiles::MaxRects);
+    QCOMPARE(dirtyTiles.repaintedPixels(), totalArea(rects));
+
+    foreach (const QRect &tiles, changed.rects()) {
+        for (int y = tiles.top(); y <= tiles.bottom(); ++y) {
+            for (int x = tiles.left(); x <= tiles.right(); ++x) {
+                const QRect pixels = renderer.boundingRect(QRect(x, y, 1, 1))
+                        .adjusted(0, -extra.height(), extra.width(), 0);
+                bool covered = false;
+                foreach (const QRect &r, rects)
+                    covered |= r.contains(pixels);
+                QVERIFY(covered);
+            }
+        }
+    }
+
+    // Nothing changed since, so the next flush repaints nothing
+    QVERIFY(dirtyTiles.takeRects(&renderer, extra).isEmpty());
+    QCOMPARE(dirtyTiles.repaintedPixels(), qint64(0));
+}
+
+QTEST_MAIN(test_DirtyTiles)
+#include "test_dirtytiles.moc"
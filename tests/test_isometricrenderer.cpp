@@ -0,0 +1,159 @@
+#include "isometricrenderer.h"
+#include "map.h"
+#include "tilelayer.h"
+#include "tileset.h"
+
+#include <QPainter>
+#include <QtTest/QtTest>
+
+using namespace Tiled;
+
+class test_IsometricRenderer : public QObject
+{
+    Q_OBJECT
+
+public:
+    test_IsometricRenderer();
+    ~test_IsometricRenderer();
+
+private slots:
+    void exposedAreaMatchesFullDraw_data();
+    void exposedAreaMatchesFullDraw();
+
+    void benchmarkZoomedOut_data();
+    void benchmarkZoomedOut();
+
+private:
+    Map *createMap(int width, int height);
+
+    Tileset *mTileset;
+};
+
+test_IsometricRenderer::test_IsometricRenderer()
+{
+    // A tileset of 16 differently colored tiles
+    QImage image(256, 128, QImage::Format_ARGB32);
+    for (int i = 0; i < 16; ++i) {
+        QPainter painter(&image);
+        painter.fillRect((i % 4) * 64, (i / 4) * 32, 64, 32,
+                         QColor::fromHsv(i * 22, 255, 255));
+    }
+
+    mTileset = new Tileset(QLatin1String("tiles"), 64, 32);
+    mTileset->loadFromImage(image, QString());
+}
+
+test_IsometricRenderer::~test_IsometricRenderer()
+{
+    delete mTileset;
+}
+
+/**
+ * Returns an isometric map with a single tile layer filled with a pattern of
+ * tiles.
+ */
+Map *test_IsometricRenderer::createMap(int width, int height)
+{
+    Map *map = new Map(Map::Isometric, width, height, 64, 32);
+    map->addTileset(mTileset);
+
+    TileLayer *layer = new TileLayer(QLatin1String("Layer"),
+                                     0, 0, width, height);
+    map->addLayer(layer);
+
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            if ((x + y) % 5 != 0)
+                layer->setCell(x, y, Cell(mTileset->tileAt((x * 3 + y) % 16)));
+
+    return map;
+}
+
+void test_IsometricRenderer::exposedAreaMatchesFullDraw_data()
+{
+    QTest::addColumn<QRect>("exposed");
+
+    QTest::newRow("inside") << QRect(700, 300, 200, 150);
+    QTest::newRow("left corner") << QRect(-20, 480, 300, 100);
+    QTest::newRow("top corner") << QRect(900, -10, 250, 90);
+    QTest::newRow("bottom corner") << QRect(1100, 1020, 300, 200);
+    QTest::newRow("outside") << QRect(-400, -300, 200, 200);
+    QTest::newRow("odd offsets") << QRect(333, 517, 111, 77);
+}
+
+/**
+ * Drawing only the exposed area should give the same pixels in that area as
+ * drawing the whole layer.
+ */
+void test_IsometricRenderer::exposedAreaMatchesFullDraw()
+{
+    QFETCH(QRect, exposed);
+
+    Map *map = createMap(40, 30);
+    TileLayer *layer = map->layerAt(0)->asTileLayer();
+    IsometricRenderer renderer(map);
+
+    const QTransform transform = QTransform::fromTranslate(-exposed.x(),
+                                                           -exposed.y());
+    QImage full(exposed.size(), QImage::Format_ARGB32_Premultiplied);
+    QImage partial(exposed.size(), QImage::Format_ARGB32_Premultiplied);
+    full.fill(0);
+    partial.fill(0);
+
+    QPainter painter(&full);
+    painter.setWorldTransform(transform);
+    renderer.drawTileLayer(&painter, layer, QRectF());
+    painter.end();
+
+    painter.begin(&partial);
+    painter.setWorldTransform(transform);
+    renderer.drawTileLayer(&painter, layer, exposed);
+    painter.end();
+
+    QVERIFY(full == partial);
+
+    delete map;
+}
+
+void test_IsometricRenderer::benchmarkZoomedOut_data()
+{
+    QTest::addColumn<qreal>("scale");
+
+    QTest::newRow("12.5%") << qreal(0.125);
+    QTest::newRow("25%") << qreal(0.25);
+    QTest::newRow("50%") << qreal(0.5);
+}
+
+/**
+ * Measures the time it takes to paint a frame of a wide isometric map, with
+ * the view centered on the map.
+ */
+void test_IsometricRenderer::benchmarkZoomedOut()
+{
+    QFETCH(qreal, scale);
+
+    Map *map = createMap(2000, 250);
+    TileLayer *layer = map->layerAt(0)->asTileLayer();
+    IsometricRenderer renderer(map);
+
+    QImage frame(1920, 1080, QImage::Format_ARGB32_Premultiplied);
+    const QRectF bounds = renderer.boundingRect(layer->bounds());
+
+    QTransform transform;
+    transform.translate(frame.width() / 2, frame.height() / 2);
+    transform.scale(scale, scale);
+    transform.translate(-bounds.center().x(), -bounds.center().y());
+    const QRectF exposed = transform.inverted().mapRect(QRectF(frame.rect()));
+
+    QBENCHMARK {
+        frame.fill(0);
+        QPainter painter(&frame);
+        painter.setWorldTransform(transform);
+        renderer.drawTileLayer(&painter, layer, exposed);
+    }
+
+    delete map;
+}
+
+QTEST_MAIN(test_IsometricRenderer)
+#include "test_isometricrenderer.moc"
@@ -2,7 +2,9 @@
 #include "mapobject.h"
 #include "objectgroup.h"
 #include "tilelayer.h"
+#include "tileset.h"
 #include "mapreader.h"
+#include "mapwriter.h"
 
 #include <QtTest/QtTest>
 
@@ -14,6 +16,12 @@ class test_MapReader : public QObject
 
 private slots:
     void loadMap();
+    void firstCorruptLayerReported();
+    void largeFirstGidNotWrapped();
+
+    void benchmarkLoadLargeLayer_data();
+    void benchmarkLoadLargeLayer();
+    void benchmarkLoadManyLayers();
 };
 
 void test_MapReader::loadMap()
@@ -53,5 +61,160 @@ void test_MapReader::loadMap()
     QCOMPARE(mapObject->height(), qreal(64) / qreal(map->tileHeight()));
 }
 
+void test_MapReader::firstCorruptLayerReported()
+{
+    // Both the second and the third layer are corrupt, which should report
+    // the second one regardless of which layer finished decoding first
+    QByteArray data(
+            "<map version=\"1.0\" orientation=\"orthogonal\""
+            " width=\"2\" height=\"2\" tilewidth=\"16\" tileheight=\"16\">"
+            " <layer name=\"A\" width=\"2\" height=\"2\">"
+            "  <data encoding=\"csv\">0,0,0,0</data>"
+            " </layer>"
+            " <layer name=\"B\" width=\"2\" height=\"2\">"
+            "  <data encoding=\"csv\">0,0,0</data>"
+            " </layer>"
+            " <layer name=\"C\" width=\"2\" height=\"2\">"
+            "  <data encoding=\"base64\">AAAA</data>"
+            " </layer>"
+            "</map>");
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+
+    MapReader reader;
+    Map *map = reader.readMap(&buffer, QString());
+
+    QVERIFY(!map);
+    QVERIFY(reader.errorString().contains(QLatin1String("'B'")));
+}
+
+void test_MapReader::largeFirstGidNotWrapped()
+{
+    // The end of this tileset is past the range of a 32-bit ID, which must
+    // not wrap around and make small IDs refer to its tiles
+    QByteArray data(
+            "<map version=\"1.0\" orientation=\"orthogonal\""
+            " width=\"1\" height=\"1\" tilewidth=\"32\" tileheight=\"32\">"
+            " <tileset firstgid=\"4294967290\" name=\"Desert\""
+            "  tilewidth=\"32\" tileheight=\"32\" spacing=\"1\" margin=\"1\">"
+            "  <image source=\"tmw_desert_spacing.png\"/>"
+            " </tileset>"
+            " <layer name=\"A\" width=\"1\" height=\"1\">"
+            "  <data encoding=\"csv\">5</data>"
+            " </layer>"
+            "</map>");
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+
+    MapReader reader;
+    Map *map = reader.readMap(&buffer, QLatin1String("../examples"));
+    QVERIFY2(map, qPrintable(reader.errorString()));
+
+    TileLayer *tileLayer = map->layerAt(0)->asTileLayer();
+    QVERIFY(tileLayer);
+    QVERIFY(tileLayer->cellAt(0, 0).isEmpty());
+
+    qDeleteAll(map->tilesets());
+    delete map;
+}
+
+/**
+ * Returns a map with the given number of tile layers of the given size in
+ * TMX format, using the given layer data format.
+ */
+static QByteArray largeMapData(int width, int height,
+                               MapWriter::LayerDataFormat format,
+                               int layerCount = 1)
+{
+    Map map(Map::Orthogonal, width, height, 16, 16);
+
+    Tileset *tileset = new Tileset(QLatin1String("tiles"), 16, 16);
+    QImage image(256, 256, QImage::Format_ARGB32);
+    image.fill(0);
+    tileset->loadFromImage(image, QString());
+    map.addTileset(tileset);
+
+    for (int i = 0; i < layerCount; ++i) {
+        TileLayer *layer = new TileLayer(QLatin1String("Layer"),
+                                         0, 0, width, height);
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < width; ++x)
+                layer->setCell(x, y,
+                               Cell(tileset->tileAt((x * 7 + y + i) % 64)));
+        map.addLayer(layer);
+    }
+
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+
+    MapWriter writer;
+    writer.setLayerDataFormat(format);
+    writer.writeMap(&map, &buffer);
+
+    delete tileset;
+    return buffer.data();
+}
+
+void test_MapReader::benchmarkLoadLargeLayer_data()
+{
+    QTest::addColumn<int>("format");
+
+    QTest::newRow("base64")
+            << int(MapWriter::Base64);
+    QTest::newRow("base64-zlib")
+            << int(MapWriter::Base64Zlib);
+    QTest::newRow("base64-gzip")
+            << int(MapWriter::Base64Gzip);
+    QTest::newRow("csv")
+            << int(MapWriter::CSV);
+
+    if (isCompressionMethodSupported(Zstandard))
+        QTest::newRow("base64-zstd")
+                << int(MapWriter::Base64Zstandard);
+    if (isCompressionMethodSupported(LZ4))
+        QTest::newRow("base64-lz4")
+                << int(MapWriter::Base64LZ4);
+}
+
+void test_MapReader::benchmarkLoadLargeLayer()
+{
+    QFETCH(int, format);
+
+    QByteArray data = largeMapData(4096, 4096,
+                                   MapWriter::LayerDataFormat(format));
+    QBuffer buffer(&data);
+
+    QBENCHMARK {
+        buffer.open(QIODevice::ReadOnly);
+
+        MapReader reader;
+        Map *map = reader.readMap(&buffer, QString());
+        QVERIFY(map);
+
+        qDeleteAll(map->tilesets());
+        delete map;
+        buffer.close();
+    }
+}
+
+void test_MapReader::benchmarkLoadManyLayers()
+{
+    QByteArray data = largeMapData(1024, 1024, MapWriter::Base64Zlib, 32);
+    QBuffer buffer(&data);
+
+    QBENCHMARK {
+        buffer.open(QIODevice::ReadOnly);
+
+        MapReader reader;
+        Map *map = reader.readMap(&buffer, QString());
+        QVERIFY(map);
+        QCOMPARE(map->layerCount(), 32);
+
+        qDeleteAll(map->tilesets());
+        delete map;
+        buffer.close();
+    }
+}
+
 QTEST_MAIN(test_MapReader)
 #include "test_mapreader.moc"
@@ -0,0 +1,270 @@
+#include "map.h"
+#include "mapreader.h"
+#include "mapwriter.h"
+#include "tilelayer.h"
+
+#include <QtTest/QtTest>
+
+using namespace Tiled;
+
+class test_MapWriter : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void roundTrip_data();
+    void roundTrip();
+    void parallelOutputIdentical_data();
+    void parallelOutputIdentical();
+    void unsupportedCompressionFails();
+
+    void benchmarkSaveLargeMap_data();
+    void benchmarkSaveLargeMap();
+    void benchmarkSaveManyLayers_data();
+    void benchmarkSaveManyLayers();
+};
+
+static void addFormatRows()
+{
+    QTest::addColumn<int>("format");
+
+    QTest::newRow("xml") << int(MapWriter::XML);
+    QTest::newRow("base64") << int(MapWriter::Base64);
+    QTest::newRow("base64-zlib") << int(MapWriter::Base64Zlib);
+    QTest::newRow("base64-gzip") << int(MapWriter::Base64Gzip);
+    QTest::newRow("csv") << int(MapWriter::CSV);
+
+    if (isCompressionMethodSupported(Zstandard))
+        QTest::newRow("base64-zstd") << int(MapWriter::Base64Zstandard);
+    if (isCompressionMethodSupported(LZ4))
+        QTest::newRow("base64-lz4") << int(MapWriter::Base64LZ4);
+}
+
+static QByteArray saveMap(const Map *map, MapWriter::LayerDataFormat format)
+{
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+
+    MapWriter writer;
+    writer.setLayerDataFormat(format);
+    writer.writeMap(map, &buffer, QLatin1String("../examples"));
+
+    return buffer.data();
+}
+
+/**
+ * Returns a copy of \a map with its tile layers repeated until the map has
+ * at least \a cellCount cells.
+ */
+static Map *scaledMap(const Map *map, int cellCount)
+{
+    int factor = 1;
+    while (map->width() * map->height() * factor * factor < cellCount)
+        ++factor;
+
+    const int width = map->width() * factor;
+    const int height = map->height() * factor;
+
+    Map *scaled = new Map(map->orientation(), width, height,
+                          map->tileWidth(), map->tileHeight());
+
+    foreach (Tileset *tileset, map->tilesets())
+        scaled->addTileset(tileset);
+
+    foreach (Layer *layer, map->layers()) {
+        TileLayer *tileLayer = layer->asTileLayer();
+        if (!tileLayer)
+            continue;
+
+        TileLayer *scaledLayer = new TileLayer(tileLayer->name(), 0, 0,
+                                               width, height);
+        for (int y = 0; y < factor; ++y)
+            for (int x = 0; x < factor; ++x)
+                scaledLayer->merge(QPoint(x * tileLayer->width(),
+                                          y * tileLayer->height()),
+                                   tileLayer);
+
+        scaled->addLayer(scaledLayer);
+    }
+
+    return scaled;
+}
+
+/**
+ * Returns a scaled copy of \a map, with its first tile layer repeated to
+ * get the given number of layers.
+ */
+static Map *layeredMap(const Map *map, int cellCount, int layerCount)
+{
+    Map *layered = scaledMap(map, cellCount);
+    const Layer *layer = layered->layerAt(0);
+
+    while (layered->layerCount() < layerCount)
+        layered->addLayer(layer->clone());
+
+    return layered;
+}
+
+void test_MapWriter::roundTrip_data()
+{
+    addFormatRows();
+}
+
+void test_MapWriter::roundTrip()
+{
+    QFETCH(int, format);
+
+    MapReader reader;
+    Map *map = reader.readMap(QLatin1String("../examples/desert.tmx"));
+    QVERIFY(map);
+
+    QByteArray data = saveMap(map, MapWriter::LayerDataFormat(format));
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+
+    Map *readBack = reader.readMap(&buffer, QLatin1String("../examples"));
+    QVERIFY2(readBack, qPrintable(reader.errorString()));
+
+    const TileLayer *layer = map->layerAt(0)->asTileLayer();
+    const TileLayer *readLayer = readBack->layerAt(0)->asTileLayer();
+    QVERIFY(layer && readLayer);
+
+    for (int y = 0; y < layer->height(); ++y) {
+        for (int x = 0; x < layer->width(); ++x) {
+            const Cell cell = layer->cellAt(x, y);
+            const Cell readCell = readLayer->cellAt(x, y);
+            QCOMPARE(readCell.tile == 0, cell.tile == 0);
+            if (cell.tile)
+                QCOMPARE(readCell.tile->id(), cell.tile->id());
+        }
+    }
+
+    qDeleteAll(readBack->tilesets());
+    delete readBack;
+    qDeleteAll(map->tilesets());
+    delete map;
+}
+
+void test_MapWriter::parallelOutputIdentical_data()
+{
+    addFormatRows();
+}
+
+void test_MapWriter::parallelOutputIdentical()
+{
+    QFETCH(int, format);
+
+    MapReader reader;
+    Map *map = reader.readMap(QLatin1String("../examples/desert.tmx"));
+    QVERIFY(map);
+
+    Map *layered = layeredMap(map, 100000, 8);
+
+    QThreadPool *threadPool = QThreadPool::globalInstance();
+    const int maxThreadCount = threadPool->maxThreadCount();
+
+    threadPool->setMaxThreadCount(1);
+    const QByteArray serial =
+            saveMap(layered, MapWriter::LayerDataFormat(format));
+
+    threadPool->setMaxThreadCount(qMax(maxThreadCount, 4));
+    const QByteArray parallel =
+            saveMap(layered, MapWriter::LayerDataFormat(format));
+
+    threadPool->setMaxThreadCount(maxThreadCount);
+
+    QVERIFY(serial == parallel);
+
+    delete layered;
+    qDeleteAll(map->tilesets());
+    delete map;
+}
+
+void test_MapWriter::unsupportedCompressionFails()
+{
+    MapWriter::LayerDataFormat format;
+    if (!isCompressionMethodSupported(Zstandard))
+        format = MapWriter::Base64Zstandard;
+    else if (!isCompressionMethodSupported(LZ4))
+        format = MapWriter::Base64LZ4;
+    else
+        QSKIP("All compression methods are supported", SkipAll);
+
+    MapReader reader;
+    Map *map = reader.readMap(QLatin1String("../examples/desert.tmx"));
+    QVERIFY(map);
+
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+
+    MapWriter writer;
+    writer.setLayerDataFormat(format);
+    QVERIFY(!writer.writeMap(map, &buffer));
+    QVERIFY(!writer.errorString().isEmpty());
+
+    qDeleteAll(map->tilesets());
+    delete map;
+}
+
+void test_MapWriter::benchmarkSaveLargeMap_data()
+{
+    addFormatRows();
+}
+
+void test_MapWriter::benchmarkSaveLargeMap()
+{
+    QFETCH(int, format);
+
+    MapReader reader;
+    Map *map = reader.readMap(QLatin1String("../examples/desert.tmx"));
+    QVERIFY(map);
+
+    Map *scaled = scaledMap(map, 10000000);
+
+    QBENCHMARK {
+        saveMap(scaled, MapWriter::LayerDataFormat(format));
+    }
+
+    delete scaled;
+    qDeleteAll(map->tilesets());
+    delete map;
+}
+
+void test_MapWriter::benchmarkSaveManyLayers_data()
+{
+    QTest::addColumn<int>("threadCount");
+
+    const int idealThreadCount = QThread::idealThreadCount();
+    for (int threads = 1; threads < idealThreadCount; threads *= 2)
+        QTest::newRow(qPrintable(QString::number(threads))) << threads;
+    QTest::newRow(qPrintable(QString::number(idealThreadCount)))
+            << idealThreadCount;
+}
+
+void test_MapWriter::benchmarkSaveManyLayers()
+{
+    QFETCH(int, threadCount);
+
+    MapReader reader;
+    Map *map = reader.readMap(QLatin1String("../examples/desert.tmx"));
+    QVERIFY(map);
+
+    Map *layered = layeredMap(map, 1000000, 30);
+
+    QThreadPool *threadPool = QThreadPool::globalInstance();
+    const int maxThreadCount = threadPool->maxThreadCount();
+    threadPool->setMaxThreadCount(threadCount);
+
+    QBENCHMARK {
+        saveMap(layered, MapWriter::Base64Zlib);
+    }
+
+    threadPool->setMaxThreadCount(maxThreadCount);
+
+    delete layered;
+    qDeleteAll(map->tilesets());
+    delete map;
+}
+
+QTEST_MAIN(test_MapWriter)
+#include "test_mapwriter.moc"
@@ -0,0 +1,160 @@
+#include "mapobject.h"
+#include "objectgroup.h"
+
+#include <QtTest/QtTest>
+
+using namespace Tiled;
+
+class test_ObjectGroup : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void objectsInRect();
+    void indexFollowsChanges();
+    void hugeObject();
+
+    void benchmarkObjectsInRect_data();
+    void benchmarkObjectsInRect();
+};
+
+/**
+ * Returns the objects overlapping \a rect by checking all of them.
+ */
+static QSet<MapObject*> scanObjects(const ObjectGroup &group,
+                                    const QRectF &rect)
+{
+    QSet<MapObject*> result;
+    foreach (MapObject *object, group.objects()) {
+        const QRectF bounds = object->bounds().normalized();
+        if (bounds.left() <= rect.right() && rect.left() <= bounds.right() &&
+                bounds.top() <= rect.bottom() && rect.top() <= bounds.bottom())
+            result.insert(object);
+    }
+    return result;
+}
+
+/**
+ * Fills the object group with \a count objects of various sizes, spread over
+ * an area of \a size tiles.
+ */
+static void addObjects(ObjectGroup &group, int count, int size)
+{
+    qsrand(42);
+    for (int i = 0; i < count; ++i) {
+        const qreal x = qrand() % (size * 10) / qreal(10);
+        const qreal y = qrand() % (size * 10) / qreal(10);
+
+        qreal width = 0, height = 0;
+        switch (i % 4) {
+        case 0: break; // Point objects, like tile objects
+        case 1: width = 1; height = 1; break;
+        case 2: width = qrand() % 30 / qreal(10); height = 2.5; break;
+        case 3: width = qrand() % 400; height = qrand() % 100; break;
+        }
+
+        group.addObject(new MapObject(QString(), QString(),
+                                      x, y, width, height));
+    }
+}
+
+void test_ObjectGroup::objectsInRect()
+{
+    ObjectGroup group(QLatin1String("Objects"), 0, 0, 200, 200);
+    addObjects(group, 2000, 200);
+
+    const QRectF rects[] = {
+        QRectF(10, 10, 5, 5),
+        QRectF(0, 0, 200, 200),
+        QRectF(-50, -50, 10, 10),
+        QRectF(63.5, 24, 0, 0),
+        QRectF(120, 80, -16, -20),
+        QRectF(7.9, 8, 0.2, 40)
+    };
+
+    for (int i = 0; i < 6; ++i) {
+        const QRectF rect = rects[i].normalized();
+        QCOMPARE(group.objectsInRect(rects[i]).toSet(),
+                 scanObjects(group, rect));
+    }
+
+    // A single object should be found exactly once
+    const QList<MapObject*> found = group.objectsInRect(rects[1]);
+    QCOMPARE(found.toSet().size(), found.size());
+}
+
+void test_ObjectGroup::indexFollowsChanges()
+{
+    ObjectGroup group(QLatin1String("Objects"), 0, 0, 100, 100);
+    MapObject *object = new MapObject(QString(), QString(), 10, 10, 1, 1);
+    group.addObject(object);
+
+    QCOMPARE(group.objectsAt(QPointF(10.5, 10.5)).size(), 1);
+
+    object->setPosition(QPointF(50, 60));
+    QVERIFY(group.objectsAt(QPointF(10.5, 10.5)).isEmpty());
+    QCOMPARE(group.objectsAt(QPointF(50.5, 60.5)).size(), 1);
+
+    object->setSize(QSizeF(30, 2));
+    QCOMPARE(group.objectsAt(QPointF(79, 61)).size(), 1);
+
+    object->setX(-5000);
+    QVERIFY(group.objectsAt(QPointF(79, 61)).isEmpty());
+    QCOMPARE(group.objectsAt(QPointF(-4990, 61)).size(), 1);
+
+    group.resize(QSize(100, 100), QPoint(5000, 0));
+    QCOMPARE(group.objectsAt(QPointF(10, 61)).size(), 1);
+
+    group.removeObject(object);
+    QVERIFY(group.objectsAt(QPointF(10, 61)).isEmpty());
+
+    // No longer part of the group, so it should not be indexed again
+    object->setPosition(QPointF(10, 10));
+    QVERIFY(group.objectsAt(QPointF(10.5, 10.5)).isEmpty());
+    delete object;
+}
+
+void test_ObjectGroup::hugeObject()
+{
+    // Covers 65536 by 65536 index cells, a number that doesn't fit an int
+    ObjectGroup group(QLatin1String("Objects"), 0, 0, 100, 100);
+    group.addObject(new MapObject(QString(), QString(),
+                                  0, 0, 524280, 524280));
+
+    QCOMPARE(group.objectsAt(QPointF(10, 10)).size(), 1);
+}
+
+void test_ObjectGroup::benchmarkObjectsInRect_data()
+{
+    QTest::addColumn<bool>("indexed");
+
+    QTest::newRow("scan") << false;
+    QTest::newRow("index") << true;
+}
+
+/**
+ * Measures looking up the objects within a view-sized area of a map with
+ * 50000 objects.
+ */
+void test_ObjectGroup::benchmarkObjectsInRect()
+{
+    QFETCH(bool, indexed);
+
+    ObjectGroup group(QLatin1String("Objects"), 0, 0, 2000, 2000);
+    addObjects(group, 50000, 2000);
+
+    int offset = 0;
+
+    QBENCHMARK {
+        const QRectF rect(offset % 1900, offset % 1950, 40, 25);
+        offset += 7;
+
+        if (indexed)
+            group.objectsInRect(rect);
+        else
+            scanObjects(group, rect);
+    }
+}
+
+QTEST_MAIN(test_ObjectGroup)
+#include "test_objectgroup.moc"
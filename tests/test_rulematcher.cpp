@@ -0,0 +1,226 @@
+#include "map.h"
+#include "mapreader.h"
+#include "rulematcher.h"
+#include "tilelayer.h"
+#include "tileset.h"
+
+#include <QtTest/QtTest>
+
+using namespace Tiled;
+using namespace Tiled::Internal;
+
+static const char SewersPath[] = "../examples/sewer_automap/";
+
+class test_RuleMatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    test_RuleMatcher() : mSewers(0) {}
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void candidatesFindAllMatches();
+
+    void benchmarkSewers_data();
+    void benchmarkSewers();
+
+private:
+    TileLayer *tiledSetLayer(int width, int height) const;
+
+    Map *mSewers;
+    QList<Map*> mRuleMaps;
+    QList<RuleMatcher*> mMatchers;
+    QList<RuleMatcher::TilesetMap> mTilesets;
+};
+
+static TileLayer *findTileLayer(const Map *map, const QString &name)
+{
+    foreach (Layer *layer, map->layers())
+        if (layer->name().compare(name, Qt::CaseInsensitive) == 0)
+            return layer->asTileLayer();
+    return 0;
+}
+
+/**
+ * Loads the sewers example map along with its rules. The tilesets of the
+ * example map are translated to those of the rules maps, like the AutoMapper
+ * does.
+ */
+void test_RuleMatcher::initTestCase()
+{
+    const QString path = QLatin1String(SewersPath);
+
+    MapReader reader;
+    mSewers = reader.readMap(path + QLatin1String("sewers.tmx"));
+    QVERIFY(mSewers);
+
+    for (int i = 1; i <= 7; ++i) {
+        const QString fileName = QString(QLatin1String("rule_%1.tmx"))
+                .arg(i, 3, 10, QLatin1Char('0'));
+        Map *rules = reader.readMap(path + fileName);
+        QVERIFY(rules);
+
+        RuleMatcher::TilesetMap tilesets;
+        foreach (Tileset *tileset, rules->tilesets()) {
+            if (Tileset *similar =
+                    tileset->findSimilarTileset(mSewers->tilesets()))
+                tilesets.insert(similar, tileset);
+        }
+
+        QVector<TileLayer*> ruleSets;
+        QVector<TileLayer*> ruleNotSets;
+        foreach (Layer *layer, rules->layers()) {
+            if (layer->name().compare(QLatin1String("RuleSet"),
+                                      Qt::CaseInsensitive) == 0)
+                ruleSets.append(layer->asTileLayer());
+            else if (layer->name().compare(QLatin1String("RuleNotSet"),
+                                           Qt::CaseInsensitive) == 0)
+                ruleNotSets.append(layer->asTileLayer());
+        }
+
+        const TileLayer *regions =
+                findTileLayer(rules, QLatin1String("RuleRegions"));
+        QVERIFY(regions);
+
+        RuleMatcher *matcher = new RuleMatcher;
+        matcher->setRules(regions, ruleSets, ruleNotSets);
+        QVERIFY(matcher->ruleCount() > 0);
+
+        mRuleMaps.append(rules);
+        mMatchers.append(matcher);
+        mTilesets.append(tilesets);
+    }
+}
+
+void test_RuleMatcher::cleanupTestCase()
+{
+    qDeleteAll(mMatchers);
+    foreach (Map *rules, mRuleMaps)
+        qDeleteAll(rules->tilesets());
+    qDeleteAll(mRuleMaps);
+    if (mSewers)
+        qDeleteAll(mSewers->tilesets());
+    delete mSewers;
+}
+
+/**
+ * Returns a set layer of the given size, on which the set layer of the
+ * sewers example is repeated.
+ */
+TileLayer *test_RuleMatcher::tiledSetLayer(int width, int height) const
+{
+    const TileLayer *set = findTileLayer(mSewers, QLatin1String("set"));
+
+    TileLayer *layer = new TileLayer(QLatin1String("set"), 0, 0,
+                                     width, height);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            layer->setCell(x, y, set->cellAt(x % set->width(),
+                                             y % set->height()));
+    return layer;
+}
+
+/**
+ * Checks that looking up the candidates, either directly or split up over
+ * multiple threads, finds the same matches as checking the rules at every
+ * position.
+ */
+void test_RuleMatcher::candidatesFindAllMatches()
+{
+    QScopedPointer<TileLayer> setLayer(tiledSetLayer(70, 50));
+    const QRect where(10, 5, 40, 30);
+
+    int matchCount = 0;
+
+    for (int i = 0; i < mMatchers.size(); ++i) {
+        const RuleMatcher *matcher = mMatchers.at(i);
+        const RuleMatcher::TilesetMap *tilesets = &mTilesets.at(i);
+        const TileLayer *layer = setLayer.data();
+
+        const QVector<QVector<QPoint> > candidates =
+                matcher->candidates(layer, where, tilesets);
+        const QVector<QVector<QPoint> > matches =
+                matcher->findMatches(layer, where, tilesets);
+
+        for (int rule = 0; rule < matcher->ruleCount(); ++rule) {
+            const QRect area = matcher->searchArea(rule, where);
+            QVector<QPoint> expected;
+            for (int y = area.top(); y <= area.bottom(); ++y) {
+                for (int x = area.left(); x <= area.right(); ++x) {
+                    const QPoint offset(x, y);
+                    if (matcher->matches(rule, layer, offset, tilesets))
+                        expected.append(offset);
+                }
+            }
+
+            QVector<QPoint> found;
+            foreach (const QPoint &offset, candidates.at(rule))
+                if (matcher->matches(rule, layer, offset, tilesets))
+                    found.append(offset);
+
+            QCOMPARE(found, expected);
+            QCOMPARE(matches.at(rule), expected);
+            matchCount += found.size();
+        }
+    }
+
+    QVERIFY(matchCount > 0);
+}
+
+void test_RuleMatcher::benchmarkSewers_data()
+{
+    QTest::addColumn<bool>("indexed");
+    QTest::addColumn<bool>("threaded");
+
+    QTest::newRow("all positions") << false << false;
+    QTest::newRow("index") << true << false;
+    QTest::newRow("index, threaded") << true << true;
+}
+
+/**
+ * Finds where the rules of the sewers example match on a 1024x1024 map.
+ */
+void test_RuleMatcher::benchmarkSewers()
+{
+    QFETCH(bool, indexed);
+    QFETCH(bool, threaded);
+
+    QScopedPointer<TileLayer> setLayer(tiledSetLayer(1024, 1024));
+    const QRect where(0, 0, 1024, 1024);
+
+    QBENCHMARK {
+        for (int i = 0; i < mMatchers.size(); ++i) {
+            const RuleMatcher *matcher = mMatchers.at(i);
+            const RuleMatcher::TilesetMap *tilesets = &mTilesets.at(i);
+            const TileLayer *layer = setLayer.data();
+
+            if (threaded) {
+                matcher->findMatches(layer, where, tilesets);
+                continue;
+            }
+
+            QVector<QVector<QPoint> > candidates;
+            if (indexed)
+                candidates = matcher->candidates(layer, where, tilesets);
+
+            for (int rule = 0; rule < matcher->ruleCount(); ++rule) {
+                if (indexed) {
+                    foreach (const QPoint &offset, candidates.at(rule))
+                        matcher->matches(rule, layer, offset, tilesets);
+                    continue;
+                }
+
+                const QRect area = matcher->searchArea(rule, where);
+                for (int y = area.top(); y <= area.bottom(); ++y)
+                    for (int x = area.left(); x <= area.right(); ++x)
+                        matcher->matches(rule, layer, QPoint(x, y), tilesets);
+            }
+        }
+    }
+}
+
+QTEST_MAIN(test_RuleMatcher)
+#include "test_rulematcher.moc"
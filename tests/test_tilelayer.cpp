@@ -0,0 +1,247 @@
+#include "tile.h"
+#include "tilelayer.h"
+#include "tileset.h"
+
+#include <QtTest/QtTest>
+
+using namespace Tiled;
+
+class test_TileLayer : public QObject
+{
+    Q_OBJECT
+
+public:
+    test_TileLayer();
+    ~test_TileLayer();
+
+private slots:
+    void setAndGetCells();
+    void region();
+    void resize();
+    void flip();
+    void copy();
+    void tilesetReferences();
+    void differences();
+
+    void benchmarkSparseFill();
+    void benchmarkSparseRegion();
+    void benchmarkNoisyTilesetReferences_data();
+    void benchmarkNoisyTilesetReferences();
+
+private:
+    Tileset *mTileset;
+    Tile *mTile;
+};
+
+test_TileLayer::test_TileLayer()
+    : mTileset(new Tileset(QLatin1String("tiles"), 32, 32))
+    , mTile(new Tile(QPixmap(), 0, mTileset))
+{
+}
+
+test_TileLayer::~test_TileLayer()
+{
+    delete mTile;
+    delete mTileset;
+}
+
+void test_TileLayer::setAndGetCells()
+{
+    TileLayer layer(QLatin1String("Layer"), 0, 0, 100, 50);
+    QVERIFY(layer.isEmpty());
+
+    layer.setCell(0, 0, Cell(mTile));
+    layer.setCell(99, 49, Cell(mTile));
+
+    QVERIFY(!layer.isEmpty());
+    QCOMPARE(layer.cellAt(0, 0).tile, mTile);
+    QCOMPARE(layer.cellAt(99, 49).tile, mTile);
+    QVERIFY(layer.cellAt(50, 25).isEmpty());
+
+    layer.setCell(0, 0, Cell());
+    layer.setCell(99, 49, Cell());
+    QVERIFY(layer.isEmpty());
+}
+
+void test_TileLayer::region()
+{
+    TileLayer layer(QLatin1String("Layer"), 2, 3, 100, 50);
+
+    // A run crossing the boundary between two chunks
+    for (int x = 10; x < 40; ++x)
+        layer.setCell(x, 20, Cell(mTile));
+    layer.setCell(99, 49, Cell(mTile));
+
+    QRegion expected;
+    expected += QRect(12, 23, 30, 1);
+    expected += QRect(101, 52, 1, 1);
+
+    QCOMPARE(layer.region().toRegion(), expected);
+}
+
+void test_TileLayer::resize()
+{
+    TileLayer layer(QLatin1String("Layer"), 0, 0, 20, 20);
+    layer.setCell(5, 5, Cell(mTile));
+    layer.setCell(19, 19, Cell(mTile));
+
+    layer.resize(QSize(40, 10), QPoint(20, -2));
+
+    QCOMPARE(layer.width(), 40);
+    QCOMPARE(layer.height(), 10);
+    QCOMPARE(layer.cellAt(25, 3).tile, mTile);
+    QCOMPARE(layer.region().toRegion(), QRegion(25, 3, 1, 1));
+}
+
+void test_TileLayer::flip()
+{
+    TileLayer layer(QLatin1String("Layer"), 0, 0, 20, 20);
+    layer.setCell(1, 2, Cell(mTile));
+
+    layer.flip(TileLayer::FlipHorizontally);
+    QVERIFY(layer.cellAt(1, 2).isEmpty());
+    QCOMPARE(layer.cellAt(18, 2).tile, mTile);
+    QVERIFY(layer.cellAt(18, 2).flippedHorizontally);
+
+    layer.flip(TileLayer::FlipVertically);
+    QCOMPARE(layer.cellAt(18, 17).tile, mTile);
+    QVERIFY(layer.cellAt(18, 17).flippedVertically);
+}
+
+void test_TileLayer::copy()
+{
+    TileLayer layer(QLatin1String("Layer"), 0, 0, 64, 64);
+    layer.setCell(30, 30, Cell(mTile));
+    layer.setCell(33, 34, Cell(mTile));
+
+    TileLayer *copied = layer.copy(28, 28, 8, 8);
+    QCOMPARE(copied->width(), 8);
+    QCOMPARE(copied->cellAt(2, 2).tile, mTile);
+    QCOMPARE(copied->cellAt(5, 6).tile, mTile);
+    QCOMPARE(copied->region().toRegion(),
+             QRegion(2, 2, 1, 1) + QRegion(5, 6, 1, 1));
+    delete copied;
+}
+
+void test_TileLayer::tilesetReferences()
+{
+    Tileset otherTileset(QLatin1String("other"), 32, 32);
+    Tile otherTile(QPixmap(), 0, &otherTileset);
+
+    TileLayer layer(QLatin1String("Layer"), 0, 0, 40, 40);
+    Cell flipped(mTile);
+    flipped.flippedVertically = true;
+    layer.setCell(3, 4, flipped);
+    layer.setCell(30, 31, Cell(&otherTile));
+
+    QCOMPARE(layer.usedTilesets().size(), 2);
+    QVERIFY(layer.referencesTileset(mTileset));
+    QCOMPARE(layer.tilesetReferences(mTileset).toRegion(),
+             QRegion(3, 4, 1, 1));
+    QVERIFY(layer.cellAt(3, 4) == flipped);
+
+    layer.removeReferencesToTileset(&otherTileset);
+    QVERIFY(!layer.referencesTileset(&otherTileset));
+    QVERIFY(layer.cellAt(30, 31).isEmpty());
+    QCOMPARE(layer.cellAt(3, 4).tile, mTile);
+}
+
+void test_TileLayer::differences()
+{
+    TileLayer layer(QLatin1String("Layer"), 0, 0, 100, 50);
+    layer.setCell(5, 5, Cell(mTile));
+    layer.setCell(60, 20, Cell(mTile));
+
+    QScopedPointer<TileLayer> before(static_cast<TileLayer*>(layer.clone()));
+    QVERIFY(layer.differences(*before).isEmpty());
+
+    Cell flipped(mTile);
+    flipped.flippedHorizontally = true;
+    layer.setCell(5, 5, Cell());
+    layer.setCell(6, 5, Cell(mTile));
+    layer.setCell(60, 20, flipped);
+    layer.setCell(61, 20, Cell(mTile));
+    layer.setCell(90, 40, Cell(mTile));
+    layer.setCell(90, 40, Cell());     // Detaches, but is unchanged
+
+    QCOMPARE(layer.differences(*before).toRegion(),
+             QRegion(5, 5, 2, 1) + QRegion(60, 20, 2, 1));
+}
+
+/*
+ * The benchmarks below work on a 4096x4096 layer of which only a few areas
+ * are painted. With the dense layout these needed 16M cells (256 MB on 64-bit
+ * systems) regardless of the painted area. Now each painted 16x16 chunk takes
+ * 1 KB of packed cells.
+ */
+
+static void paintSparse(TileLayer &layer, Tile *tile)
+{
+    for (int i = 0; i < 16; ++i) {
+        const int originX = (i * 997) % (layer.width() - 64);
+        const int originY = (i * 1499) % (layer.height() - 64);
+        for (int y = 0; y < 64; ++y)
+            for (int x = 0; x < 64; ++x)
+                layer.setCell(originX + x, originY + y, Cell(tile));
+    }
+}
+
+void test_TileLayer::benchmarkSparseFill()
+{
+    QBENCHMARK {
+        TileLayer layer(QLatin1String("Layer"), 0, 0, 4096, 4096);
+        paintSparse(layer, mTile);
+    }
+}
+
+void test_TileLayer::benchmarkSparseRegion()
+{
+    TileLayer layer(QLatin1String("Layer"), 0, 0, 4096, 4096);
+    paintSparse(layer, mTile);
+
+    QBENCHMARK {
+        layer.region();
+    }
+}
+
+void test_TileLayer::benchmarkNoisyTilesetReferences_data()
+{
+    QTest::addColumn<bool>("toRegion");
+
+    QTest::newRow("TileRegion") << false;
+    QTest::newRow("QRegion") << true;
+}
+
+/**
+ * Finds the references to one of two tilesets on a 2048x2048 layer on which
+ * tiles from both are mixed randomly, which makes for a very fragmented
+ * region.
+ */
+void test_TileLayer::benchmarkNoisyTilesetReferences()
+{
+    QFETCH(bool, toRegion);
+
+    Tileset otherTileset(QLatin1String("other"), 32, 32);
+    Tile otherTile(QPixmap(), 0, &otherTileset);
+
+    TileLayer layer(QLatin1String("Layer"), 0, 0, 2048, 2048);
+    qsrand(1);
+    for (int y = 0; y < layer.height(); ++y) {
+        for (int x = 0; x < layer.width(); ++x) {
+            switch (qrand() % 3) {
+            case 0: layer.setCell(x, y, Cell(mTile)); break;
+            case 1: layer.setCell(x, y, Cell(&otherTile)); break;
+            default: break;
+            }
+        }
+    }
+
+    QBENCHMARK {
+        const TileRegion refs = layer.tilesetReferences(mTileset);
+        if (toRegion)
+            refs.toRegion();
+    }
+}
+
+QTEST_MAIN(test_TileLayer)
+#include "test_tilelayer.moc"
@@ -0,0 +1,213 @@
+#include "map.h"
+#include "orthogonalrenderer.h"
+#include "tilelayer.h"
+#include "tilelayeritem.h"
+#include "tileset.h"
+
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+#include <QtTest/QtTest>
+
+using namespace Tiled;
+using namespace Tiled::Internal;
+
+class test_TileLayerItem : public QObject
+{
+    Q_OBJECT
+
+public:
+    test_TileLayerItem();
+    ~test_TileLayerItem();
+
+private slots:
+    void cachedMatchesDirect();
+    void overviewFollowsEdits();
+
+    void benchmarkScroll_data();
+    void benchmarkScroll();
+
+private:
+    Map *createMap(int width, int height);
+
+    Tileset *mTileset;
+};
+
+test_TileLayerItem::test_TileLayerItem()
+{
+    // A tileset of 16 differently colored tiles
+    QImage image(128, 64, QImage::Format_ARGB32);
+    for (int i = 0; i < 16; ++i) {
+        QPainter painter(&image);
+        painter.fillRect((i % 4) * 32, (i / 4) * 32, 32, 32,
+                         QColor::fromHsv(i * 22, 255, 255));
+    }
+
+    mTileset = new Tileset(QLatin1String("tiles"), 32, 32);
+    mTileset->loadFromImage(image, QString());
+}
+
+test_TileLayerItem::~test_TileLayerItem()
+{
+    delete mTileset;
+}
+
+/**
+ * Returns a map with a single tile layer filled with a pattern of tiles.
+ */
+Map *test_TileLayerItem::createMap(int width, int height)
+{
+    Map *map = new Map(Map::Orthogonal, width, height, 32, 32);
+    map->addTileset(mTileset);
+
+    TileLayer *layer = new TileLayer(QLatin1String("Layer"),
+                                     0, 0, width, height);
+    map->addLayer(layer);
+
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            if ((x + y) % 5 != 0)
+                layer->setCell(x, y, Cell(mTileset->tileAt((x * 3 + y) % 8)));
+
+    return map;
+}
+
+/**
+ * Paints the item into \a image with the given view transform, the way
+ * a QGraphicsView would.
+ */
+static void paintItem(QImage &image, TileLayerItem &item,
+                      const QTransform &transform)
+{
+    image.fill(0);
+
+    QPainter painter(&image);
+    painter.setWorldTransform(transform);
+
+    QStyleOptionGraphicsItem option;
+    option.exposedRect = transform.inverted().mapRect(QRectF(image.rect()));
+    item.paint(&painter, &option);
+}
+
+void test_TileLayerItem::cachedMatchesDirect()
+{
+    Map *map = createMap(64, 64);
+    TileLayer *layer = map->layerAt(0)->asTileLayer();
+    OrthogonalRenderer renderer(map);
+    TileLayerItem item(layer, &renderer);
+
+    const QTransform transform = QTransform::fromTranslate(-300, -200);
+    QImage cached(640, 480, QImage::Format_ARGB32_Premultiplied);
+    QImage direct(640, 480, QImage::Format_ARGB32_Premultiplied);
+
+    for (int pass = 0; pass < 2; ++pass) {
+        paintItem(cached, item, transform);
+
+        direct.fill(0);
+        QPainter painter(&direct);
+        painter.setWorldTransform(transform);
+        renderer.drawTileLayer(&painter, layer,
+                               transform.inverted().mapRect(
+                                   QRectF(direct.rect())));
+        painter.end();
+
+        QVERIFY(cached == direct);
+
+        // Change some tiles, which should only be picked up by the cache
+        // after invalidating them
+        const QRegion changed(12, 10, 3, 2);
+        foreach (const QRect &r, changed.rects())
+            for (int y = r.top(); y <= r.bottom(); ++y)
+                for (int x = r.left(); x <= r.right(); ++x)
+                    layer->setCell(x, y, Cell(mTileset->tileAt(15)));
+        item.invalidateRegion(changed);
+    }
+
+    delete map;
+}
+
+/**
+ * When zoomed out far enough, each cell should be drawn in the average color
+ * of its tile, also after changing the cell.
+ */
+void test_TileLayerItem::overviewFollowsEdits()
+{
+    Map *map = createMap(64, 64);
+    TileLayer *layer = map->layerAt(0)->asTileLayer();
+    OrthogonalRenderer renderer(map);
+    TileLayerItem item(layer, &renderer);
+
+    // Tiles become 2x2 pixels
+    const QTransform transform = QTransform::fromScale(0.0625, 0.0625);
+    QImage frame(128, 128, QImage::Format_ARGB32_Premultiplied);
+
+    const QPoint cellPos(10, 7);
+    const QPoint pixelPos(cellPos * 2);
+
+    paintItem(frame, item, transform);
+    QCOMPARE(frame.pixel(pixelPos),
+             layer->cellAt(cellPos).tile->averageColor());
+
+    layer->setCell(cellPos.x(), cellPos.y(), Cell(mTileset->tileAt(15)));
+    item.invalidateRegion(QRect(cellPos, QSize(1, 1)));
+
+    paintItem(frame, item, transform);
+    QCOMPARE(frame.pixel(pixelPos), mTileset->tileAt(15)->averageColor());
+
+    delete map;
+}
+
+void test_TileLayerItem::benchmarkScroll_data()
+{
+    QTest::addColumn<qreal>("scale");
+    QTest::addColumn<bool>("cached");
+
+    const qreal scales[] = { 0.0625, 0.25, 0.5, 1, 2 };
+    for (int i = 0; i < 5; ++i) {
+        const QString zoom = QString::number(scales[i] * 100);
+        QTest::newRow(qPrintable(zoom + QLatin1String("% direct")))
+                << scales[i] << false;
+        QTest::newRow(qPrintable(zoom + QLatin1String("% cached")))
+                << scales[i] << true;
+    }
+}
+
+/**
+ * Measures the time it takes to paint a frame while scrolling diagonally
+ * through a 1000x1000 map.
+ */
+void test_TileLayerItem::benchmarkScroll()
+{
+    QFETCH(qreal, scale);
+    QFETCH(bool, cached);
+
+    Map *map = createMap(1000, 1000);
+    TileLayer *layer = map->layerAt(0)->asTileLayer();
+    OrthogonalRenderer renderer(map);
+    TileLayerItem item(layer, &renderer);
+
+    QImage frame(1280, 720, QImage::Format_ARGB32_Premultiplied);
+    int offset = 0;
+
+    QBENCHMARK {
+        QTransform transform;
+        transform.translate(-offset, -offset);
+        transform.scale(scale, scale);
+        offset += 8;
+
+        if (cached) {
+            paintItem(frame, item, transform);
+        } else {
+            frame.fill(0);
+            QPainter painter(&frame);
+            painter.setWorldTransform(transform);
+            renderer.drawTileLayer(&painter, layer,
+                                   transform.inverted().mapRect(
+                                       QRectF(frame.rect())));
+        }
+    }
+
+    delete map;
+}
+
+QTEST_MAIN(test_TileLayerItem)
+#include "test_tilelayeritem.moc"
@@ -0,0 +1,76 @@
+#include "tileregion.h"
+
+#include <QtTest/QtTest>
+
+using namespace Tiled;
+
+class test_TileRegion : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void setOperations_data();
+    void setOperations();
+    void addSpan();
+};
+
+void test_TileRegion::setOperations_data()
+{
+    QTest::addColumn<QRegion>("a");
+    QTest::addColumn<QRegion>("b");
+
+    QTest::newRow("disjoint")
+            << QRegion(0, 0, 4, 4) << QRegion(10, 10, 3, 3);
+    QTest::newRow("overlapping")
+            << QRegion(0, 0, 6, 6) << QRegion(3, 2, 6, 6);
+    QTest::newRow("touching")
+            << QRegion(0, 0, 4, 4) << QRegion(4, 0, 4, 4);
+    QTest::newRow("contained")
+            << QRegion(0, 0, 10, 10) << QRegion(2, 3, 4, 2);
+    QTest::newRow("fragmented")
+            << (QRegion(0, 0, 2, 8) + QRegion(4, 0, 2, 8) + QRegion(0, 3, 8, 1))
+            << (QRegion(1, 1, 4, 1) + QRegion(3, 5, 6, 6));
+    QTest::newRow("empty")
+            << QRegion(2, 2, 5, 5) << QRegion();
+}
+
+/**
+ * Checks the set operations against the ones of QRegion.
+ */
+void test_TileRegion::setOperations()
+{
+    QFETCH(QRegion, a);
+    QFETCH(QRegion, b);
+
+    const TileRegion tileA(a);
+    const TileRegion tileB(b);
+
+    QCOMPARE(tileA.toRegion(), a);
+    QCOMPARE((tileA | tileB).toRegion(), a | b);
+    QCOMPARE((tileA & tileB).toRegion(), a & b);
+    QCOMPARE((tileA - tileB).toRegion(), a - b);
+    QCOMPARE(tileA.translated(3, -2).toRegion(), a.translated(3, -2));
+    QCOMPARE(tileA.intersects(tileB), a.intersects(b));
+    QCOMPARE(tileA.boundingRect(), a.boundingRect());
+
+    for (int y = -1; y < 12; ++y)
+        for (int x = -1; x < 12; ++x)
+            QCOMPARE(tileA.contains(x, y), a.contains(QPoint(x, y)));
+}
+
+void test_TileRegion::addSpan()
+{
+    TileRegion region;
+    region.addSpan(5, 0, 3);
+    region.addSpan(0, 0, 2);
+    region.addSpan(2, 0, 3);    // joins both spans
+    region.addSpan(1, 1, 2);
+
+    QCOMPARE(region.spans().size(), 2);
+    QCOMPARE(region.spans().at(0), TileRegion::Span(0, 0, 8));
+    QCOMPARE(region.spans().at(1), TileRegion::Span(1, 1, 3));
+    QCOMPARE(region.cellCount(), 10);
+}
+
+QTEST_MAIN(test_TileRegion)
+#include "test_tileregion.moc"